@@ -36,8 +36,15 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <vcg/complex/algorithms/closest.h>
 #include <vcg/complex/algorithms/local_optimization/tri_edge_collapse.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
 #include <memory>
 
+#include <progress.h>
+#include <scheduler.h>
+
 template <class Mesh>
 class AutoRemesher {
 
@@ -183,6 +190,11 @@ public:
         ScalarType maxAdaptiveMult = 3;
         ScalarType minAspectRatioThr = 0.05;
         ScalarType targetEdgeLen = 0;
+        double timeLimit = 0; //seconds for the whole remeshing, 0 for no limit
+        int partitionFaces = 50000; //faces per patch of the parallel remeshing, 0 to remesh the whole mesh at once
+        int partitionIterations = 3; //iterations of a parallel pass, the patches move after each pass
+        int iterationsDone = 0; //output: iterations run by each pass
+        Progress* progress = nullptr; //reported after each iteration, can cancel the remeshing
     } Params;
 
     static size_t openNonManifoldEdges(Mesh & m, const ScalarType moveThreshold,
@@ -356,6 +368,444 @@ public:
 
     }
 
+    //Number of patches remeshed in parallel, less than 2 to remesh the whole mesh
+    static size_t NumPatches(const Mesh & m, const Params & par)
+    {
+        const size_t threads = Scheduler::threads();
+        if (par.partitionFaces <= 0 || threads < 2)
+            return 1;
+        return std::min<size_t>(m.FN() / par.partitionFaces, 4 * threads);
+    }
+
+    //The seam edges (borders of sub between two seam vertices) as the sorted
+    //indices in the whole mesh of their vertices, with their crease flag
+    typedef std::pair<std::pair<size_t, size_t>, bool> SeamEdge;
+
+    static std::vector<SeamEdge> SeamEdges(Mesh & sub, const std::vector<size_t> & seamIndex)
+    {
+        std::vector<SeamEdge> edges;
+        for (size_t i = 0; i < sub.face.size(); ++i)
+        {
+            if (sub.face[i].IsD())continue;
+            for (int j = 0; j < 3; ++j)
+            {
+                if (!vcg::face::IsBorder(sub.face[i], j))continue;
+                const size_t v0 = seamIndex[vcg::tri::Index(sub, sub.face[i].cV0(j))];
+                const size_t v1 = seamIndex[vcg::tri::Index(sub, sub.face[i].cV1(j))];
+                if (v0 == 0 || v1 == 0)continue;
+                edges.push_back(SeamEdge(std::make_pair(std::min(v0, v1), std::max(v0, v1)),
+                                         sub.face[i].IsFaceEdgeS(j)));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        return edges;
+    }
+
+    //Copy the faces of m into sub, with their vertices: sub.vert[i] is the
+    //copy of m.vert[verts[i]]
+    static void CopyFaces(const Mesh & m,
+                          const std::vector<size_t> & faces,
+                          Mesh & sub,
+                          std::vector<size_t> & verts)
+    {
+        verts.clear();
+        verts.reserve(faces.size() * 3);
+        for (size_t i = 0; i < faces.size(); ++i)
+            for (int j = 0; j < 3; ++j)
+                verts.push_back(vcg::tri::Index(m, m.face[faces[i]].cV(j)));
+        std::sort(verts.begin(), verts.end());
+        verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+
+        vcg::tri::Allocator<Mesh>::AddVertices(sub, verts.size());
+        vcg::tri::Allocator<Mesh>::AddFaces(sub, faces.size());
+        for (size_t i = 0; i < verts.size(); ++i)
+            sub.vert[i].ImportData(m.vert[verts[i]]);
+        for (size_t i = 0; i < faces.size(); ++i)
+        {
+            const FaceType & f = m.face[faces[i]];
+            sub.face[i].ImportData(f);
+            for (int j = 0; j < 3; ++j)
+                sub.face[i].V(j) = &sub.vert[std::lower_bound(verts.begin(), verts.end(), vcg::tri::Index(m, f.cV(j))) - verts.begin()];
+        }
+    }
+
+    //Remesh the faces of a patch of m as the mesh sub. The faces touching the
+    //seam (the vertices shared with other patches) are a frozen halo: they are
+    //left out of the selection, so the seam is not changed and the patch can be
+    //put back. The patch is projected onto the faces targetFaces of the mesh
+    //original, the surface the pass started from, so that it does not drift
+    //from pass to pass. seamIndex gets the index+1 in m of the seam vertices
+    //of sub, 0 for the others. Returns false if the seam did not survive the
+    //remeshing
+    static bool RemeshPatch(const Mesh & m,
+                            const std::vector<size_t> & faces,
+                            const std::vector<bool> & seam,
+                            const Mesh & original,
+                            const std::vector<size_t> & targetFaces,
+                            typename vcg::tri::IsotropicRemeshing<Mesh>::Params para,
+                            Mesh & sub,
+                            std::vector<size_t> & seamIndex)
+    {
+        std::vector<size_t> verts;
+        CopyFaces(m, faces, sub, verts);
+
+        //the attribute follows the vertices through the remeshing
+        typename Mesh::template PerVertexAttributeHandle<size_t> handle =
+                vcg::tri::Allocator<Mesh>::template GetPerVertexAttribute<size_t>(sub, std::string("SeamIndex"));
+        size_t numSeam = 0;
+        for (size_t i = 0; i < verts.size(); ++i)
+        {
+            sub.vert[i].ClearS();
+            handle[i] = seam[verts[i]] ? verts[i] + 1 : 0;
+            if (seam[verts[i]])numSeam++;
+        }
+        for (size_t i = 0; i < faces.size(); ++i)
+        {
+            sub.face[i].SetS();
+            for (int j = 0; j < 3; ++j)
+                if (seam[vcg::tri::Index(m, m.face[faces[i]].cV(j))])sub.face[i].ClearS();
+        }
+        vcg::tri::UpdateSelection<Mesh>::VertexFromFaceStrict(sub);
+
+        seamIndex.resize(sub.vert.size());
+        for (size_t i = 0; i < sub.vert.size(); ++i)
+            seamIndex[i] = handle[i];
+        vcg::tri::UpdateTopology<Mesh>::FaceFace(sub);
+        const std::vector<SeamEdge> before = SeamEdges(sub, seamIndex);
+
+        Mesh target;
+        std::vector<size_t> targetVerts;
+        CopyFaces(original, targetFaces, target, targetVerts);
+        vcg::tri::UpdateBounding<Mesh>::Box(target);
+
+        para.selectedOnly = true;
+        vcg::tri::IsotropicRemeshing<Mesh>::Do(sub, target, para);
+
+        //the seam vertices have to be all there, where they were
+        seamIndex.resize(sub.vert.size());
+        size_t found = 0;
+        bool moved = false;
+        for (size_t i = 0; i < sub.vert.size(); ++i)
+        {
+            seamIndex[i] = sub.vert[i].IsD() ? 0 : handle[i];
+            if (seamIndex[i] == 0)continue;
+            if (sub.vert[i].cP() != m.vert[seamIndex[i] - 1].cP())moved = true;
+            found++;
+        }
+        vcg::tri::Allocator<Mesh>::DeletePerVertexAttribute(sub, handle);
+        if (moved || found != numSeam)return false;
+
+        //and so the seam edges, which get back their crease flag (the
+        //remeshing may have marked them as borders)
+        vcg::tri::UpdateTopology<Mesh>::FaceFace(sub);
+        std::vector<SeamEdge> after = SeamEdges(sub, seamIndex);
+        if (after.size() != before.size())return false;
+        for (size_t i = 0; i < after.size(); ++i)
+            if (after[i].first != before[i].first)return false;
+
+        for (size_t i = 0; i < sub.face.size(); ++i)
+        {
+            if (sub.face[i].IsD())continue;
+            for (int j = 0; j < 3; ++j)
+            {
+                if (!vcg::face::IsBorder(sub.face[i], j))continue;
+                const size_t v0 = seamIndex[vcg::tri::Index(sub, sub.face[i].cV0(j))];
+                const size_t v1 = seamIndex[vcg::tri::Index(sub, sub.face[i].cV1(j))];
+                if (v0 == 0 || v1 == 0)continue;
+                const std::pair<size_t, size_t> key(std::min(v0, v1), std::max(v0, v1));
+                const typename std::vector<SeamEdge>::const_iterator it =
+                        std::lower_bound(before.begin(), before.end(), SeamEdge(key, false));
+                if (it->second)
+                    sub.face[i].SetFaceEdgeS(j);
+                else
+                    sub.face[i].ClearFaceEdgeS(j);
+            }
+        }
+        return true;
+    }
+
+    //The cell of the grid (cellSize, moved by offset) of a point
+    static std::array<int, 3> Cell(const Mesh & m, const CoordType & p, const ScalarType cellSize, const ScalarType offset)
+    {
+        std::array<int, 3> cell;
+        for (int k = 0; k < 3; ++k)
+            cell[k] = (int)std::floor((p[k] - m.bbox.min[k] + offset) / cellSize);
+        return cell;
+    }
+
+    //One pass of the parallel remeshing: the faces are split into patches by
+    //the cells of a grid moved by offset (a fraction of a cell), the patches
+    //are remeshed concurrently, each with its frozen halo and projected onto
+    //original, and put back into m. A surface crosses more cells of the 3D
+    //grid than its area fills, so cellSize is grown until there are at most
+    //maxPatches patches
+    static void RemeshPatches(Mesh & m,
+                              const Mesh & original,
+                              const typename vcg::tri::IsotropicRemeshing<Mesh>::Params & para,
+                              ScalarType cellSize,
+                              const ScalarType offset,
+                              const size_t maxPatches)
+    {
+        vcg::tri::Allocator<Mesh>::CompactEveryVector(m);
+        vcg::tri::UpdateBounding<Mesh>::Box(m);
+
+        std::map<std::array<int, 3>, size_t> cells;
+        std::vector<std::vector<size_t> > patchFaces;
+        std::vector<size_t> facePatch(m.face.size());
+        while (true)
+        {
+            cells.clear();
+            patchFaces.clear();
+            for (size_t i = 0; i < m.face.size(); ++i)
+            {
+                const CoordType bary = (m.face[i].cP(0) + m.face[i].cP(1) + m.face[i].cP(2)) / 3;
+                const std::pair<typename std::map<std::array<int, 3>, size_t>::iterator, bool> inserted =
+                        cells.insert(std::make_pair(Cell(m, bary, cellSize, cellSize * offset), patchFaces.size()));
+                if (inserted.second)
+                    patchFaces.push_back(std::vector<size_t>());
+                facePatch[i] = inserted.first->second;
+                patchFaces[facePatch[i]].push_back(i);
+            }
+            if (patchFaces.size() <= maxPatches)break;
+            cellSize *= 1.05 * std::sqrt((ScalarType)patchFaces.size() / maxPatches);
+        }
+        const size_t numPatches = patchFaces.size();
+
+        //the faces of original around each cell, a tenth of a cell beyond it,
+        //cover the patch even where the remeshing moves its faces
+        const ScalarType margin = cellSize / 10;
+        std::vector<std::vector<size_t> > patchTarget(numPatches);
+        for (size_t i = 0; i < original.face.size(); ++i)
+        {
+            if (original.face[i].IsD())continue;
+            const CoordType bary = (original.face[i].cP(0) + original.face[i].cP(1) + original.face[i].cP(2)) / 3;
+            const std::array<int, 3> low = Cell(m, bary, cellSize, cellSize * offset - margin);
+            const std::array<int, 3> high = Cell(m, bary, cellSize, cellSize * offset + margin);
+            std::array<int, 3> cell;
+            for (cell[0] = low[0]; cell[0] <= high[0]; ++cell[0])
+                for (cell[1] = low[1]; cell[1] <= high[1]; ++cell[1])
+                    for (cell[2] = low[2]; cell[2] <= high[2]; ++cell[2])
+                    {
+                        const typename std::map<std::array<int, 3>, size_t>::const_iterator it = cells.find(cell);
+                        if (it != cells.end())
+                            patchTarget[it->second].push_back(i);
+                    }
+        }
+
+        //the patches use the selection for their halo, the caller's one is
+        //carried by a user bit, which the remeshing copies to the new faces
+        const int selectedFace = FaceType::NewBitFlag();
+        const int selectedVert = VertexType::NewBitFlag();
+        for (size_t i = 0; i < m.face.size(); ++i)
+        {
+            if (m.face[i].IsS())
+                m.face[i].SetUserBit(selectedFace);
+            else
+                m.face[i].ClearUserBit(selectedFace);
+        }
+        for (size_t i = 0; i < m.vert.size(); ++i)
+        {
+            if (m.vert[i].IsS())
+                m.vert[i].SetUserBit(selectedVert);
+            else
+                m.vert[i].ClearUserBit(selectedVert);
+        }
+
+        //the vertices shared by two patches are the seam
+        std::vector<size_t> vertPatch(m.vert.size(), numPatches);
+        std::vector<bool> seam(m.vert.size(), false);
+        for (size_t i = 0; i < m.face.size(); ++i)
+            for (int j = 0; j < 3; ++j)
+            {
+                const size_t v = vcg::tri::Index(m, m.face[i].cV(j));
+                if (vertPatch[v] == numPatches)
+                    vertPatch[v] = facePatch[i];
+                else if (vertPatch[v] != facePatch[i])
+                    seam[v] = true;
+            }
+
+        std::vector<std::unique_ptr<Mesh> > patches(numPatches);
+        std::vector<std::vector<size_t> > seamIndex(numPatches);
+        std::vector<char> remeshed(numPatches, 0);
+        Scheduler::parallelFor(0, numPatches, [&](size_t p) {
+            patches[p].reset(new Mesh());
+            remeshed[p] = RemeshPatch(m, patchFaces[p], seam, original, patchTarget[p], para, *patches[p], seamIndex[p]);
+            std::vector<size_t>().swap(patchTarget[p]);
+            if (!remeshed[p])
+                patches[p].reset();
+        });
+
+        //the remeshed patches replace their faces, the others are kept
+        size_t numFailed = 0;
+        std::vector<size_t> vertBase(numPatches + 1, 0);
+        std::vector<size_t> faceBase(numPatches + 1, 0);
+        for (size_t p = 0; p < numPatches; ++p)
+        {
+            size_t numV = 0;
+            size_t numF = 0;
+            if (remeshed[p])
+            {
+                for (size_t i = 0; i < patches[p]->vert.size(); ++i)
+                    if (!patches[p]->vert[i].IsD() && seamIndex[p][i] == 0)numV++;
+                numF = patches[p]->FN();
+                for (size_t i = 0; i < patchFaces[p].size(); ++i)
+                    vcg::tri::Allocator<Mesh>::DeleteFace(m, m.face[patchFaces[p][i]]);
+            }
+            else
+                numFailed++;
+            vertBase[p + 1] = vertBase[p] + numV;
+            faceBase[p + 1] = faceBase[p] + numF;
+        }
+        for (size_t i = 0; i < m.vert.size(); ++i)
+            if (!seam[i] && vertPatch[i] < numPatches && remeshed[vertPatch[i]])
+                vcg::tri::Allocator<Mesh>::DeleteVertex(m, m.vert[i]);
+
+        const size_t firstV = m.vert.size();
+        const size_t firstF = m.face.size();
+        vcg::tri::Allocator<Mesh>::AddVertices(m, vertBase.back());
+        vcg::tri::Allocator<Mesh>::AddFaces(m, faceBase.back());
+        Scheduler::parallelFor(0, numPatches, [&](size_t p) {
+            if (!remeshed[p])
+                return;
+            const Mesh & sub = *patches[p];
+            std::vector<size_t> & index = seamIndex[p];
+            size_t nextV = firstV + vertBase[p];
+            for (size_t i = 0; i < sub.vert.size(); ++i)
+            {
+                if (sub.vert[i].IsD())continue;
+                if (index[i] > 0)
+                {
+                    index[i]--;
+                    continue;
+                }
+                m.vert[nextV].ImportData(sub.vert[i]);
+                index[i] = nextV++;
+            }
+            size_t nextF = firstF + faceBase[p];
+            for (size_t i = 0; i < sub.face.size(); ++i)
+            {
+                if (sub.face[i].IsD())continue;
+                FaceType & f = m.face[nextF++];
+                f.ImportData(sub.face[i]);
+                for (int j = 0; j < 3; ++j)
+                    f.V(j) = &m.vert[index[vcg::tri::Index(sub, sub.face[i].cV(j))]];
+            }
+            patches[p].reset();
+        });
+
+        vcg::tri::Allocator<Mesh>::CompactEveryVector(m);
+        for (size_t i = 0; i < m.face.size(); ++i)
+        {
+            if (m.face[i].IsUserBit(selectedFace))
+                m.face[i].SetS();
+            else
+                m.face[i].ClearS();
+        }
+        for (size_t i = 0; i < m.vert.size(); ++i)
+        {
+            if (m.vert[i].IsUserBit(selectedVert))
+                m.vert[i].SetS();
+            else
+                m.vert[i].ClearS();
+        }
+        VertexType::DeleteBitFlag(selectedVert);
+        FaceType::DeleteBitFlag(selectedFace);
+        vcg::tri::UpdateTopology<Mesh>::FaceFace(m);
+        vcg::tri::UpdateBounding<Mesh>::Box(m);
+
+        if (numFailed > 0)
+            std::cout << numFailed << " of " << numPatches << " patches kept, their seam changed" << std::endl;
+    }
+
+    //Progress of the pass run by a single IsotropicRemeshing::Do call, which
+    //reports it through a plain function pointer: the progress and the
+    //fraction at which the pass starts
+    static std::pair<Progress*, double> & IterationProgress()
+    {
+        static thread_local std::pair<Progress*, double> target(nullptr, 0);
+        return target;
+    }
+
+    static bool ReportIteration(const int pos, const char *)
+    {
+        const std::pair<Progress*, double> & target = IterationProgress();
+        target.first->report("remesh_adapt", target.second + 0.005 * pos);
+        return true;
+    }
+
+    //Run the iterations of a remeshing pass. With a time limit they are run a
+    //few at a time, stopping when the pass has used up its share (fraction of
+    //the limit, counted from start) of the time, all projected onto the mesh
+    //the pass started from. Each of the two passes is half of the reported
+    //progress, which does not change how the pass is run.
+    //Big meshes are remeshed in patches, in parallel: the patches are moved
+    //(the grid by a different offset) every partitionIterations iterations, so
+    //that the halo of a step is remeshed by the next ones.
+    //The adaptive pass is never partitioned: its edge length multiplier is
+    //normalized over the remeshed region, so each patch would get its own
+    //density and the density would jump at the seams. Neither is the
+    //remeshing of a selection, the patches remesh all their faces
+    static void DoIterations(Mesh & m,
+                             typename vcg::tri::IsotropicRemeshing<Mesh>::Params & para,
+                             Params & par,
+                             const std::chrono::steady_clock::time_point & start,
+                             const double fraction)
+    {
+        const size_t numPatches = (para.adapt || para.selectedOnly) ? 1 : NumPatches(m, par);
+        const ScalarType area = numPatches >= 2 ? vcg::tri::Stat<Mesh>::ComputeMeshArea(m) : 0;
+        const bool partitioned = area > 0;
+
+        if (!partitioned && par.timeLimit <= 0)
+        {
+            if (par.progress != nullptr)
+            {
+                IterationProgress() = std::make_pair(par.progress, fraction - 0.5);
+                vcg::tri::IsotropicRemeshing<Mesh>::Do(m, para, &ReportIteration);
+                par.progress->report("remesh_adapt", fraction);
+            }
+            else
+                vcg::tri::IsotropicRemeshing<Mesh>::Do(m, para);
+            return;
+        }
+
+        //as Do(m, para) does, but once for the whole pass: a copy of m at each
+        //step would let the surface drift away from the input
+        Mesh original;
+        vcg::tri::UpdateBounding<Mesh>::Box(m);
+        vcg::tri::UpdateNormal<Mesh>::PerVertexNormalizedPerFace(m);
+        vcg::tri::Append<Mesh, Mesh>::MeshCopy(original, m);
+
+        //cells of about partitionFaces faces, the offsets (in cells) never
+        //put the seams of two steps at the same place
+        const ScalarType cellSize = partitioned ? std::sqrt(area / numPatches) : 0;
+        const ScalarType offsets[4] = {0, 0.5, 0.25, 0.75};
+        const int step = partitioned ? std::max(1, par.partitionIterations) : 1;
+        if (partitioned)
+            std::cout << "Remeshing " << m.FN() << " faces in patches of about " << m.FN() / numPatches << " faces" << std::endl;
+
+        const int iterations = para.iter;
+        int done = 0;
+        int pass = 0;
+        while (done < iterations)
+        {
+            para.iter = std::min(step, iterations - done);
+            if (partitioned)
+                RemeshPatches(m, original, para, cellSize, offsets[pass++ % 4], numPatches);
+            else
+                vcg::tri::IsotropicRemeshing<Mesh>::Do(m, original, para);
+            done += para.iter;
+            if (par.progress != nullptr)
+                par.progress->report("remesh_adapt", fraction - 0.5 + 0.5 * done / iterations);
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (par.timeLimit > 0 && elapsed >= par.timeLimit * fraction)break;
+        }
+        para.iter = iterations;
+
+        if (done < iterations)
+            std::cout << "Remeshing time limit reached after " << done << " of " << iterations << " iterations" << std::endl;
+        par.iterationsDone = std::min(par.iterationsDone, done);
+    }
+
     //for big meshes disabling par.surfDistCheck provides big perf improvements, sacrificing result accuracy
     //static std::shared_ptr<Mesh> Remesh (Mesh & m, Params & par)
     static void RemeshAdapt(Mesh & m, Params & par)
@@ -395,8 +845,11 @@ public:
         para.SetTargetLen(par.targetEdgeLen);
 
 
+        const auto start = std::chrono::steady_clock::now();
+        par.iterationsDone = par.iterations;
+
         std::cout << "Before Remeshing - faces: " << m.FN() << " quality: " <<  computeAR(m) << std::endl;
-        vcg::tri::IsotropicRemeshing<Mesh>::Do(m, para);
+        DoIterations(m, para, par, start, 0.5);
         std::cout << "After Iter 0 - faces: " << m.FN() << " quality: " <<  computeAR(m) << std::endl;
 
 
@@ -411,7 +864,7 @@ public:
         para.smoothFlag   = true;
         para.maxSurfDist = m.bbox.Diag() / 2500.;
 
-        vcg::tri::IsotropicRemeshing<Mesh>::Do(m, para);
+        DoIterations(m, para, par, start, 1.0);
 
         m.UpdateDataStructures();
 
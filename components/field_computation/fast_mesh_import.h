@@ -0,0 +1,538 @@
+/***************************************************************************/
+/* Copyright(C) 2021
+
+
+The authors of
+
+Reliable Feature-Line Driven Quad-Remeshing
+Siggraph 2021
+
+
+ All rights reserved.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+****************************************************************************/
+
+#ifndef FAST_MESH_IMPORT_H
+#define FAST_MESH_IMPORT_H
+
+#include <vcg/complex/complex.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <version>
+
+//floating point std::from_chars is missing in the libc++ of older AppleClang
+#ifndef __cpp_lib_to_chars
+#include <cerrno>
+#include <clocale>
+#include <cstdlib>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#endif
+
+#ifdef _WIN32
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <scheduler.h>
+
+//Loader of triangle meshes (vertex positions and faces only) from OBJ and
+//binary little endian PLY files. The file is memory mapped, OBJ files are
+//parsed in parallel chunks, and the mesh is allocated once and filled in
+//place. Files it does not handle (polygonal faces, ascii or big endian PLY,
+//unusual PLY layouts) make it return false, so that the caller can fall back
+//to the vcg importers. The mesh is untouched if that is found out before the
+//elements are read, and left empty otherwise
+template <class MeshType>
+class FastMeshImporter
+{
+    typedef typename MeshType::ScalarType ScalarType;
+    typedef typename MeshType::CoordType CoordType;
+
+    //Read only view of a file, memory mapped where possible
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::string &filename)
+        {
+#ifdef _WIN32
+            std::ifstream input(filename,std::ios::binary|std::ios::ate);
+            if (!input.is_open())return;
+            size=static_cast<size_t>(input.tellg());
+            buffer.resize(size);
+            input.seekg(0);
+            input.read(buffer.data(),static_cast<std::streamsize>(size));
+            data=buffer.data();
+#else
+            int fd=open(filename.c_str(),O_RDONLY);
+            if (fd<0)return;
+            struct stat st;
+            if ((fstat(fd,&st)==0)&&(st.st_size>0))
+            {
+                size=static_cast<size_t>(st.st_size);
+                void *mapped=mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+                if (mapped!=MAP_FAILED)
+                {
+                    madvise(mapped,size,MADV_SEQUENTIAL);
+                    data=static_cast<const char*>(mapped);
+                }
+                else
+                    size=0;
+            }
+            close(fd);
+#endif
+        }
+
+        ~MappedFile()
+        {
+#ifndef _WIN32
+            if (data!=nullptr)
+                munmap(const_cast<char*>(data),size);
+#endif
+        }
+
+        MappedFile(const MappedFile&)=delete;
+        MappedFile& operator=(const MappedFile&)=delete;
+
+        const char *data=nullptr;
+        size_t size=0;
+#ifdef _WIN32
+        std::vector<char> buffer;
+#endif
+    };
+
+    static bool IsBlank(const char c)
+    {
+        return (c==' ')||(c=='\t')||(c=='\r');
+    }
+
+    static const char* SkipBlanks(const char *p,const char *end)
+    {
+        while ((p<end)&&IsBlank(*p))p++;
+        return p;
+    }
+
+    static const char* NextLine(const char *p,const char *end)
+    {
+        const char *nl=static_cast<const char*>(std::memchr(p,'\n',end-p));
+        return (nl==nullptr)?end:nl+1;
+    }
+
+    //Kind of an OBJ line: 'v' vertex, 'f' face, 0 anything else
+    static char LineKind(const char *&p,const char *end)
+    {
+        p=SkipBlanks(p,end);
+        if ((end-p<2)||!IsBlank(p[1]))return 0;
+        if ((p[0]!='v')&&(p[0]!='f'))return 0;
+        char kind=p[0];
+        p+=2;
+        return kind;
+    }
+
+    //Chunks of the file starting at line boundaries
+    static std::vector<const char*> SplitLines(const char *begin,const char *end,size_t numChunks)
+    {
+        std::vector<const char*> bounds;
+        bounds.push_back(begin);
+        const size_t chunkSize=std::max<size_t>(1,(end-begin)/numChunks);
+        for (size_t i=1;i<numChunks;i++)
+        {
+            const char *p=std::max(bounds.back(),begin+i*chunkSize);
+            if (p>=end)break;
+            p=NextLine(p,end);
+            if (p>=end)break;
+            bounds.push_back(p);
+        }
+        bounds.push_back(end);
+        return bounds;
+    }
+
+    //Parse a coordinate, independently of the locale
+    static bool ParseCoord(const char *&p,const char *end,double &value)
+    {
+#ifdef __cpp_lib_to_chars
+        auto res=std::from_chars(p,end,value);
+        if (res.ec!=std::errc())return false;
+        p=res.ptr;
+        return true;
+#else
+        //strtod_l needs a terminated string, the "C" locale reads '.' as the point
+        static const locale_t cLocale=newlocale(LC_ALL_MASK,"C",(locale_t)0);
+        char token[64];
+        size_t n=0;
+        while ((p+n<end)&&(n<sizeof(token)-1)&&!IsBlank(p[n])&&(p[n]!='\n'))
+        {
+            token[n]=p[n];
+            n++;
+        }
+        token[n]='\0';
+        char *tokenEnd;
+        errno=0;
+        value=strtod_l(token,&tokenEnd,cLocale);
+        if ((tokenEnd==token)||(errno==ERANGE))return false;
+        p+=tokenEnd-token;
+        return true;
+#endif
+    }
+
+    //Parse the vertex index of an OBJ face corner (i, i/j, i//k, i/j/k)
+    static bool ParseCorner(const char *&p,const char *end,long long &index)
+    {
+        auto res=std::from_chars(p,end,index);
+        if ((res.ec!=std::errc())||(index==0))return false;
+        p=res.ptr;
+        while ((p<end)&&!IsBlank(*p)&&(*p!='\n'))p++;
+        return true;
+    }
+
+public:
+
+    static bool OpenOBJ(MeshType &mesh,const std::string &filename)
+    {
+        MappedFile file(filename);
+        if (file.data==nullptr)return false;
+        const char *begin=file.data;
+        const char *end=file.data+file.size;
+
+        const size_t numThreads=Scheduler::threads();
+        std::vector<const char*> bounds=SplitLines(begin,end,numThreads*4);
+        const size_t numChunks=bounds.size()-1;
+
+        //FIRST PASS: count the elements of each chunk
+        std::vector<size_t> chunkVertices(numChunks+1,0);
+        std::vector<size_t> chunkFaces(numChunks+1,0);
+        std::atomic<bool> supported(true);
+
+#pragma omp parallel for schedule(dynamic,1)
+        for (long long c=0;c<static_cast<long long>(numChunks);c++)
+        {
+            size_t nv=0,nf=0;
+            const char *p=bounds[c];
+            const char *chunkEnd=bounds[c+1];
+            while (p<chunkEnd)
+            {
+                const char *lineEnd=NextLine(p,chunkEnd);
+                char kind=LineKind(p,lineEnd);
+                if (kind=='v')nv++;
+                if (kind=='f')
+                {
+                    size_t corners=0;
+                    while (true)
+                    {
+                        p=SkipBlanks(p,lineEnd);
+                        if ((p>=lineEnd)||(*p=='\n')||(*p=='#'))break;
+                        if (*p=='\\')supported=false; //line continuation
+                        while ((p<lineEnd)&&!IsBlank(*p)&&(*p!='\n'))p++;
+                        corners++;
+                    }
+                    if (corners!=3)
+                        supported=false;
+                    nf++;
+                }
+                p=lineEnd;
+            }
+            chunkVertices[c+1]=nv;
+            chunkFaces[c+1]=nf;
+        }
+        if (!supported)return false;
+
+        for (size_t c=0;c<numChunks;c++)
+        {
+            chunkVertices[c+1]+=chunkVertices[c];
+            chunkFaces[c+1]+=chunkFaces[c];
+        }
+        const size_t numVertices=chunkVertices[numChunks];
+        const size_t numFaces=chunkFaces[numChunks];
+        if (numVertices==0)return false;
+
+        //SECOND PASS: positions and face indices, at their final place
+        Allocate(mesh,numVertices,numFaces);
+
+#pragma omp parallel for schedule(dynamic,1)
+        for (long long c=0;c<static_cast<long long>(numChunks);c++)
+        {
+            size_t vIndex=chunkVertices[c];
+            size_t fIndex=chunkFaces[c];
+            const char *p=bounds[c];
+            const char *chunkEnd=bounds[c+1];
+            while ((p<chunkEnd)&&supported)
+            {
+                const char *lineEnd=NextLine(p,chunkEnd);
+                char kind=LineKind(p,lineEnd);
+                if (kind=='v')
+                {
+                    double coord[3];
+                    for (int j=0;j<3;j++)
+                    {
+                        p=SkipBlanks(p,lineEnd);
+                        if ((p<lineEnd)&&(*p=='+'))p++;
+                        if (!ParseCoord(p,lineEnd,coord[j]))
+                        {
+                            supported=false;
+                            break;
+                        }
+                    }
+                    mesh.vert[vIndex++].P()=CoordType(coord[0],coord[1],coord[2]);
+                }
+                if (kind=='f')
+                {
+                    for (int j=0;j<3;j++)
+                    {
+                        p=SkipBlanks(p,lineEnd);
+                        long long index;
+                        if (!ParseCorner(p,lineEnd,index))
+                        {
+                            supported=false;
+                            break;
+                        }
+                        //negative indices are relative to the vertices read so far
+                        long long absIndex=(index>0)?(index-1):(static_cast<long long>(vIndex)+index);
+                        if ((absIndex<0)||(absIndex>=static_cast<long long>(numVertices)))
+                        {
+                            supported=false;
+                            break;
+                        }
+                        mesh.face[fIndex].V(j)=&mesh.vert[absIndex];
+                    }
+                    fIndex++;
+                }
+                p=lineEnd;
+            }
+        }
+        if (!supported)
+        {
+            mesh.Clear();
+            return false;
+        }
+        return true;
+    }
+
+    static bool OpenPLY(MeshType &mesh,const std::string &filename)
+    {
+        MappedFile file(filename);
+        if (file.data==nullptr)return false;
+        const char *begin=file.data;
+        const char *end=file.data+file.size;
+
+        //HEADER
+        struct Property
+        {
+            std::string name;
+            int size=0;
+            char type=0;     //'f' float, 'd' double, 'i' signed, 'u' unsigned
+            bool list=false;
+            int countSize=0;
+        };
+        struct Element
+        {
+            std::string name;
+            size_t count=0;
+            std::vector<Property> properties;
+        };
+
+        auto typeOf=[](const std::string &name,int &size,char &type)
+        {
+            if ((name=="char")||(name=="int8")){size=1;type='i';}
+            else if ((name=="uchar")||(name=="uint8")){size=1;type='u';}
+            else if ((name=="short")||(name=="int16")){size=2;type='i';}
+            else if ((name=="ushort")||(name=="uint16")){size=2;type='u';}
+            else if ((name=="int")||(name=="int32")){size=4;type='i';}
+            else if ((name=="uint")||(name=="uint32")){size=4;type='u';}
+            else if ((name=="float")||(name=="float32")){size=4;type='f';}
+            else if ((name=="double")||(name=="float64")){size=8;type='d';}
+            else return false;
+            return true;
+        };
+
+        std::vector<Element> elements;
+        const char *p=begin;
+        bool binaryLE=false;
+        bool headerEnd=false;
+        while ((p<end)&&!headerEnd)
+        {
+            const char *lineEnd=NextLine(p,end);
+            std::string line(p,lineEnd);
+            while (!line.empty()&&((line.back()=='\n')||(line.back()=='\r')))line.pop_back();
+            std::istringstream tokens(line);
+            std::string keyword;
+            tokens>>keyword;
+            if (keyword=="format")
+            {
+                std::string format;
+                tokens>>format;
+                binaryLE=(format=="binary_little_endian");
+            }
+            else if (keyword=="element")
+            {
+                Element element;
+                tokens>>element.name>>element.count;
+                elements.push_back(element);
+            }
+            else if (keyword=="property")
+            {
+                if (elements.empty())return false;
+                Property property;
+                std::string type;
+                tokens>>type;
+                if (type=="list")
+                {
+                    std::string countType;
+                    char countKind;
+                    property.list=true;
+                    tokens>>countType>>type;
+                    if (!typeOf(countType,property.countSize,countKind))return false;
+                }
+                if (!typeOf(type,property.size,property.type))return false;
+                tokens>>property.name;
+                elements.back().properties.push_back(property);
+            }
+            else if (keyword=="end_header")
+                headerEnd=true;
+            p=lineEnd;
+        }
+        if (!headerEnd||!binaryLE)return false;
+
+        //only a vertex element followed by a face element, other elements
+        //may follow them
+        if ((elements.size()<2)||(elements[0].name!="vertex")||(elements[1].name!="face"))
+            return false;
+
+        const Element &vertexElement=elements[0];
+        const Element &faceElement=elements[1];
+        if (vertexElement.count==0)return false;
+
+        size_t vertexStride=0;
+        int coordOffset[3]={-1,-1,-1};
+        char coordType[3]={0,0,0};
+        for (const Property &property : vertexElement.properties)
+        {
+            if (property.list)return false;
+            const char *names[3]={"x","y","z"};
+            for (int j=0;j<3;j++)
+                if (property.name==names[j])
+                {
+                    coordOffset[j]=static_cast<int>(vertexStride);
+                    coordType[j]=property.type;
+                    if ((property.type!='f')&&(property.type!='d'))return false;
+                }
+            vertexStride+=property.size;
+        }
+        if ((coordOffset[0]<0)||(coordOffset[1]<0)||(coordOffset[2]<0))return false;
+
+        //faces must all be triangles to have a fixed stride
+        if (faceElement.properties.empty()||!faceElement.properties[0].list)return false;
+        const Property &indexProperty=faceElement.properties[0];
+        if ((indexProperty.type!='i')&&(indexProperty.type!='u'))return false;
+        if ((indexProperty.size!=4))return false;
+        size_t faceStride=indexProperty.countSize+3*indexProperty.size;
+        for (size_t i=1;i<faceElement.properties.size();i++)
+        {
+            if (faceElement.properties[i].list)return false;
+            faceStride+=faceElement.properties[i].size;
+        }
+
+        const char *vertexData=p;
+        const char *faceData=vertexData+vertexElement.count*vertexStride;
+        if (faceData+faceElement.count*faceStride>end)return false;
+
+        Allocate(mesh,vertexElement.count,faceElement.count);
+        std::atomic<bool> supported(true);
+
+#pragma omp parallel for schedule(static)
+        for (long long i=0;i<static_cast<long long>(vertexElement.count);i++)
+        {
+            const char *v=vertexData+i*vertexStride;
+            double coord[3];
+            for (int j=0;j<3;j++)
+            {
+                if (coordType[j]=='f')
+                {
+                    float value;
+                    std::memcpy(&value,v+coordOffset[j],sizeof(float));
+                    coord[j]=value;
+                }
+                else
+                    std::memcpy(&coord[j],v+coordOffset[j],sizeof(double));
+            }
+            mesh.vert[i].P()=CoordType(coord[0],coord[1],coord[2]);
+        }
+
+#pragma omp parallel for schedule(static)
+        for (long long i=0;i<static_cast<long long>(faceElement.count);i++)
+        {
+            const unsigned char *f=reinterpret_cast<const unsigned char*>(faceData+i*faceStride);
+            uint64_t count=0;
+            for (int k=indexProperty.countSize-1;k>=0;k--)
+                count=(count<<8)|f[k];
+            if (count!=3)
+            {
+                supported=false;
+                continue;
+            }
+            for (int j=0;j<3;j++)
+            {
+                uint32_t index;
+                std::memcpy(&index,f+indexProperty.countSize+j*4,sizeof(uint32_t));
+                if (index>=vertexElement.count)
+                {
+                    supported=false;
+                    break;
+                }
+                mesh.face[i].V(j)=&mesh.vert[index];
+            }
+        }
+        if (!supported)
+        {
+            mesh.Clear();
+            return false;
+        }
+        return true;
+    }
+
+    //Dispatch on the extension, false if the file is not handled
+    static bool Open(MeshType &mesh,const std::string &filename)
+    {
+        if (filename.size()<4)return false;
+        std::string extension=filename.substr(filename.size()-4);
+        for (char &c : extension)c=static_cast<char>(std::tolower(c));
+        if (extension==".obj")return OpenOBJ(mesh,filename);
+        if (extension==".ply")return OpenPLY(mesh,filename);
+        return false;
+    }
+
+private:
+
+    //Allocate all the elements at once, the parsers fill them in place
+    static void Allocate(MeshType &mesh,const size_t numVertices,const size_t numFaces)
+    {
+        mesh.Clear();
+        vcg::tri::Allocator<MeshType>::AddVertices(mesh,numVertices);
+        vcg::tri::Allocator<MeshType>::AddFaces(mesh,numFaces);
+    }
+};
+
+#endif
@@ -4,7 +4,8 @@ include(../../libs/libs.pri)
 
 HEADERS = \
     glwidget.h \
-    triangle_mesh_type.h
+    triangle_mesh_type.h \
+    fast_mesh_import.h
 
 SOURCES = \
     glwidget.cpp \
@@ -13,7 +14,9 @@ SOURCES = \
 HEADERS += \
     fields/field_smoother.h \
     fields/n_polyvector.h \
-    fields/polyroots.h
+    fields/polyroots.h \
+    fields/polyvector_multigrid.h \
+    fields/vertex_curvature.h
 SOURCES += \
     fields/n_polyvector.cpp \
     fields/polyroots.cpp
@@ -70,6 +73,9 @@ SOURCES += $$VCGLIB_PATH/wrap/qt/anttweakbarMapperNew.cpp
 #eigen
 INCLUDEPATH += $$EIGEN_PATH
 
+#threading
+INCLUDEPATH += ../threading
+
 #libigl
 INCLUDEPATH += $$LIBIGL_PATH/include
 HEADERS += \
@@ -24,6 +24,8 @@
 #ifndef QR_FIELD_SMOOTHER_H
 #define QR_FIELD_SMOOTHER_H
 
+#include <memory>
+
 //eigen stuff
 #include <Eigen/Sparse>
 
@@ -36,7 +38,7 @@
 //igl related stuff
 
 #include "fields/n_polyvector.h"
-#include <igl/principal_curvature.h>
+#include "fields/vertex_curvature.h"
 #include <igl/igl_inline.h>
 
 #ifdef COMISO_FIELD
@@ -46,7 +48,14 @@
 namespace vcg {
 namespace tri {
 
-enum SmoothMethod{SMMiq,SMNPoly,SMIterative};
+enum SmoothMethod{SMMiq,SMNPoly,SMIterative,SMNPolyIterative};
+
+//n-PolyVector solver kept between the smoothings of a mesh, so that a new
+//smoothing with other constraints reuses the factorization of the last one
+struct NPolySolverCache
+{
+    std::unique_ptr<igl::NPolyVectorSolver> solver;
+};
 
 template <class MeshType>
 class FieldSmoother
@@ -176,7 +185,7 @@ class FieldSmoother
             HardD(curr_index,0)=dir.X();
             HardD(curr_index,1)=dir.Y();
             HardD(curr_index,2)=dir.Z();
-            if ((Ndir==4)&&(SMethod==SMNPoly))
+            if ((Ndir==4)&&(SMethod!=SMMiq))
             {
                 dir=mesh.face[i].PD2();
                 HardD(curr_index,3)=dir.X();
@@ -189,18 +198,23 @@ class FieldSmoother
 
     }
 
-    //hard constraints have selected face
+    //soft constraints are the faces not selected, weighted by their quality
     static void CollectSoftConstraints( MeshType & mesh,
                                         Eigen::VectorXi &SoftI,
                                         Eigen::MatrixXd &SoftD,
-                                        Eigen::VectorXd &SoftW)
+                                        Eigen::VectorXd &SoftW,
+                                        SmoothMethod SMethod=SMMiq,
+                                        int Ndir=4)
     {
         //count number of soft constraints
         int numS=vcg::tri::UpdateSelection<MeshType>::FaceCount(mesh);
         numS=mesh.fn-numS;
         //allocate eigen matrix
         SoftI=Eigen::MatrixXi(numS,1);
-        SoftD=Eigen::MatrixXd(numS,3);
+        if ((Ndir==2)||(SMethod==SMMiq))
+            SoftD=Eigen::MatrixXd(numS,3);
+        else
+            SoftD=Eigen::MatrixXd(numS,6);
         SoftW=Eigen::MatrixXd(numS,1);
 
         //then update them
@@ -217,6 +231,14 @@ class FieldSmoother
             SoftD(curr_index,0)=dir.X();
             SoftD(curr_index,1)=dir.Y();
             SoftD(curr_index,2)=dir.Z();
+            if ((Ndir==4)&&(SMethod!=SMMiq))
+            {
+                dir=mesh.face[i].PD2();
+                dir.Normalize();
+                SoftD(curr_index,3)=dir.X();
+                SoftD(curr_index,4)=dir.Y();
+                SoftD(curr_index,5)=dir.Z();
+            }
 
             SoftW(curr_index,0)=mesh.face[i].Q();
             curr_index++;
@@ -280,7 +302,8 @@ class FieldSmoother
     static void SmoothNPoly(MeshType &mesh,
                             Eigen::VectorXi &HardI,   //hard constraints index
                             Eigen::MatrixXd &HardD,   //hard directions
-                            int Ndir)
+                            int Ndir,
+                            NPolySolverCache *cache=NULL)
     {
         assert((Ndir==2)||(Ndir==4));
 
@@ -294,7 +317,62 @@ class FieldSmoother
         Eigen::MatrixXd output_field;
         //Eigen::VectorXd output_sing;
 
-        igl::n_polyvector(V,F,HardI,HardD,output_field);
+        if (cache==NULL)
+            igl::n_polyvector(V,F,HardI,HardD,output_field);
+        else
+        {
+            int n=HardD.cols()/3;
+            if ((cache->solver==nullptr)||(!cache->solver->matches(V,F,n)))
+                cache->solver.reset(new igl::NPolyVectorSolver(V,F,n));
+            cache->solver->solve(HardI,HardD,output_field);
+        }
+
+        //finally update the principal directions
+        for (size_t i=0;i<mesh.face.size();i++)
+        {
+            CoordType dir1;
+            dir1[0]=output_field(i,0);
+            dir1[1]=output_field(i,1);
+            dir1[2]=output_field(i,2);
+
+            dir1.Normalize();
+            CoordType dir2=mesh.face[i].N()^dir1;
+            dir2.Normalize();
+
+            ScalarType Norm1=mesh.face[i].PD1().Norm();
+            ScalarType Norm2=mesh.face[i].PD2().Norm();
+
+            mesh.face[i].PD1()=dir1*Norm1;
+            mesh.face[i].PD2()=dir2*Norm2;
+        }
+    }
+
+    static void SmoothNPolyIterative(MeshType &mesh,
+                                     Eigen::VectorXi &HardI,   //hard constraints index
+                                     Eigen::MatrixXd &HardD,   //hard directions
+                                     Eigen::VectorXi &SoftI,   //soft constraints
+                                     Eigen::MatrixXd &SoftD,   //soft directions
+                                     Eigen::VectorXd &SoftW,   //weight of soft constraints
+                                     ScalarType alpha_soft,
+                                     int Ndir,
+                                     ScalarType tolerance)
+    {
+        assert((Ndir==2)||(Ndir==4));
+
+        Eigen::MatrixXi F;
+        typename vcg::tri::MeshToMatrix<MeshType>::MatrixXm Vf;
+
+        MeshToMatrix<MeshType>::GetTriMeshData(mesh,F,Vf);
+        Eigen::MatrixXd V = Vf.template cast<double>();
+        Eigen::MatrixXd output_field;
+
+        //the coefficients of a CG that did not converge are not a field
+        if (!igl::n_polyvector_iterative(V,F,HardI,HardD,SoftI,SoftW,SoftD,alpha_soft,tolerance,output_field))
+        {
+            std::cout<<"Iterative n-PolyVector solve failed, using the direct solver"<<std::endl;
+            SmoothNPoly(mesh,HardI,HardD,Ndir);
+            return;
+        }
 
         //finally update the principal directions
         for (size_t i=0;i<mesh.face.size();i++)
@@ -357,13 +435,21 @@ public:
         //threshold to consider some edge as high curvature anisotropyand to use as hard constraint (0, not use)
         ScalarType curv_thr;
         //the method used to smooth MIQ or "Designing N-PolyVector Fields with Complex Polynomials"
+        //(SMNPolyIterative solves it iteratively, for meshes too big to factorize)
         SmoothMethod SmoothM;
+        //SMNPolyIterative only: also attract the field to the curvature with alpha_curv,
+        //as SMMiq does; SMNPoly ignores alpha_curv, so this changes the field energy
+        bool iterative_soft;
         //the number of faces of the ring used ot esteem the curvature
         int curvRing;
         //this are additional hard constraints
         std::vector<std::pair<int,CoordType> > AddConstr;
         //the number of iteration in case of iterative method
         size_t IteN;
+        //keeps the n-PolyVector factorization between calls (NULL: solve from scratch)
+        std::shared_ptr<NPolySolverCache> NPolyCache;
+        //relative residual at which the SMNPolyIterative solver stops
+        ScalarType solve_tol;
 
         SmoothParam()
         {
@@ -375,6 +461,8 @@ public:
             sharp_thr=0.0;
             curv_thr=0.4;
             IteN=20;
+            solve_tol=1e-6;
+            iterative_soft=false;
         }
 
     };
@@ -386,23 +474,9 @@ public:
 
         tri::RequirePerVertexCurvatureDir(mesh);
 
-        Eigen::MatrixXi F;
-        typename vcg::tri::MeshToMatrix<MeshType>::MatrixXm Vf;
-
-        Eigen::MatrixXd PD1,PD2,PV1,PV2;
-        MeshToMatrix<MeshType>::GetTriMeshData(mesh,F,Vf);
-        Eigen::MatrixXd V = Vf.template cast<double>();
+        //quadric fit on the N-ring, as igl::principal_curvature
+        QuadricCurvature<MeshType>::Compute(mesh,Nring);
 
-        igl::principal_curvature(V,F,PD1,PD2,PV1,PV2,Nring,true);
-
-        //then copy curvature per vertex
-        for (size_t i=0;i<mesh.vert.size();i++)
-        {
-            mesh.vert[i].PD1()=CoordType(PD1(i,0),PD1(i,1),PD1(i,2));
-            mesh.vert[i].PD2()=CoordType(PD2(i,0),PD2(i,1),PD2(i,2));
-            mesh.vert[i].K1()=PV1(i,0);
-            mesh.vert[i].K2()=PV2(i,0);
-        }
         if (!UpdateFaces)return;
         vcg::tri::CrossField<MeshType>::SetFaceCrossVectorFromVert(mesh);
         InitQualityByAnisotropyDir(mesh);
@@ -446,10 +520,12 @@ private:
                                     int Ndir,
                                     SmoothMethod SMethod=SMNPoly,
                                     bool HardAsS=true,
-                                    ScalarType alphaSoft=0)
+                                    ScalarType alphaSoft=0,
+                                    NPolySolverCache *cache=NULL,
+                                    ScalarType tolerance=1e-6)
     {
 
-        assert((SMethod==SMNPoly)||(SMethod==SMMiq));
+        assert((SMethod==SMNPoly)||(SMethod==SMMiq)||(SMethod==SMNPolyIterative));
 
         Eigen::VectorXi HardI;   //hard constraints
         Eigen::MatrixXd HardD;   //hard directions
@@ -460,9 +536,10 @@ private:
         if (HardAsS)
             CollectHardConstraints(mesh,HardI,HardD,SMethod,Ndir);
 
-        //collect soft constraints , miw only one that allows for soft constraints
-        if ((alphaSoft>0)&&(SMethod==SMMiq))
-            CollectSoftConstraints(mesh,SoftI,SoftD,SoftW);
+        //collect soft constraints, the direct n-PolyVector solver has none
+        //(the iterative one only if asked to, with alphaSoft>0)
+        if ((alphaSoft>0)&&(SMethod!=SMNPoly))
+            CollectSoftConstraints(mesh,SoftI,SoftD,SoftW,SMethod,Ndir);
 
         //add some hard constraints if are not present
         int numC=3;
@@ -472,7 +549,7 @@ private:
             fflush(stdout);
             HardI=Eigen::MatrixXi(numC,1);
 
-            if ((Ndir==4)&&(SMethod==SMNPoly))
+            if ((Ndir==4)&&(SMethod!=SMMiq))
                 HardD=Eigen::MatrixXd(numC,6);
             else
                 HardD=Eigen::MatrixXd(numC,3);
@@ -488,7 +565,7 @@ private:
                 HardD(i,1)=Dir.Y();
                 HardD(i,2)=Dir.Z();
 
-                if ((Ndir==4)&&(SMethod==SMNPoly))
+                if ((Ndir==4)&&(SMethod!=SMMiq))
                 {
                     CoordType Dir1=mesh.face[indexF].N()^Dir;
                     Dir1.Normalize();
@@ -502,10 +579,12 @@ private:
         //finally smooth
         if (SMethod==SMMiq)
             SmoothMIQ(mesh,HardI,HardD,SoftI,SoftD,SoftW,alphaSoft,Ndir);
+        else if (SMethod==SMNPolyIterative)
+            SmoothNPolyIterative(mesh,HardI,HardD,SoftI,SoftD,SoftW,alphaSoft,Ndir,tolerance);
         else
         {
             assert(SMethod==SMNPoly);
-            SmoothNPoly(mesh,HardI,HardD,Ndir);
+            SmoothNPoly(mesh,HardI,HardD,Ndir,cache);
         }
     }
 
@@ -514,7 +593,7 @@ public:
     static void SmoothDirections(MeshType &mesh,SmoothParam SParam)
     {
 
-        if ((SParam.SmoothM==SMMiq)||(SParam.SmoothM==SMNPoly))
+        if ((SParam.SmoothM==SMMiq)||(SParam.SmoothM==SMNPoly)||(SParam.SmoothM==SMNPolyIterative))
         {
             //        //initialize direction by curvature if needed
             if ((SParam.alpha_curv>0)||
@@ -529,7 +608,11 @@ public:
                 SelectConstraints(mesh,SParam);
                 vcg::tri::CrossField<MeshType>::PropagateFromSelF(mesh);
             }
-            SmoothDirectionsIGL(mesh,SParam.Ndir,SParam.SmoothM,true,SParam.alpha_curv);
+            //without iterative_soft SMNPolyIterative has the hard constraints of SMNPoly only
+            ScalarType alphaSoft=SParam.alpha_curv;
+            if ((SParam.SmoothM==SMNPolyIterative)&&(!SParam.iterative_soft))
+                alphaSoft=0;
+            SmoothDirectionsIGL(mesh,SParam.Ndir,SParam.SmoothM,true,alphaSoft,SParam.NPolyCache.get(),SParam.solve_tol);
         }
         else
         {
@@ -16,20 +16,32 @@
 #include "igl/igl_inline.h"
 
 #include "polyroots.h"
+#include "polyvector_multigrid.h"
 
 #include <Eigen/Sparse>
+#include <Eigen/LU>
+#include <Eigen/IterativeLinearSolvers>
 
 #include <Eigen/Geometry>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <complex>
+#include <memory>
 
 namespace igl {
   template <typename DerivedV, typename DerivedF>
   class PolyVectorFieldFinder
   {
   private:
-    const Eigen::PlainObjectBase<DerivedV> &V;
-    const Eigen::PlainObjectBase<DerivedF> &F; int numF;
+    typedef std::complex<typename DerivedV::Scalar> Complex;
+    typedef Eigen::SparseMatrix<Complex> SparseMatrixC;
+    typedef Eigen::Matrix<Complex, Eigen::Dynamic, 1> VectorC;
+    typedef Eigen::Matrix<Complex, Eigen::Dynamic, Eigen::Dynamic> MatrixC;
+
+    // copies, the finder is kept between solves on the same mesh
+    const DerivedV V;
+    const DerivedF F; int numF;
     const int n;
 
     Eigen::MatrixXi EV; int numE;
@@ -45,6 +57,32 @@ namespace igl {
 
     DerivedV B1, B2, FN;
 
+    // Coefficient Laplacian of one degree and the factorization of its block on
+    // the faces that were free when it was computed. Another constraint set is
+    // solved by bordering that block with the changed faces (Schur complement)
+    struct DegreeSystem
+    {
+      SparseMatrixC D;
+
+      bool factorized = false;
+      Eigen::VectorXi isConstrained;      // constraints of the factorization
+      Eigen::VectorXi unknown;            // free faces
+      Eigen::VectorXi unknownIndex;       // face -> position in unknown, -1 if constrained
+      std::unique_ptr<Eigen::SimplicialLDLT<SparseMatrixC, Eigen::Lower, Eigen::AMDOrdering<int> > > ldlt;
+      std::unique_ptr<Eigen::SparseLU<SparseMatrixC> > lu;
+
+      // Schur complement for the last constraint set that differs from isConstrained
+      bool bordered = false;
+      Eigen::VectorXi borderedConstrained;
+      std::vector<int> released;          // constrained in the factorization, free now
+      std::vector<int> added;             // free in the factorization, constrained now
+      Eigen::FullPivLU<MatrixC> schur;
+    };
+    std::vector<DegreeSystem> systems;
+
+    // above this many changed constraints a new factorization is cheaper than the border
+    static const int maxBorderSize = 64;
+
     IGL_INLINE void computek();
     IGL_INLINE void setFieldFromGeneralCoefficients(const  std::vector<Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic,1> > &coeffs,
                                                     std::vector<Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, 2> > &pv);
@@ -55,10 +93,25 @@ namespace igl {
                                     Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic,1> &Ck);
     IGL_INLINE void precomputeInteriorEdges();
 
-
-    IGL_INLINE void minQuadWithKnownMini(const Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > &Q,
-                                         const Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > &f,
-                                         const Eigen::VectorXi isConstrained,
+    IGL_INLINE bool factorize(DegreeSystem &sys, const Eigen::VectorXi &isConstrained, bool useLU);
+    IGL_INLINE MatrixC solveFactorized(const DegreeSystem &sys, const MatrixC &rhs) const;
+    IGL_INLINE bool computeBorder(DegreeSystem &sys, const Eigen::VectorXi &isConstrained);
+    IGL_INLINE VectorC applyBorder(const DegreeSystem &sys, const VectorC &w) const;
+    IGL_INLINE VectorC applyBorderAdjoint(const DegreeSystem &sys, const VectorC &z) const;
+
+    IGL_INLINE bool minQuadIterative(const SparseMatrixC &D,
+                                     const Eigen::VectorXi &isConstrained,
+                                     const VectorC &xknown,
+                                     const Eigen::VectorXd &softWeight,
+                                     const VectorC &xsoft,
+                                     double alpha,
+                                     double tolerance,
+                                     VectorC &x);
+    IGL_INLINE void setOutputFromCoefficients(const std::vector<VectorC> &coeffs,
+                                              Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &output);
+
+    IGL_INLINE void minQuadWithKnownMini(DegreeSystem &sys,
+                                         const Eigen::VectorXi &isConstrained,
                                          const Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic, 1> &xknown,
                                          Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic, 1> &x);
 
@@ -66,9 +119,22 @@ namespace igl {
     IGL_INLINE PolyVectorFieldFinder(const Eigen::PlainObjectBase<DerivedV> &_V,
                                      const Eigen::PlainObjectBase<DerivedF> &_F,
                                      const int &_n);
+    IGL_INLINE bool matches(const Eigen::PlainObjectBase<DerivedV> &_V,
+                            const Eigen::PlainObjectBase<DerivedF> &_F,
+                            const int &_n) const;
     IGL_INLINE bool solve(const Eigen::VectorXi &isConstrained,
                const Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &cfW,
                Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &output);
+    // conjugate gradient with a multigrid preconditioner instead of the
+    // factorization, plus the soft constraints: with alpha > 0 the faces with
+    // softWeight > 0 are attracted to the vectors of cfSoft. False if CG fails
+    IGL_INLINE bool solveIterative(const Eigen::VectorXi &isConstrained,
+               const Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &cfW,
+               const Eigen::VectorXd &softWeight,
+               const Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &cfSoft,
+               double alpha,
+               double tolerance,
+               Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &output);
 
   };
 }
@@ -94,8 +160,24 @@ n(_n)
 
   computek();
 
+  systems.resize(n);
+  for (int i=0; i<n; ++i)
+    computeCoefficientLaplacian(2*(i+1), systems[i].D);
+
 };
 
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE bool igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+matches(const Eigen::PlainObjectBase<DerivedV> &_V,
+        const Eigen::PlainObjectBase<DerivedF> &_F,
+        const int &_n) const
+{
+  if (_n != n || _V.rows() != V.rows() || _V.cols() != V.cols() ||
+      _F.rows() != F.rows() || _F.cols() != F.cols())
+    return false;
+  return (_V.array() == V.array()).all() && (_F.array() == F.array()).all();
+}
+
 
 template<typename DerivedV, typename DerivedF>
 IGL_INLINE void igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
@@ -133,68 +215,267 @@ precomputeInteriorEdges()
 
 
 template<typename DerivedV, typename DerivedF>
-IGL_INLINE void igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
-minQuadWithKnownMini(const Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > &Q,
-                          const Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > &f,
-                     const Eigen::VectorXi isConstrained,
-                          const Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic, 1> &xknown,
-                          Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic, 1> &x)
+IGL_INLINE bool igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+factorize(DegreeSystem &sys, const Eigen::VectorXi &isConstrained, bool useLU)
 {
-  int N = Q.rows();
-
-  int nc = xknown.rows();
-  Eigen::VectorXi known; known.setZero(nc,1);
-  Eigen::VectorXi unknown; unknown.setZero(N-nc,1);
-
-  int indk = 0, indu = 0;
+  typedef std::chrono::steady_clock Clock;
+
+  const int N = numF;
+  sys.factorized = false;
+  sys.bordered = false;
+  sys.ldlt.reset();
+  sys.lu.reset();
+  sys.isConstrained = isConstrained;
+
+  sys.unknown.resize(N-isConstrained.sum());
+  sys.unknownIndex.setConstant(N,-1);
+  int indu = 0;
   for (int i = 0; i<N; ++i)
-    if (isConstrained[i])
+    if (!isConstrained[i])
     {
-      known[indk] = i;
-      indk++;
+      sys.unknownIndex[i] = indu;
+      sys.unknown[indu++] = i;
     }
-    else
+
+  SparseMatrixC Quu;
+  igl::slice(sys.D, sys.unknown, sys.unknown, Quu);
+
+  // Quu (a block of the coefficient Laplacian) is Hermitian positive
+  // semi-definite, so factorize it with a sparse LDLT and a fill-reducing
+  // ordering. It is singular only for a connected component without
+  // constraints, then fall back to the LU
+  Clock::time_point t0 = Clock::now();
+  const char* method = "LDLT";
+  bool ok = false;
+  if (!useLU)
+  {
+    sys.ldlt.reset(new Eigen::SimplicialLDLT<SparseMatrixC, Eigen::Lower, Eigen::AMDOrdering<int> >());
+    sys.ldlt->compute(Quu);
+    ok = sys.ldlt->info()==Eigen::Success &&
+         sys.ldlt->vectorD().allFinite() && (sys.ldlt->vectorD().array().abs() > 0).all();
+  }
+  if (!ok)
+  {
+    sys.ldlt.reset();
+    method = "LU";
+    sys.lu.reset(new Eigen::SparseLU<SparseMatrixC>());
+    sys.lu->compute(Quu);
+    ok = sys.lu->info()==Eigen::Success;
+    if (!ok)
     {
-      unknown[indu] = i;
-      indu++;
+      sys.lu.reset();
+      std::cerr<<"Decomposition failed!"<<std::endl;
+      return false;
     }
+  }
+  std::cout<<"n-PolyVector "<<method<<" on "<<Quu.rows()<<" unknowns: factorization "
+           <<std::chrono::duration<double>(Clock::now()-t0).count()<<" s"<<std::endl;
 
-  Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > Quu, Quk;
-
-  igl::slice(Q,unknown, unknown, Quu);
-  igl::slice(Q,unknown, known, Quk);
-
+  sys.factorized = true;
+  return true;
+}
 
-  std::vector<typename Eigen::Triplet<std::complex<typename DerivedV::Scalar> > > tripletList;
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE typename igl::PolyVectorFieldFinder<DerivedV, DerivedF>::MatrixC
+igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+solveFactorized(const DegreeSystem &sys, const MatrixC &rhs) const
+{
+  if (rhs.rows() == 0)
+    return rhs;
+  if (sys.ldlt)
+    return sys.ldlt->solve(rhs);
+  return sys.lu->solve(rhs);
+}
 
-  Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > fu(N-nc,1);
+// B has a column Q(unknown, f) per released face f and a unit column per added
+// face, whose multiplier holds the face at its constrained value
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE typename igl::PolyVectorFieldFinder<DerivedV, DerivedF>::VectorC
+igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+applyBorder(const DegreeSystem &sys, const VectorC &w) const
+{
+  VectorC out = VectorC::Zero(sys.unknown.size());
+  const int nr = sys.released.size();
+  for (int a = 0; a<nr; ++a)
+    for (typename SparseMatrixC::InnerIterator it(sys.D, sys.released[a]); it; ++it)
+    {
+      const int u = sys.unknownIndex[it.row()];
+      if (u >= 0)
+        out[u] += it.value()*w[a];
+    }
+  for (size_t k = 0; k<sys.added.size(); ++k)
+    out[sys.unknownIndex[sys.added[k]]] += w[nr+k];
+  return out;
+}
 
-  igl::slice(f,unknown, Eigen::VectorXi::Zero(1,1), fu);
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE typename igl::PolyVectorFieldFinder<DerivedV, DerivedF>::VectorC
+igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+applyBorderAdjoint(const DegreeSystem &sys, const VectorC &z) const
+{
+  const int nr = sys.released.size();
+  VectorC out = VectorC::Zero(nr+sys.added.size());
+  for (int a = 0; a<nr; ++a)
+    for (typename SparseMatrixC::InnerIterator it(sys.D, sys.released[a]); it; ++it)
+    {
+      const int u = sys.unknownIndex[it.row()];
+      if (u >= 0)
+        out[a] += std::conj(it.value())*z[u];
+    }
+  for (size_t k = 0; k<sys.added.size(); ++k)
+    out[nr+k] = z[sys.unknownIndex[sys.added[k]]];
+  return out;
+}
 
-  Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > rhs = (Quk*xknown).sparseView()+.5*fu;
+// Schur complement S = C - B^H K^-1 B of the factorized block K bordered by the
+// constraint changes, C being Q on the released faces (zero for the added ones)
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE bool igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+computeBorder(DegreeSystem &sys, const Eigen::VectorXi &isConstrained)
+{
+  typedef std::chrono::steady_clock Clock;
 
-  Eigen::SparseLU< Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > > solver;
-  solver.compute(-Quu);
-  if(solver.info()!=Eigen::Success)
+  sys.bordered = false;
+  sys.released.clear();
+  sys.added.clear();
+  for (int i = 0; i<numF; ++i)
   {
-    std::cerr<<"Decomposition failed!"<<std::endl;
-    return;
+    if (sys.isConstrained[i] && !isConstrained[i])
+      sys.released.push_back(i);
+    else if (!sys.isConstrained[i] && isConstrained[i])
+      sys.added.push_back(i);
   }
-  Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> >  b  = solver.solve(rhs);
-  if(solver.info()!=Eigen::Success)
+  const int nr = sys.released.size();
+  const int m = nr+sys.added.size();
+  if (m > maxBorderSize)
+    return false;
+
+  Clock::time_point t0 = Clock::now();
+  std::vector<int> releasedIndex(numF,-1);
+  for (int a = 0; a<nr; ++a)
+    releasedIndex[sys.released[a]] = a;
+
+  MatrixC S = MatrixC::Zero(m,m);
+  for (int a = 0; a<nr; ++a)
+    for (typename SparseMatrixC::InnerIterator it(sys.D, sys.released[a]); it; ++it)
+      if (releasedIndex[it.row()] >= 0)
+        S(releasedIndex[it.row()],a) = it.value();
+
+  // K^-1 B a few columns at a time, B is not kept
+  const int blockSize = 8;
+  for (int j0 = 0; j0<m; j0 += blockSize)
   {
-    std::cerr<<"Solving failed!"<<std::endl;
-    return;
+    const int cols = std::min(blockSize, m-j0);
+    MatrixC Bj(sys.unknown.size(), cols);
+    for (int j = 0; j<cols; ++j)
+      Bj.col(j) = applyBorder(sys, VectorC::Unit(m, j0+j));
+    const MatrixC Zj = solveFactorized(sys, Bj);
+    for (int j = 0; j<cols; ++j)
+      S.col(j0+j) -= applyBorderAdjoint(sys, Zj.col(j));
   }
 
-  indk = 0, indu = 0;
-  x.setZero(N,1);
+  if (!S.allFinite())
+    return false;
+  sys.schur.compute(S);
+  if (!sys.schur.isInvertible())
+    return false;
+
+  std::cout<<"n-PolyVector border of "<<m<<" changed constraints: "
+           <<std::chrono::duration<double>(Clock::now()-t0).count()<<" s"<<std::endl;
+
+  sys.borderedConstrained = isConstrained;
+  sys.bordered = true;
+  return true;
+}
+
+// Minimize x^H Q x with the constrained faces at xknown, using the factorization
+// of sys directly if it has the same constraints, bordered by the changed
+// faces if only a few changed, and a new factorization otherwise
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE void igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+minQuadWithKnownMini(DegreeSystem &sys,
+                     const Eigen::VectorXi &isConstrained,
+                     const Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic, 1> &xknown,
+                     Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic, 1> &x)
+{
+  typedef std::chrono::steady_clock Clock;
+  const int N = numF;
+
+  // known values at their faces
+  VectorC xfull = VectorC::Zero(N);
+  int indk = 0;
   for (int i = 0; i<N; ++i)
     if (isConstrained[i])
-      x[i] = xknown[indk++];
-    else
-      x[i] = b.coeff(indu++,0);
+      xfull[i] = xknown[indk++];
+
+  auto solveCurrent = [&]() -> bool
+  {
+    if (!sys.factorized)
+      return false;
 
+    if (sys.isConstrained == isConstrained)
+    {
+      // Quu x_u = -Quk x_k
+      const VectorC r = -(sys.D*xfull);
+      VectorC ru(sys.unknown.size());
+      for (int u = 0; u<sys.unknown.size(); ++u)
+        ru[u] = r[sys.unknown[u]];
+      const VectorC y = solveFactorized(sys, ru);
+
+      x = xfull;
+      for (int u = 0; u<sys.unknown.size(); ++u)
+        x[sys.unknown[u]] = y[u];
+      return x.allFinite();
+    }
+
+    if (!(sys.bordered && sys.borderedConstrained == isConstrained) &&
+        !computeBorder(sys, isConstrained))
+      return false;
+
+    // [K B; B^H C] [y; w] = [r; g], with r and g from the faces constrained
+    // both in the factorization and now, and g holding the added values
+    const int nr = sys.released.size();
+    VectorC xt = xfull;
+    for (int i = 0; i<N; ++i)
+      if (!sys.isConstrained[i])
+        xt[i] = 0;
+    const VectorC r = -(sys.D*xt);
+    VectorC ru(sys.unknown.size());
+    for (int u = 0; u<sys.unknown.size(); ++u)
+      ru[u] = r[sys.unknown[u]];
+    VectorC g(nr+sys.added.size());
+    for (int a = 0; a<nr; ++a)
+      g[a] = r[sys.released[a]];
+    for (size_t k = 0; k<sys.added.size(); ++k)
+      g[nr+k] = xfull[sys.added[k]];
+
+    const VectorC z = solveFactorized(sys, ru);
+    const VectorC w = sys.schur.solve(VectorC(g-applyBorderAdjoint(sys, z)));
+    const VectorC y = solveFactorized(sys, VectorC(ru-applyBorder(sys, w)));
+
+    x = xfull;
+    for (int u = 0; u<sys.unknown.size(); ++u)
+      if (!isConstrained[sys.unknown[u]])
+        x[sys.unknown[u]] = y[u];
+    for (int a = 0; a<nr; ++a)
+      x[sys.released[a]] = w[a];
+    return x.allFinite();
+  };
+
+  Clock::time_point t0 = Clock::now();
+  bool solved = solveCurrent();
+  if (!solved && factorize(sys, isConstrained, false))
+    solved = solveCurrent();
+  if (!solved && sys.ldlt && factorize(sys, isConstrained, true))
+    solved = solveCurrent();
+  if (!solved)
+  {
+    std::cerr<<"Solving failed!"<<std::endl;
+    x = xfull;
+    return;
+  }
+  std::cout<<"n-PolyVector solve: "
+           <<std::chrono::duration<double>(Clock::now()-t0).count()<<" s"<<std::endl;
 }
 
 
@@ -218,21 +499,135 @@ IGL_INLINE bool igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
 
   for (int i =0; i<n; ++i)
   {
-    int degree = 2*(i+1);
-
     Eigen::Matrix<std::complex<typename DerivedV::Scalar>, Eigen::Dynamic,1> Ck;
     getGeneralCoeffConstraints(isConstrained,
                                cfW,
                                i,
                                Ck);
 
-    Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > DD;
-    computeCoefficientLaplacian(degree, DD);
-    Eigen::SparseMatrix<std::complex<typename DerivedV::Scalar> > f; f.resize(numF,1);
+    minQuadWithKnownMini(systems[i], isConstrained, Ck, coeffs[i]);
+  }
+
+  setOutputFromCoefficients(coeffs, output);
+  return true;
+}
+
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE bool igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+                     solveIterative(const Eigen::VectorXi &isConstrained,
+                                    const Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &cfW,
+                                    const Eigen::VectorXd &softWeight,
+                                    const Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &cfSoft,
+                                    double alpha,
+                                    double tolerance,
+                                    Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &output)
+{
+  Eigen::VectorXi isSoft = Eigen::VectorXi::Zero(numF);
+  for (int fi=0; fi<numF; ++fi)
+    isSoft[fi] = (softWeight[fi] > 0) && !isConstrained[fi];
+
+  std::vector<VectorC> coeffs(n,VectorC::Zero(numF, 1));
+  for (int i =0; i<n; ++i)
+  {
+    VectorC Ck, Sk;
+    getGeneralCoeffConstraints(isConstrained, cfW, i, Ck);
+    getGeneralCoeffConstraints(isSoft, cfSoft, i, Sk);
+
+    // soft coefficients at their faces
+    VectorC xsoft = VectorC::Zero(numF);
+    int inds = 0;
+    for (int fi=0; fi<numF; ++fi)
+      if (isSoft[fi])
+        xsoft[fi] = Sk[inds++];
+
+    if (!minQuadIterative(systems[i].D, isConstrained, Ck, softWeight, xsoft, alpha, tolerance, coeffs[i]))
+      return false;
+  }
+
+  setOutputFromCoefficients(coeffs, output);
+  return true;
+}
+
+// Minimize (1-alpha) x^H D x + alpha sum_f w_f |x_f - xsoft_f|^2 with the
+// constrained faces at xknown, as the soft constraints of the MIQ smoothing.
+// False if CG does not reach the tolerance or its result is not finite
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE bool igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+minQuadIterative(const SparseMatrixC &D,
+                 const Eigen::VectorXi &isConstrained,
+                 const VectorC &xknown,
+                 const Eigen::VectorXd &softWeight,
+                 const VectorC &xsoft,
+                 double alpha,
+                 double tolerance,
+                 VectorC &x)
+{
+  typedef std::chrono::steady_clock Clock;
+  const int N = numF;
+
+  VectorC xfull = VectorC::Zero(N);
+  Eigen::VectorXi unknown(N-isConstrained.sum());
+  int indk = 0, indu = 0;
+  for (int i = 0; i<N; ++i)
+    if (isConstrained[i])
+      xfull[i] = xknown[indk++];
+    else
+      unknown[indu++] = i;
+
+  Clock::time_point t0 = Clock::now();
+  SparseMatrixC Quu;
+  igl::slice(D, unknown, unknown, Quu);
+  Quu *= Complex(1.-alpha);
 
-    minQuadWithKnownMini(DD, f, isConstrained, Ck, coeffs[i]);
+  const VectorC r = -(1.-alpha)*(D*xfull);
+  VectorC rhs(unknown.size());
+  std::vector<Eigen::Triplet<Complex> > soft;
+  for (int u = 0; u<unknown.size(); ++u)
+  {
+    const int fi = unknown[u];
+    rhs[u] = r[fi];
+    if (alpha > 0 && softWeight[fi] > 0)
+    {
+      soft.emplace_back(u, u, Complex(alpha*softWeight[fi]));
+      rhs[u] += alpha*softWeight[fi]*xsoft[fi];
+    }
+  }
+  if (!soft.empty())
+  {
+    SparseMatrixC W(unknown.size(), unknown.size());
+    W.setFromTriplets(soft.begin(), soft.end());
+    Quu += W;
+  }
+
+  Eigen::ConjugateGradient<SparseMatrixC, Eigen::Lower|Eigen::Upper, igl::ConnectionMultigrid<typename DerivedV::Scalar> > cg;
+  cg.setTolerance(tolerance);
+  cg.setMaxIterations(1000);
+  cg.compute(Quu);
+  Clock::time_point t1 = Clock::now();
+  VectorC y = cg.solve(rhs);
+  Clock::time_point t2 = Clock::now();
+
+  std::cout<<"n-PolyVector CG on "<<Quu.rows()<<" unknowns, "<<cg.preconditioner().numLevels()<<" levels: "
+           <<cg.iterations()<<" iterations, error "<<cg.error()<<", setup "
+           <<std::chrono::duration<double>(t1-t0).count()<<" s, solve "
+           <<std::chrono::duration<double>(t2-t1).count()<<" s"<<std::endl;
+  if (cg.info()!=Eigen::Success || !y.allFinite())
+  {
+    std::cerr<<"n-PolyVector CG did not reach the tolerance "<<tolerance<<std::endl;
+    return false;
   }
 
+  x = xfull;
+  for (int u = 0; u<unknown.size(); ++u)
+    x[unknown[u]] = y[u];
+  return true;
+}
+
+template<typename DerivedV, typename DerivedF>
+IGL_INLINE void igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
+setOutputFromCoefficients(const std::vector<VectorC> &coeffs,
+                          Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, Eigen::Dynamic> &output)
+{
   std::vector<Eigen::Matrix<typename DerivedV::Scalar, Eigen::Dynamic, 2> > pv;
   setFieldFromGeneralCoefficients(coeffs, pv);
 
@@ -244,7 +639,6 @@ IGL_INLINE bool igl::PolyVectorFieldFinder<DerivedV, DerivedF>::
     for (int i=0; i<n; ++i)
       output.block(fi,3*i, 1, 3) = pv[i](fi,0)*b1 + pv[i](fi,1)*b2;
   }
-  return true;
 }
 
 template<typename DerivedV, typename DerivedF>
@@ -515,6 +909,84 @@ IGL_INLINE void igl::n_polyvector(const Eigen::MatrixXd &V,
   pvff.solve(isConstrained, cfW, output);
 }
 
+IGL_INLINE bool igl::n_polyvector_iterative(const Eigen::MatrixXd &V,
+                                            const Eigen::MatrixXi &F,
+                                            const Eigen::VectorXi& b,
+                                            const Eigen::MatrixXd& bc,
+                                            const Eigen::VectorXi& softI,
+                                            const Eigen::VectorXd& softW,
+                                            const Eigen::MatrixXd& softD,
+                                            double alpha,
+                                            double tolerance,
+                                            Eigen::MatrixXd &output)
+{
+  Eigen::VectorXi isConstrained = Eigen::VectorXi::Constant(F.rows(),0);
+  Eigen::MatrixXd cfW = Eigen::MatrixXd::Constant(F.rows(),bc.cols(),0);
+
+  for(unsigned i=0; i<b.size();++i)
+  {
+    isConstrained(b(i)) = 1;
+    cfW.row(b(i)) << bc.row(i);
+  }
+  if (b.size() == F.rows())
+  {
+    output = cfW;
+    return true;
+  }
+
+  Eigen::VectorXd softWeight = Eigen::VectorXd::Zero(F.rows());
+  Eigen::MatrixXd cfSoft = Eigen::MatrixXd::Zero(F.rows(),bc.cols());
+  for(int i=0; i<softI.size(); ++i)
+  {
+    softWeight(softI(i)) = softW(i);
+    cfSoft.row(softI(i)) << softD.row(i);
+  }
+
+  int n = cfW.cols()/3;
+  igl::PolyVectorFieldFinder<Eigen::MatrixXd, Eigen::MatrixXi> pvff(V,F,n);
+  return pvff.solveIterative(isConstrained, cfW, softWeight, cfSoft, alpha, tolerance, output);
+}
+
+IGL_INLINE igl::NPolyVectorSolver::NPolyVectorSolver(const Eigen::MatrixXd &V,
+                                                     const Eigen::MatrixXi &F,
+                                                     int n):
+finder(new igl::PolyVectorFieldFinder<Eigen::MatrixXd, Eigen::MatrixXi>(V,F,n)),
+numF(F.rows())
+{
+}
+
+IGL_INLINE igl::NPolyVectorSolver::~NPolyVectorSolver()
+{
+}
+
+IGL_INLINE bool igl::NPolyVectorSolver::matches(const Eigen::MatrixXd &V,
+                                                const Eigen::MatrixXi &F,
+                                                int n) const
+{
+  return finder->matches(V,F,n);
+}
+
+IGL_INLINE void igl::NPolyVectorSolver::solve(const Eigen::VectorXi& b,
+                                              const Eigen::MatrixXd& bc,
+                                              Eigen::MatrixXd &output)
+{
+  Eigen::VectorXi isConstrained = Eigen::VectorXi::Constant(numF,0);
+  Eigen::MatrixXd cfW = Eigen::MatrixXd::Constant(numF,bc.cols(),0);
+
+  for(unsigned i=0; i<b.size();++i)
+  {
+    isConstrained(b(i)) = 1;
+    cfW.row(b(i)) << bc.row(i);
+  }
+  if (b.size() == numF)
+  {
+    output = cfW;
+    return;
+  }
+
+  finder->solve(isConstrained, cfW, output);
+}
+
 
 #ifdef IGL_STATIC_LIBRARY
 // Explicit template instantiation
@@ -11,6 +11,7 @@
 #include "igl/igl_inline.h"
 
 #include <Eigen/Core>
+#include <memory>
 #include <vector>
 
 namespace igl {
@@ -30,6 +31,58 @@ namespace igl {
                                const Eigen::MatrixXd& bc,
                                Eigen::MatrixXd &output);
 
+  // n_polyvector for meshes too big to factorize: conjugate gradient with a
+  // multigrid preconditioner, in memory linear in the faces. With alpha > 0
+  // the faces softI are also attracted to the vectors softD (same columns as
+  // bc) with weights softW, alpha in [0,1) blending smoothness and attraction
+  // as in the MIQ soft constraints; with alpha = 0 it minimizes the same
+  // energy as n_polyvector.
+  //   tolerance   relative residual at which the solver stops
+  // Returns false, leaving output unchanged, if the solver does not reach the
+  // tolerance or its result is not finite
+  IGL_INLINE bool n_polyvector_iterative(const Eigen::MatrixXd& V,
+                                         const Eigen::MatrixXi& F,
+                                         const Eigen::VectorXi& b,
+                                         const Eigen::MatrixXd& bc,
+                                         const Eigen::VectorXi& softI,
+                                         const Eigen::VectorXd& softW,
+                                         const Eigen::MatrixXd& softD,
+                                         double alpha,
+                                         double tolerance,
+                                         Eigen::MatrixXd &output);
+
+  template <typename DerivedV, typename DerivedF> class PolyVectorFieldFinder;
+
+  // n_polyvector for repeated solves on the same mesh: the edge topology, the
+  // coefficient Laplacians and their factorizations are kept between solves.
+  // A solve with the constraints of the previous factorization only does the
+  // back substitution, one whose constrained faces differ in a few faces
+  // borders that factorization (Schur complement) instead of computing a new one.
+  // Not thread safe
+  class NPolyVectorSolver
+  {
+  public:
+    // n: number of vectors per face (bc has 3*n columns)
+    IGL_INLINE NPolyVectorSolver(const Eigen::MatrixXd& V,
+                                 const Eigen::MatrixXi& F,
+                                 int n);
+    IGL_INLINE ~NPolyVectorSolver();
+
+    // true if the solver was built for this mesh and n
+    IGL_INLINE bool matches(const Eigen::MatrixXd& V,
+                            const Eigen::MatrixXi& F,
+                            int n) const;
+
+    // same inputs and output as n_polyvector
+    IGL_INLINE void solve(const Eigen::VectorXi& b,
+                          const Eigen::MatrixXd& bc,
+                          Eigen::MatrixXd &output);
+
+  private:
+    std::unique_ptr<PolyVectorFieldFinder<Eigen::MatrixXd, Eigen::MatrixXi> > finder;
+    int numF;
+  };
+
 };
 
 
@@ -0,0 +1,241 @@
+/***************************************************************************/
+/* Copyright(C) 2021
+
+
+The authors of
+
+Reliable Feature-Line Driven Quad-Remeshing
+Siggraph 2021
+
+
+ All rights reserved.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+****************************************************************************/
+
+#ifndef POLYVECTOR_MULTIGRID_H
+#define POLYVECTOR_MULTIGRID_H
+
+#include <Eigen/Sparse>
+
+#include <complex>
+#include <cmath>
+#include <vector>
+
+namespace igl {
+
+//Algebraic multigrid preconditioner for the Hermitian systems of the
+//n-PolyVector coefficients, usable with Eigen::ConjugateGradient.
+//Faces are grouped into aggregates of a face and its neighbours; the
+//prolongation carries the coarse value of an aggregate to its faces rotated
+//by the connection (the phase of the off-diagonal entries), so a smooth field
+//is represented exactly on the coarse levels. One V-cycle with a symmetric
+//Gauss-Seidel smoother keeps the preconditioner symmetric. The hierarchy
+//takes memory linear in the size of the system
+template <typename Scalar>
+class ConnectionMultigrid
+{
+public:
+    typedef std::complex<Scalar> Complex;
+    typedef Eigen::SparseMatrix<Complex> SparseMatrixC;
+    typedef Eigen::Matrix<Complex, Eigen::Dynamic, 1> VectorC;
+
+    ConnectionMultigrid() : isInitialized(false) {}
+
+    template<typename MatrixType>
+    ConnectionMultigrid& analyzePattern(const MatrixType&) { return *this; }
+
+    template<typename MatrixType>
+    ConnectionMultigrid& factorize(const MatrixType& mat) { return compute(mat); }
+
+    template<typename MatrixType>
+    ConnectionMultigrid& compute(const MatrixType& mat)
+    {
+        levels.clear();
+        levels.emplace_back();
+        levels.back().A = mat;
+        levels.back().A.makeCompressed();
+
+        while (levels.back().A.rows() > coarsestSize && (int)levels.size() < maxLevels)
+        {
+            SparseMatrixC P;
+            if (!aggregate(levels.back().A, P))
+                break;
+            Level coarse;
+            SparseMatrixC Ph = P.adjoint();
+            coarse.A = Ph * levels.back().A * P;
+            coarse.A.makeCompressed();
+            levels.back().P = P;
+            levels.push_back(coarse);
+        }
+        for (Level &level : levels)
+            level.diag = level.A.diagonal();
+
+        //the coarsest level is solved directly, slightly regularized since
+        //a part of the mesh without constraints makes it singular
+        SparseMatrixC Ac = levels.back().A;
+        Scalar maxDiag = 0;
+        for (int i = 0; i < Ac.rows(); ++i)
+            maxDiag = std::max(maxDiag, std::abs(levels.back().diag[i]));
+        SparseMatrixC I(Ac.rows(), Ac.cols());
+        I.setIdentity();
+        Ac += I * Complex(1e-10 * std::max(maxDiag, Scalar(1)));
+        coarseSolver.compute(Ac);
+
+        isInitialized = true;
+        return *this;
+    }
+
+    Eigen::ComputationInfo info() const
+    {
+        return isInitialized ? coarseSolver.info() : Eigen::InvalidInput;
+    }
+
+    //one V-cycle from a zero guess
+    VectorC solve(const VectorC &b) const
+    {
+        return cycle(0, b);
+    }
+
+    int numLevels() const { return (int)levels.size(); }
+
+private:
+    struct Level
+    {
+        SparseMatrixC A;
+        SparseMatrixC P; //prolongation from the next level
+        VectorC diag;
+    };
+
+    //below this size the level is factorized
+    static const int coarsestSize = 1000;
+    static const int maxLevels = 20;
+
+    std::vector<Level> levels;
+    Eigen::SimplicialLDLT<SparseMatrixC, Eigen::Lower, Eigen::AMDOrdering<int> > coarseSolver;
+    bool isInitialized;
+
+    //A(i,j) of a neighbour j transports the value of j to i: x_i ~ -A(i,j)/|A(i,j)| x_j
+    static Complex transport(const Complex &a)
+    {
+        return -a / std::abs(a);
+    }
+
+    static bool aggregate(const SparseMatrixC &A, SparseMatrixC &P)
+    {
+        const int n = A.rows();
+        std::vector<int> agg(n, -1);
+        std::vector<Complex> phase(n, Complex(1));
+        int numAgg = 0;
+
+        //a face whose neighbours are all free makes an aggregate with them
+        for (int i = 0; i < n; ++i)
+        {
+            if (agg[i] != -1)
+                continue;
+            bool free = true;
+            for (typename SparseMatrixC::InnerIterator it(A, i); it && free; ++it)
+                if (it.row() != i && agg[it.row()] != -1)
+                    free = false;
+            if (!free)
+                continue;
+            agg[i] = numAgg;
+            for (typename SparseMatrixC::InnerIterator it(A, i); it; ++it)
+            {
+                const int j = it.row();
+                if (j == i || std::abs(it.value()) == 0)
+                    continue;
+                agg[j] = numAgg;
+                //the column of i holds A(j,i)
+                phase[j] = transport(it.value()) * phase[i];
+            }
+            numAgg++;
+        }
+
+        //the others join the aggregate of their strongest neighbour
+        std::vector<int> joined(agg);
+        for (int i = 0; i < n; ++i)
+        {
+            if (agg[i] != -1)
+                continue;
+            int best = -1;
+            Scalar bestW = 0;
+            Complex bestA;
+            for (typename SparseMatrixC::InnerIterator it(A, i); it; ++it)
+            {
+                const int j = it.row();
+                if (j == i || agg[j] == -1 || std::abs(it.value()) <= bestW)
+                    continue;
+                best = j;
+                bestW = std::abs(it.value());
+                bestA = it.value();
+            }
+            if (best == -1)
+            {
+                joined[i] = numAgg++;
+                continue;
+            }
+            joined[i] = agg[best];
+            //the column of i holds A(best,i) = conj(A(i,best))
+            phase[i] = transport(std::conj(bestA)) * phase[best];
+        }
+
+        //no coarsening, e.g. a level without off-diagonal entries
+        if (numAgg > 0.8 * n)
+            return false;
+
+        std::vector<Eigen::Triplet<Complex> > triplets;
+        triplets.reserve(n);
+        for (int i = 0; i < n; ++i)
+            triplets.emplace_back(i, joined[i], phase[i]);
+        P.resize(n, numAgg);
+        P.setFromTriplets(triplets.begin(), triplets.end());
+        return true;
+    }
+
+    //x_i = (b_i - sum_j A(i,j) x_j) / A(i,i), with A(i,j) = conj(A(j,i)) read
+    //from column i
+    static void relax(const Level &level, const VectorC &b, VectorC &x, const int i)
+    {
+        if (std::abs(level.diag[i]) == 0)
+            return;
+        Complex sum = b[i];
+        for (typename SparseMatrixC::InnerIterator it(level.A, i); it; ++it)
+            if (it.row() != i)
+                sum -= std::conj(it.value()) * x[it.row()];
+        x[i] = sum / level.diag[i];
+    }
+
+    VectorC cycle(const size_t l, const VectorC &b) const
+    {
+        const Level &level = levels[l];
+        if (l + 1 == levels.size())
+            return coarseSolver.solve(b);
+
+        const int n = level.A.rows();
+        VectorC x = VectorC::Zero(n);
+        for (int i = 0; i < n; ++i)
+            relax(level, b, x, i);
+
+        const VectorC r = b - level.A * x;
+        x += level.P * cycle(l + 1, VectorC(level.P.adjoint() * r));
+
+        for (int i = n - 1; i >= 0; --i)
+            relax(level, b, x, i);
+        return x;
+    }
+};
+
+}
+
+#endif // POLYVECTOR_MULTIGRID_H
@@ -0,0 +1,289 @@
+/***************************************************************************/
+/* Copyright(C) 2021
+
+
+The authors of
+
+Reliable Feature-Line Driven Quad-Remeshing
+Siggraph 2021
+
+
+ All rights reserved.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+****************************************************************************/
+
+#ifndef QR_VERTEX_CURVATURE_H
+#define QR_VERTEX_CURVATURE_H
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <scheduler.h>
+
+namespace vcg {
+namespace tri {
+
+//Principal curvature directions and values of the vertices, fitting a quadric
+//to the N-ring of each vertex as igl::principal_curvature does (Panozzo et al.
+//2010), but working on the mesh itself: compressed (CSR) adjacency instead of
+//a copy of the mesh into matrices, fixed size fits and the vertices computed
+//in parallel. Writes PD1/PD2 (maximal/minimal direction) and K1/K2
+template <class MeshType>
+class QuadricCurvature
+{
+    typedef typename MeshType::CoordType CoordType;
+
+    //row i has the entries Index[Start[i]] .. Index[Start[i+1]-1]
+    struct Adjacency
+    {
+        std::vector<size_t> Start;
+        std::vector<int> Index;
+
+        size_t Size(size_t i) const {return Start[i+1]-Start[i];}
+        const int *Begin(size_t i) const {return Index.data()+Start[i];}
+        const int *End(size_t i) const {return Index.data()+Start[i+1];}
+    };
+
+    //a fit needs at least this many points, as in igl
+    static const size_t MinRingSize=6;
+
+    static Eigen::Vector3d Pos(const MeshType &mesh,int v)
+    {
+        const CoordType &P=mesh.vert[v].cP();
+        return Eigen::Vector3d(P.X(),P.Y(),P.Z());
+    }
+
+    static void VertexFaces(const MeshType &mesh,Adjacency &VF)
+    {
+        VF.Start.assign(mesh.vert.size()+1,0);
+        for (size_t i=0;i<mesh.face.size();i++)
+        {
+            if (mesh.face[i].IsD())continue;
+            for (int j=0;j<3;j++)
+                VF.Start[vcg::tri::Index(mesh,mesh.face[i].cV(j))+1]++;
+        }
+        for (size_t i=0;i<mesh.vert.size();i++)
+            VF.Start[i+1]+=VF.Start[i];
+
+        VF.Index.resize(VF.Start.back());
+        std::vector<size_t> Fill(VF.Start.begin(),VF.Start.end()-1);
+        for (size_t i=0;i<mesh.face.size();i++)
+        {
+            if (mesh.face[i].IsD())continue;
+            for (int j=0;j<3;j++)
+                VF.Index[Fill[vcg::tri::Index(mesh,mesh.face[i].cV(j))]++]=i;
+        }
+    }
+
+    //the other vertices of the faces of each vertex, sorted
+    static void VertexVertices(const MeshType &mesh,const Adjacency &VF,Adjacency &VV)
+    {
+        const size_t numV=mesh.vert.size();
+        auto collect=[&mesh,&VF](size_t v,std::vector<int> &Neigh)
+        {
+            Neigh.clear();
+            for (const int *f=VF.Begin(v);f!=VF.End(v);f++)
+                for (int j=0;j<3;j++)
+                {
+                    int w=vcg::tri::Index(mesh,mesh.face[*f].cV(j));
+                    if (w!=(int)v)Neigh.push_back(w);
+                }
+            std::sort(Neigh.begin(),Neigh.end());
+            Neigh.erase(std::unique(Neigh.begin(),Neigh.end()),Neigh.end());
+        };
+
+        VV.Start.assign(numV+1,0);
+        Scheduler::parallelFor(0,numV,[&](size_t v){
+            thread_local std::vector<int> Neigh;
+            collect(v,Neigh);
+            VV.Start[v+1]=Neigh.size();
+        },256);
+        for (size_t v=0;v<numV;v++)
+            VV.Start[v+1]+=VV.Start[v];
+
+        VV.Index.resize(VV.Start.back());
+        Scheduler::parallelFor(0,numV,[&](size_t v){
+            thread_local std::vector<int> Neigh;
+            collect(v,Neigh);
+            std::copy(Neigh.begin(),Neigh.end(),VV.Index.begin()+VV.Start[v]);
+        },256);
+    }
+
+    //angle weighted normals
+    static void VertexNormals(const MeshType &mesh,const Adjacency &VF,std::vector<Eigen::Vector3d> &Normals)
+    {
+        Normals.assign(mesh.vert.size(),Eigen::Vector3d::Zero());
+        Scheduler::parallelFor(0,mesh.vert.size(),[&](size_t v){
+            Eigen::Vector3d N=Eigen::Vector3d::Zero();
+            for (const int *f=VF.Begin(v);f!=VF.End(v);f++)
+            {
+                int j=0;
+                while (vcg::tri::Index(mesh,mesh.face[*f].cV(j))!=v)j++;
+                const Eigen::Vector3d P0=Pos(mesh,v);
+                const Eigen::Vector3d E1=Pos(mesh,vcg::tri::Index(mesh,mesh.face[*f].cV((j+1)%3)))-P0;
+                const Eigen::Vector3d E2=Pos(mesh,vcg::tri::Index(mesh,mesh.face[*f].cV((j+2)%3)))-P0;
+                const Eigen::Vector3d FN=E1.cross(E2);
+                if ((FN.norm()==0)||(E1.norm()==0)||(E2.norm()==0))continue;
+                const double Angle=std::acos(std::max(-1.0,std::min(1.0,E1.normalized().dot(E2.normalized()))));
+                N+=Angle*FN.normalized();
+            }
+            if (N.norm()>0)N.normalize();
+            Normals[v]=N;
+        },256);
+    }
+
+    //vertices within Nring edges of v, v first
+    static void Ring(const Adjacency &VV,int v,int Nring,std::vector<int> &RingV)
+    {
+        RingV.clear();
+        RingV.push_back(v);
+        size_t LevelBegin=0;
+        for (int r=0;r<Nring;r++)
+        {
+            const size_t LevelEnd=RingV.size();
+            for (size_t k=LevelBegin;k<LevelEnd;k++)
+                for (const int *w=VV.Begin(RingV[k]);w!=VV.End(RingV[k]);w++)
+                    if (std::find(RingV.begin(),RingV.end(),*w)==RingV.end())
+                        RingV.push_back(*w);
+            LevelBegin=LevelEnd;
+        }
+    }
+
+    //fit h = a u^2 + b uv + c v^2 + d u + e v in the tangent frame of v and
+    //take the principal curvatures of the quadric at the origin
+    static bool Fit(const MeshType &mesh,
+                    const std::vector<Eigen::Vector3d> &Normals,
+                    const Adjacency &VV,
+                    int v,
+                    std::vector<int> &RingV,
+                    Eigen::Vector3d &PD1,Eigen::Vector3d &PD2,
+                    double &K1,double &K2)
+    {
+        //average normal of the neighbourhood
+        Eigen::Vector3d N=Eigen::Vector3d::Zero();
+        for (size_t k=0;k<RingV.size();k++)
+            N+=Normals[RingV[k]];
+        if (N.norm()==0)return false;
+        N.normalize();
+
+        //leave out the vertices facing away, unless too few remain
+        size_t Front=0;
+        for (size_t k=0;k<RingV.size();k++)
+            if (Normals[RingV[k]].dot(N)>0)Front++;
+        if ((Front>=MinRingSize)&&(Front<RingV.size()))
+            RingV.erase(std::remove_if(RingV.begin(),RingV.end(),
+                                       [&](int w){return Normals[w].dot(N)<=0;}),RingV.end());
+        if ((RingV.size()<MinRingSize)||(VV.Size(v)==0))return false;
+
+        //tangent frame, x towards the first neighbour
+        const Eigen::Vector3d P=Pos(mesh,v);
+        Eigen::Vector3d X=Pos(mesh,*VV.Begin(v))-P;
+        X-=X.dot(N)*N;
+        if (X.norm()==0)return false;
+        X.normalize();
+        const Eigen::Vector3d Y=N.cross(X).normalized();
+
+        //least squares on coordinates scaled to the size of the ring
+        double Scale=0;
+        for (size_t k=0;k<RingV.size();k++)
+            Scale=std::max(Scale,(Pos(mesh,RingV[k])-P).norm());
+        if (Scale==0)return false;
+
+        Eigen::Matrix<double,5,5> M=Eigen::Matrix<double,5,5>::Zero();
+        Eigen::Matrix<double,5,1> R=Eigen::Matrix<double,5,1>::Zero();
+        for (size_t k=0;k<RingV.size();k++)
+        {
+            const Eigen::Vector3d D=(Pos(mesh,RingV[k])-P)/Scale;
+            const double u=D.dot(X),t=D.dot(Y),h=D.dot(N);
+            Eigen::Matrix<double,5,1> Phi;
+            Phi<<u*u,u*t,t*t,u,t;
+            M+=Phi*Phi.transpose();
+            R+=Phi*h;
+        }
+        Eigen::JacobiSVD<Eigen::Matrix<double,5,5> > Svd(M,Eigen::ComputeFullU|Eigen::ComputeFullV);
+        const Eigen::Matrix<double,5,1> Q=Svd.solve(R);
+        const double a=Q[0]/Scale,b=Q[1]/Scale,c=Q[2]/Scale,d=Q[3],e=Q[4];
+
+        //fundamental forms of the quadric at the origin
+        const double E=1.0+d*d;
+        const double F=d*e;
+        const double G=1.0+e*e;
+        const double Nz=Eigen::Vector3d(-d,-e,1.0).normalized()[2];
+        const double L=2.0*a*Nz;
+        const double Mf=b*Nz;
+        const double Nf=2.0*c*Nz;
+
+        Eigen::Matrix2d Shape;
+        Shape<<L*G-Mf*F, Mf*E-L*F,
+               Mf*E-L*F, Nf*E-Mf*F;
+        Shape/=(E*G-F*F);
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> Eig(Shape);
+        const Eigen::Vector2d Val=-Eig.eigenvalues();
+        const Eigen::Matrix2d &Vec=Eig.eigenvectors();
+
+        Eigen::Vector3d Dir0=(X*Vec(0,0)+Y*Vec(1,0)).normalized();
+        Eigen::Vector3d Dir1=(X*Vec(0,1)+Y*Vec(1,1)).normalized();
+        if (!Val.allFinite()||!Dir0.allFinite()||!Dir1.allFinite())return false;
+
+        if (Val[0]>=Val[1])
+        {
+            PD1=Dir0;K1=Val[0];
+            PD2=Dir1;K2=Val[1];
+        }
+        else
+        {
+            PD1=Dir1;K1=Val[1];
+            PD2=Dir0;K2=Val[0];
+        }
+        return true;
+    }
+
+public:
+
+    static void Compute(MeshType &mesh,int Nring)
+    {
+        Adjacency VF,VV;
+        VertexFaces(mesh,VF);
+        VertexVertices(mesh,VF,VV);
+
+        std::vector<Eigen::Vector3d> Normals;
+        VertexNormals(mesh,VF,Normals);
+
+        Scheduler::parallelFor(0,mesh.vert.size(),[&](size_t v){
+            thread_local std::vector<int> RingV;
+            Eigen::Vector3d PD1=Eigen::Vector3d::Zero(),PD2=Eigen::Vector3d::Zero();
+            double K1=0,K2=0;
+            if (!mesh.vert[v].IsD())
+            {
+                Ring(VV,v,Nring,RingV);
+                if (!Fit(mesh,Normals,VV,v,RingV,PD1,PD2,K1,K2))
+                {
+                    PD1.setZero();PD2.setZero();
+                    K1=K2=0;
+                }
+            }
+            mesh.vert[v].PD1()=CoordType(PD1[0],PD1[1],PD1[2]);
+            mesh.vert[v].PD2()=CoordType(PD2[0],PD2[1],PD2[2]);
+            mesh.vert[v].K1()=K1;
+            mesh.vert[v].K2()=K2;
+        },256);
+    }
+};
+
+} // end namespace tri
+} // end namespace vcg
+#endif // QR_VERTEX_CURVATURE_H
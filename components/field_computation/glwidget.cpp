@@ -439,13 +439,15 @@ void InitFieldBar(QWidget *w)
     TwAddVarRW(barQuad,"HardCT",TW_TYPE_DOUBLE, &FieldParam.curv_thr," label='Hard Curv Thr'");
     TwAddVarRW(barQuad,"CurvRing",TW_TYPE_INT32,&FieldParam.curvRing,"label='Curvature Ring'");
 
-    TwEnumVal smoothmodes[3] = {
+    TwEnumVal smoothmodes[4] = {
         {vcg::tri::SMMiq,"MIQ"},
         {vcg::tri::SMNPoly,"NPoly"},
-        {vcg::tri::SMIterative,"Ite"}
+        {vcg::tri::SMIterative,"Ite"},
+        {vcg::tri::SMNPolyIterative,"NPolyIte"}
     };
-    TwType smoothMode = TwDefineEnum("SmoothMode", smoothmodes, 3);
+    TwType smoothMode = TwDefineEnum("SmoothMode", smoothmodes, 4);
     TwAddVarRW(barQuad, "Smooth Mode", smoothMode, &FieldParam.SmoothM," label='Smooth Mode' ");
+    TwAddVarRW(barQuad,"SolveTol",TW_TYPE_DOUBLE, &FieldParam.solve_tol," label='Iterative Tolerance' min=1e-12 step=1e-7");
 
 
     TwAddButton(barQuad,"AutoSetup",AutoSetupField,0,"label='Auto Setup Field'");
@@ -605,6 +607,8 @@ GLWidget::GLWidget(QWidget *parent)
     bool Loaded=tri_mesh.LoadTriMesh(pathM,AllQuad);
     FieldParam.alpha_curv=alpha;
     FieldParam.curv_thr=0.8;
+    //the field is smoothed again and again on the same mesh
+    FieldParam.NPolyCache=std::make_shared<vcg::tri::NPolySolverCache>();
 
     if (!Loaded)
     {
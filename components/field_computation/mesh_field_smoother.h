@@ -51,12 +51,15 @@ class MeshFieldSmoother
         FParam.align_borders=true;
         FParam.sharp_thr=0;
 
+        //the iterative n-PolyVector solver, if chosen, replaces both methods
+        bool Iterative=(FParam.SmoothM==vcg::tri::SMNPolyIterative);
+
         bool SufficientFeatures=mesh.SufficientFeatures(SharpFactor);
 
         if (SufficientFeatures)
         {
             std::cout<<"Using NPoly"<<std::endl;
-            FParam.SmoothM=vcg::tri::SMNPoly;
+            FParam.SmoothM=Iterative?vcg::tri::SMNPolyIterative:vcg::tri::SMNPoly;
             FParam.curv_thr=0;
             FParam.alpha_curv=0;
         }
@@ -64,12 +67,12 @@ class MeshFieldSmoother
         {
 #ifndef COMISO_FIELD
             std::cout<<"Using NPoly"<<std::endl;
-            FParam.SmoothM=vcg::tri::SMNPoly;
+            FParam.SmoothM=Iterative?vcg::tri::SMNPolyIterative:vcg::tri::SMNPoly;
             FParam.curv_thr=0.8;
             FParam.alpha_curv=0;
 #else
             std::cout<<"Using Comiso"<<std::endl;
-            FParam.SmoothM=vcg::tri::SMMiq;
+            FParam.SmoothM=Iterative?vcg::tri::SMNPolyIterative:vcg::tri::SMMiq;
             if (FParam.alpha_curv==0)
                 FParam.alpha_curv=0.3;
             FParam.curv_thr=0;
@@ -114,7 +117,8 @@ class MeshFieldSmoother
             FieldParam.align_borders=true;
 //        }
 #ifndef COMISO_FIELD
-         FieldParam.SmoothM=vcg::tri::SMNPoly;
+         if (FieldParam.SmoothM!=vcg::tri::SMNPolyIterative)
+             FieldParam.SmoothM=vcg::tri::SMNPoly;
 #endif
 //        std::cout<<"..Alpha.."<<FieldParam.alpha_curv<<std::endl;
 //        std::cout<<"..Smoothing.."<<std::endl;
@@ -38,6 +38,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "AutoRemesher.h"
 #include <wrap/io_trimesh/export_field.h>
 #include <iostream>
+#include <functional>
+#include <string>
 #include <fstream>
 #include <vcg/complex/algorithms/attribute_seam.h>
 #include <vcg/complex/algorithms/crease_cut.h>
@@ -717,14 +719,30 @@ public:
         size_t remesher_iterations=15;
         ScalarType remesher_aspect_ratio=0.3;
         ScalarType remesher_termination_delta = 10000;
+        double remesher_time_limit = 0; //seconds, 0 for no limit
+        int remesher_iterations_done = 0; //output: iterations run by each remeshing pass
+        //called with the name of each step when it starts, and with an
+        //empty name when the processing is over
+        std::function<void(const std::string&)> StageCallback;
+        //progress of the steps, cancelling it stops the processing with
+        //Progress::Cancelled
+        Progress* progress = nullptr;
     };
 
     static void BatchProcess(MeshType &mesh,BatchParam &BPar,
                              typename vcg::tri::FieldSmoother<MeshType>::SmoothParam &FieldParam)
     {
+        auto stage = [&BPar](const std::string& name) {
+            if (BPar.StageCallback)
+                BPar.StageCallback(name);
+            if (BPar.progress != nullptr && !name.empty())
+                BPar.progress->report(name, 0);
+        };
+
         mesh.UpdateDataStructures();
 
         // SELECT SHARP FEATURES
+        stage("sharp_features");
         if (BPar.UpdateSharp)
             MeshPrepocess<MeshType>::InitSharpFeatures(mesh,BPar.sharp_feature_thr,BPar.feature_erode_dilate);
 
@@ -737,14 +755,18 @@ public:
         //DO REMESH IF NEEDED
         if (BPar.DoRemesh)
         {
+            stage("remesh_adapt");
             typename AutoRemesher<MeshType>::Params RemPar;
             RemPar.iterations   = BPar.remesher_iterations;
             RemPar.targetAspect = BPar.remesher_aspect_ratio;
             RemPar.targetDeltaFN= BPar.remesher_termination_delta;
             RemPar.surfDistCheck = BPar.surf_dist_check;
+            RemPar.timeLimit = BPar.remesher_time_limit;
+            RemPar.progress = BPar.progress;
 
             //AutoRemesher<MeshType>::Remesh2(mesh,RemPar);
             AutoRemesher<MeshType>::RemeshAdapt(mesh,RemPar);
+            BPar.remesher_iterations_done = RemPar.iterationsDone;
 
         }
         mesh.InitFeatureCoordsTable();
@@ -755,6 +777,7 @@ public:
 
 
         //SOLVE POSSIBLE GEOMETRIC ARTIFACTS AFTER REFINEMENT
+        stage("cleanup");
         MeshPrepocess<MeshType>::SolveGeometricArtifacts(mesh);
 
         //REFINE THE MESH IF NEEDED TO BE CONSISTENT WHEN COMPUTING FIELD
@@ -768,8 +791,12 @@ public:
         MeshFieldSmoother<MeshType>::AutoSetupParam(mesh,FieldParam,BPar.SharpFactor);
 
         //THEN SMOOTH THE FIELD
+        stage("smooth_field");
         std::cout << "[fieldComputation] Smooth Field Computation..." << std::endl;
         MeshFieldSmoother<MeshType>::SmoothField(mesh,FieldParam);
+        if (BPar.progress != nullptr)
+            BPar.progress->report("smooth_field", 1);
+        stage("");
     }
 
     static void SaveAllData(MeshType &tri_mesh,const std::string &pathM)
@@ -38,6 +38,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 //
 #include <wrap/io_trimesh/export_field.h>
 #include <wrap/io_trimesh/import_field.h>
+#include "fast_mesh_import.h"
 #include <iostream>
 #include <fstream>
 #include <vcg/complex/algorithms/attribute_seam.h>
@@ -191,6 +192,7 @@ public:
 
         if (position0!=-1)
         {
+            if (FastMeshImporter<FieldTriMesh>::OpenPLY(*this,filename))return true;
             int err=vcg::tri::io::ImporterPLY<FieldTriMesh>::Open(*this,filename.c_str());
             if (err!=vcg::ply::E_NOERROR)return false;
             return true;
@@ -279,6 +281,7 @@ public:
             else
             {
 #endif
+                if (FastMeshImporter<FieldTriMesh>::OpenOBJ(*this,filename))return true;
                 int mask;
                 vcg::tri::io::ImporterOBJ<FieldTriMesh>::LoadMask(filename.c_str(),mask);
                 int err=vcg::tri::io::ImporterOBJ<FieldTriMesh>::Open(*this,filename.c_str(),mask);
@@ -27,35 +27,53 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
 #include "assert.h"
 
-std::vector<std::vector<size_t>> loadPatches(const std::string& filename)
-{
-    std::vector<std::vector<size_t>> partitions;
+#ifdef _WIN32
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
+std::vector<int> loadFacePartition(const std::string& filename)
+{
     std::ifstream input;
     input.open(filename.c_str());
     if (!input.is_open())
     {
-        std::cout<<"ERROR LOADING PATCH FILE"<<std::endl;
-        exit(0);
+        throw std::runtime_error("error loading patch file " + filename);
     }
 
     size_t numFaces;
     input >> numFaces;
 
-    int maxPartitionId = 0;
     std::vector<int> facePartition(numFaces,-1);
 
     for (size_t i=0; i < numFaces;i++)
     {
         input >> facePartition[i];
-        maxPartitionId = std::max(facePartition[i], maxPartitionId);
     }
 
     input.close();
 
-    partitions.clear();
+    return facePartition;
+}
+
+template<class FacePartition>
+static std::vector<std::vector<size_t>> groupPartitions(const FacePartition& facePartition)
+{
+    std::vector<std::vector<size_t>> partitions;
+
+    int maxPartitionId = 0;
+    for (size_t i = 0; i < facePartition.size(); i++)
+        maxPartitionId = std::max(static_cast<int>(facePartition[i]), maxPartitionId);
+
     partitions.resize(static_cast<size_t>(maxPartitionId+1));
     for(size_t i = 0; i < facePartition.size(); i++)
     {
@@ -68,6 +86,11 @@ std::vector<std::vector<size_t>> loadPatches(const std::string& filename)
     return partitions;
 }
 
+std::vector<std::vector<size_t>> loadPatches(const std::string& filename)
+{
+    return groupPartitions(loadFacePartition(filename));
+}
+
 std::vector<std::vector<size_t>> loadCorners(const std::string& filename)
 {
     std::vector<std::vector<size_t>> corners;
@@ -76,8 +99,7 @@ std::vector<std::vector<size_t>> loadCorners(const std::string& filename)
     input.open(filename.c_str());
     if (!input.is_open())
     {
-        std::cout<<"ERROR LOADING CORNERS FILE"<<std::endl;
-        exit(0);
+        throw std::runtime_error("error loading corners file " + filename);
     }
 
     size_t numPartitions;
@@ -116,8 +138,7 @@ std::vector<std::pair<size_t,size_t> > LoadFeatures(const std::string &filename)
     f=fopen(filename.c_str(),"rt");
     if (f==NULL)
     {
-        std::cout<<"ERROR LOADING FEATURES FILE"<<std::endl;
-        exit(0);
+        throw std::runtime_error("error loading features file " + filename);
     }
 
     int numFeatures;
@@ -142,8 +163,7 @@ std::vector<size_t> loadFeatureCorners(const std::string &filename)
     f=fopen(filename.c_str(),"rt");
     if (f==NULL)
     {
-        std::cout<<"ERROR LOADING FEATURES FILE"<<std::endl;
-        exit(0);
+        throw std::runtime_error("error loading feature corners file " + filename);
     }
 
     int numFeaturesC;
@@ -160,3 +180,323 @@ std::vector<size_t> loadFeatureCorners(const std::string &filename)
 
     return featureCorners;
 }
+
+
+/* Binary patch decomposition (.pdec)
+ *
+ * header, then the sections, each starting at a multiple of 8 bytes:
+ *   int32  facePartition[numFaces]
+ *   uint64 cornerOffsets[numPartitions+1]
+ *   uint64 corners[numCorners]
+ *   uint64 features[2*numFeatures]        (face, edge)
+ *   uint64 featureCorners[numFeatureCorners]
+ * All values are in the byte order of the writer, checked with endianTag */
+
+static const char patchDecompositionMagic[8] = {'Q','W','P','A','T','C','H','\0'};
+static const uint32_t patchDecompositionVersion = 2;
+static const uint32_t patchDecompositionEndianTag = 0x01020304;
+
+struct PatchDecompositionHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint64_t numFaces;
+    uint64_t numPartitions;
+    uint64_t numCorners;
+    uint64_t numFeatures;
+    uint64_t numFeatureCorners;
+    uint64_t payloadSize;
+    uint64_t checksum;
+    //the .patch file written along with it, to tell whether it is up to date
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+};
+static_assert(sizeof(PatchDecompositionHeader) % 8 == 0, "sections must stay aligned");
+
+static uint64_t alignedSize(const uint64_t size)
+{
+    return (size + 7) / 8 * 8;
+}
+
+//FNV-1a on 64 bit words
+static uint64_t payloadChecksum(const char* data, const uint64_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(data);
+    for (uint64_t i = 0; i < size / 8; i++) {
+        hash ^= words[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+//FNV-1a on the bytes of a file, false if it cannot be read
+static bool fileHash(const std::string& filename, uint64_t& size, uint64_t& hash)
+{
+    std::ifstream input(filename, std::ios::binary);
+    if (!input.is_open())
+        return false;
+
+    size = 0;
+    hash = 14695981039346656037ull;
+    std::vector<char> buffer(1 << 16);
+    while (input) {
+        input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        const std::streamsize n = input.gcount();
+        for (std::streamsize i = 0; i < n; i++) {
+            hash ^= static_cast<unsigned char>(buffer[i]);
+            hash *= 1099511628211ull;
+        }
+        size += static_cast<uint64_t>(n);
+    }
+    return input.eof();
+}
+
+struct PatchDecompositionLayout {
+    uint64_t facePartition;
+    uint64_t cornerOffsets;
+    uint64_t corners;
+    uint64_t features;
+    uint64_t featureCorners;
+    uint64_t size;
+};
+
+static PatchDecompositionLayout patchDecompositionLayout(const PatchDecompositionHeader& header)
+{
+    PatchDecompositionLayout layout;
+    layout.facePartition = 0;
+    layout.cornerOffsets = layout.facePartition + alignedSize(header.numFaces * sizeof(int32_t));
+    layout.corners = layout.cornerOffsets + (header.numPartitions + 1) * sizeof(uint64_t);
+    layout.features = layout.corners + header.numCorners * sizeof(uint64_t);
+    layout.featureCorners = layout.features + 2 * header.numFeatures * sizeof(uint64_t);
+    layout.size = layout.featureCorners + header.numFeatureCorners * sizeof(uint64_t);
+    return layout;
+}
+
+void savePatchDecomposition(
+        const std::string& filename,
+        const std::vector<int>& facePartition,
+        const std::vector<std::vector<size_t>>& corners,
+        const std::vector<std::pair<size_t,size_t>>& features,
+        const std::vector<size_t>& featureCorners,
+        const std::string& sourceFilename)
+{
+    PatchDecompositionHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, patchDecompositionMagic, sizeof(header.magic));
+    header.version = patchDecompositionVersion;
+    header.endianTag = patchDecompositionEndianTag;
+    header.numFaces = facePartition.size();
+    header.numPartitions = corners.size();
+    for (const std::vector<size_t>& partitionCorners : corners)
+        header.numCorners += partitionCorners.size();
+    header.numFeatures = features.size();
+    header.numFeatureCorners = featureCorners.size();
+    if (!sourceFilename.empty() && !fileHash(sourceFilename, header.sourceSize, header.sourceHash)) {
+        throw std::runtime_error("error reading " + sourceFilename);
+    }
+
+    const PatchDecompositionLayout layout = patchDecompositionLayout(header);
+    header.payloadSize = layout.size;
+
+    std::vector<char> payload(layout.size, 0);
+    int32_t* facePartitionData = reinterpret_cast<int32_t*>(payload.data() + layout.facePartition);
+    for (size_t i = 0; i < facePartition.size(); i++)
+        facePartitionData[i] = static_cast<int32_t>(facePartition[i]);
+
+    uint64_t* cornerOffsetsData = reinterpret_cast<uint64_t*>(payload.data() + layout.cornerOffsets);
+    uint64_t* cornersData = reinterpret_cast<uint64_t*>(payload.data() + layout.corners);
+    uint64_t offset = 0;
+    for (size_t i = 0; i < corners.size(); i++) {
+        cornerOffsetsData[i] = offset;
+        for (const size_t& corner : corners[i])
+            cornersData[offset++] = corner;
+    }
+    cornerOffsetsData[corners.size()] = offset;
+
+    uint64_t* featuresData = reinterpret_cast<uint64_t*>(payload.data() + layout.features);
+    for (size_t i = 0; i < features.size(); i++) {
+        featuresData[2 * i] = features[i].first;
+        featuresData[2 * i + 1] = features[i].second;
+    }
+
+    uint64_t* featureCornersData = reinterpret_cast<uint64_t*>(payload.data() + layout.featureCorners);
+    for (size_t i = 0; i < featureCorners.size(); i++)
+        featureCornersData[i] = featureCorners[i];
+
+    header.checksum = payloadChecksum(payload.data(), payload.size());
+
+    //write to a temporary file, so that a reader never sees a partial file
+    const std::string tmpFilename = filename + ".tmp";
+    std::ofstream output(tmpFilename, std::ios::binary);
+    if (!output.is_open()) {
+        throw std::runtime_error("error saving patch decomposition " + filename);
+    }
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    output.close();
+    if (!output || std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        std::remove(tmpFilename.c_str());
+        throw std::runtime_error("error saving patch decomposition " + filename);
+    }
+}
+
+void savePatchDecomposition(
+        const std::string& filename,
+        const std::vector<std::vector<size_t>>& partitions,
+        const std::vector<std::vector<size_t>>& corners,
+        const std::vector<std::pair<size_t,size_t>>& features,
+        const std::vector<size_t>& featureCorners,
+        const std::string& sourceFilename)
+{
+    size_t numFaces = 0;
+    for (const std::vector<size_t>& partition : partitions)
+        for (const size_t& face : partition)
+            numFaces = std::max(numFaces, face + 1);
+
+    std::vector<int> facePartition(numFaces, -1);
+    for (size_t i = 0; i < partitions.size(); i++)
+        for (const size_t& face : partitions[i])
+            facePartition[face] = static_cast<int>(i);
+
+    savePatchDecomposition(filename, facePartition, corners, features, featureCorners, sourceFilename);
+}
+
+bool isPatchDecompositionCurrent(const std::string& filename, const std::string& sourceFilename)
+{
+    PatchDecompositionHeader header;
+    std::ifstream input(filename, std::ios::binary);
+    if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    if (std::memcmp(header.magic, patchDecompositionMagic, sizeof(header.magic)) != 0 ||
+            header.endianTag != patchDecompositionEndianTag ||
+            header.version != patchDecompositionVersion)
+        return false;
+
+    uint64_t sourceSize, sourceHash;
+    if (!fileHash(sourceFilename, sourceSize, sourceHash))
+        return false;
+    return sourceSize == header.sourceSize && sourceHash == header.sourceHash;
+}
+
+PatchDecompositionFile::PatchDecompositionFile(const std::string& filename, const bool verifyChecksum) :
+    data(nullptr),
+    size(0)
+{
+#ifdef _WIN32
+    std::ifstream input(filename, std::ios::binary | std::ios::ate);
+    if (!input.is_open()) {
+        throw std::runtime_error("error loading patch decomposition " + filename);
+    }
+    size = static_cast<size_t>(input.tellg());
+    buffer.resize((size + 7) / 8);
+    input.seekg(0);
+    input.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(size));
+    data = reinterpret_cast<const char*>(buffer.data());
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("error loading patch decomposition " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(PatchDecompositionHeader))) {
+        close(fd);
+        throw std::runtime_error("invalid patch decomposition " + filename);
+    }
+    size = static_cast<size_t>(st.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("error mapping patch decomposition " + filename);
+    }
+    data = static_cast<const char*>(mapped);
+#endif
+
+    try {
+        if (size < sizeof(PatchDecompositionHeader))
+            throw std::runtime_error("truncated header");
+
+        const PatchDecompositionHeader& header = *reinterpret_cast<const PatchDecompositionHeader*>(data);
+        if (std::memcmp(header.magic, patchDecompositionMagic, sizeof(header.magic)) != 0)
+            throw std::runtime_error("not a patch decomposition");
+        if (header.endianTag != patchDecompositionEndianTag)
+            throw std::runtime_error("written with a different byte order");
+        if (header.version != patchDecompositionVersion)
+            throw std::runtime_error("unsupported version " + std::to_string(header.version));
+
+        const PatchDecompositionLayout layout = patchDecompositionLayout(header);
+        if (header.payloadSize != layout.size || size != sizeof(PatchDecompositionHeader) + layout.size)
+            throw std::runtime_error("inconsistent size");
+
+        const char* payload = data + sizeof(PatchDecompositionHeader);
+        if (verifyChecksum && payloadChecksum(payload, layout.size) != header.checksum)
+            throw std::runtime_error("checksum mismatch");
+
+        facePartitionView = std::span<const int32_t>(reinterpret_cast<const int32_t*>(payload + layout.facePartition), header.numFaces);
+        cornerOffsetsView = std::span<const uint64_t>(reinterpret_cast<const uint64_t*>(payload + layout.cornerOffsets), header.numPartitions + 1);
+        cornersView = std::span<const uint64_t>(reinterpret_cast<const uint64_t*>(payload + layout.corners), header.numCorners);
+        featuresView = std::span<const uint64_t>(reinterpret_cast<const uint64_t*>(payload + layout.features), 2 * header.numFeatures);
+        featureCornersView = std::span<const uint64_t>(reinterpret_cast<const uint64_t*>(payload + layout.featureCorners), header.numFeatureCorners);
+
+        if (cornerOffsetsView.front() != 0 || cornerOffsetsView.back() != header.numCorners)
+            throw std::runtime_error("invalid corner offsets");
+        for (size_t i = 0; i < header.numPartitions; i++) {
+            if (cornerOffsetsView[i] > cornerOffsetsView[i + 1])
+                throw std::runtime_error("invalid corner offsets");
+        }
+        for (const int32_t& partition : facePartitionView) {
+            if (partition < 0)
+                throw std::runtime_error("face without partition");
+        }
+    }
+    catch (std::runtime_error& e) {
+        release();
+        throw std::runtime_error("invalid patch decomposition " + filename + ": " + e.what());
+    }
+}
+
+PatchDecompositionFile::~PatchDecompositionFile()
+{
+    release();
+}
+
+void PatchDecompositionFile::release()
+{
+#ifndef _WIN32
+    if (data != nullptr)
+        munmap(const_cast<char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+std::span<const uint64_t> PatchDecompositionFile::corners(const size_t partition) const
+{
+    return cornersView.subspan(cornerOffsetsView[partition], cornerOffsetsView[partition + 1] - cornerOffsetsView[partition]);
+}
+
+void loadPatchDecomposition(
+        const std::string& filename,
+        std::vector<std::vector<size_t>>& partitions,
+        std::vector<std::vector<size_t>>& corners,
+        std::vector<std::pair<size_t,size_t>>& features,
+        std::vector<size_t>& featureCorners)
+{
+    PatchDecompositionFile file(filename);
+
+    partitions = groupPartitions(file.facePartition());
+
+    corners.resize(file.numPartitions());
+    for (size_t i = 0; i < file.numPartitions(); i++) {
+        std::span<const uint64_t> partitionCorners = file.corners(i);
+        corners[i].assign(partitionCorners.begin(), partitionCorners.end());
+    }
+
+    std::span<const uint64_t> featuresView = file.features();
+    features.resize(featuresView.size() / 2);
+    for (size_t i = 0; i < features.size(); i++)
+        features[i] = std::make_pair(featuresView[2 * i], featuresView[2 * i + 1]);
+
+    std::span<const uint64_t> featureCornersView = file.featureCorners();
+    featureCorners.assign(featureCornersView.begin(), featureCornersView.end());
+}
@@ -26,11 +26,77 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef LOAD_SAVE_H
 #define LOAD_SAVE_H
 
+#include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
+std::vector<int> loadFacePartition(const std::string& filename);
 std::vector<std::vector<size_t>> loadPatches(const std::string& filename);
 std::vector<std::vector<size_t>> loadCorners(const std::string& filename);
 std::vector<std::pair<size_t,size_t>> LoadFeatures(const std::string &filename);
 std::vector<size_t> loadFeatureCorners(const std::string& filename);
 
+//Binary container (.pdec) of the patch decomposition: the partition of each
+//face, the corners of each partition, the feature edges and the feature
+//corners, versioned and checksummed. It is memory mapped and read in place
+class PatchDecompositionFile {
+public:
+    //throws std::runtime_error if the file is missing or invalid
+    explicit PatchDecompositionFile(const std::string& filename, const bool verifyChecksum = true);
+    ~PatchDecompositionFile();
+    PatchDecompositionFile(const PatchDecompositionFile&) = delete;
+    PatchDecompositionFile& operator=(const PatchDecompositionFile&) = delete;
+
+    std::span<const int32_t> facePartition() const { return facePartitionView; }
+    size_t numPartitions() const { return cornerOffsetsView.size() - 1; }
+    std::span<const uint64_t> corners(const size_t partition) const;
+    std::span<const uint64_t> features() const { return featuresView; } //face, edge pairs
+    std::span<const uint64_t> featureCorners() const { return featureCornersView; }
+
+private:
+    void release();
+
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    std::vector<uint64_t> buffer;
+#endif
+    std::span<const int32_t> facePartitionView;
+    std::span<const uint64_t> cornerOffsetsView;
+    std::span<const uint64_t> cornersView;
+    std::span<const uint64_t> featuresView;
+    std::span<const uint64_t> featureCornersView;
+};
+
+//the size and hash of sourceFilename, the .patch file of the same decomposition
+//if given, are recorded to tell later whether the .pdec is up to date
+void savePatchDecomposition(
+        const std::string& filename,
+        const std::vector<int>& facePartition,
+        const std::vector<std::vector<size_t>>& corners,
+        const std::vector<std::pair<size_t,size_t>>& features,
+        const std::vector<size_t>& featureCorners,
+        const std::string& sourceFilename = std::string());
+
+//same, with the faces of each partition as loadPatches returns them
+void savePatchDecomposition(
+        const std::string& filename,
+        const std::vector<std::vector<size_t>>& partitions,
+        const std::vector<std::vector<size_t>>& corners,
+        const std::vector<std::pair<size_t,size_t>>& features,
+        const std::vector<size_t>& featureCorners,
+        const std::string& sourceFilename = std::string());
+
+//same output as loadPatches, loadCorners, LoadFeatures and loadFeatureCorners
+void loadPatchDecomposition(
+        const std::string& filename,
+        std::vector<std::vector<size_t>>& partitions,
+        std::vector<std::vector<size_t>>& corners,
+        std::vector<std::pair<size_t,size_t>>& features,
+        std::vector<size_t>& featureCorners);
+
+//true if the .pdec is valid and was written with sourceFilename as it is now
+//(same size and hash); false if sourceFilename cannot be read
+bool isPatchDecompositionCurrent(const std::string& filename, const std::string& sourceFilename);
+
 #endif // LOAD_SAVE_H
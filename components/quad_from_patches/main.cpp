@@ -39,6 +39,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "smooth_mesh.h"
 #include "quad_from_patches.h"
+#include <scheduler.h>
 //#include "quad_mesh_tracer.h"
 
 #include <clocale>
@@ -76,6 +77,8 @@ int actual_main(int argc, char *argv[])
     // any signs of a an application crash!
     SetErrorMode(0);
 #endif
+    Scheduler::parseOptions(argc, argv);
+
     HSW sw_root("main");
     HSW sw_load("load", sw_root);
     HSW sw_smooth("smooth", sw_root);
@@ -119,6 +122,7 @@ int actual_main(int argc, char *argv[])
     if(argc<2 || argc > 5)
     {
         std::cerr << "usage: " << argv[0] << " <input.obj> [num] [setup.txt] [out_stats.json]"
+                     " [--threads N] [--stage-threads <stage>=N[,<stage>=N...]]"
                   << std::endl;
         exit(1);
     }
@@ -27,6 +27,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <quadretopology/quadretopology.h>
 #include <quadretopology/qr_eval_quantization.h>
 #include <random>
+#include <stdexcept>
 
 #ifdef SAVE_MESHES_FOR_DEBUG
 #include <igl/writeOBJ.h>
@@ -58,12 +59,20 @@ quadrangulationFromPatches(
     std::vector<Satsuma::BiMDFFullResult> bimdf_results; // empty if ILP was used
     std::vector<QuadRetopology::FlowStats> flow_stats;
     std::vector<std::vector<QuadRetopology::ILPStats>> ilp_stats_per_cluster;
+    bool ilpTimeLimitReached = false;
+    bool flowResolveSkipped = false;
 
     sw_root.resume();
     std::vector<Timekeeper::HierarchicalStopWatchResult> sw_results;
 
     assert(trimeshPartitions.size() == trimeshCorners.size() && chartEdgeLength.size() == trimeshPartitions.size());
 
+    auto progress = [&parameters](const std::string& stage, const double fraction) {
+        if (parameters.progressCallback && !parameters.progressCallback(stage, fraction)) {
+            throw std::runtime_error("quadrangulation cancelled");
+        }
+    };
+    progress("compute_chart_data", 0);
 
     //Get chart data
     sw_compute_chart_data.resume();
@@ -195,6 +204,43 @@ quadrangulationFromPatches(
         if (numClusters > 1) {
             std::cout << "Patches clustered in: " << numClusters << " clusters." << std::endl;
 
+            //With the flow solver, the cluster boundaries are taken from a coarse solve of
+            //the whole chart graph at twice the edge length, instead of rounding each subside
+            //on its own: the doubled values are even and consistent across the clusters.
+            //The coarse network is as big as the full one, it does not bound the memory
+            std::vector<int> coarseResult;
+            if (parameters.useFlowSolver) {
+                QuadRetopology::Parameters coarseParameters = parameters;
+                coarseParameters.repeatLosingConstraintsQuads = false;
+                coarseParameters.repeatLosingConstraintsNonQuads = false;
+                coarseParameters.repeatLosingConstraintsAlign = false;
+
+                std::vector<double> coarseEdgeLength(chartEdgeLength.size());
+                for (size_t cId = 0; cId < chartEdgeLength.size(); ++cId) {
+                    coarseEdgeLength[cId] = 2.0 * chartEdgeLength[cId];
+                }
+
+                progress("find_subdivisions", 0);
+                //the subsides already fixed keep their value, at the coarse resolution
+                coarseResult.resize(chartData.subsides.size());
+                for (size_t subsideId = 0; subsideId < chartData.subsides.size(); subsideId++) {
+                    coarseResult[subsideId] = ilpResult[subsideId] >= 0 ?
+                                std::max(MIN_SUBDIVISION_VALUE, (ilpResult[subsideId] + 1) / 2) :
+                                ilpResult[subsideId];
+                }
+                double gap;
+                auto subdiv_res = QuadRetopology::findSubdivisions(
+                    chartData,
+                    coarseEdgeLength,
+                    coarseParameters,
+                    gap,
+                    coarseResult);
+                subdiv_res.stopwatch.name = "coarse_" + subdiv_res.stopwatch.name;
+                sw_results.push_back(std::move(subdiv_res.stopwatch));
+                ilpTimeLimitReached = ilpTimeLimitReached || subdiv_res.ilpTimeLimitReached;
+                flowResolveSkipped = flowResolveSkipped || subdiv_res.flowResolveSkipped;
+            }
+
             int numFixed = 0;
 
             std::vector<bool> subsideAlreadyFixed(chartData.subsides.size(), false);
@@ -208,7 +254,17 @@ quadrangulationFromPatches(
                         chartCluster[incidentCharts[0]] != chartCluster[incidentCharts[1]]
                 )
                 {
-                    if (!subsideAlreadyFixed[subsideId])
+                    if (!subsideAlreadyFixed[subsideId] && !coarseResult.empty())
+                    {
+                        if (ilpResult[subsideId] < 0) {
+                            ilpResult[subsideId] = std::max(MIN_SUBDIVISION_VALUE*2, 2 * coarseResult[subsideId]);
+                        }
+
+                        numFixed++;
+
+                        subsideAlreadyFixed[subsideId] = true;
+                    }
+                    else if (!subsideAlreadyFixed[subsideId])
                     {
                         double edgeLength = 0.0;
                         int numIncident = 0;
@@ -243,51 +299,77 @@ quadrangulationFromPatches(
             std::cout << "Fixed " << numFixed << " / " << chartData.subsides.size() << " subsides." << std::endl;
 
 
+            if (parameters.useFlowSolver) {
+                //The flow solver splits the problem at the fixed subsides by itself,
+                //each cluster gets its own network and they are solved concurrently
+                QuadRetopology::Parameters clusterParameters = parameters;
+                clusterParameters.flowParallelComponents = true;
+                clusterParameters.flowMinComponentCharts = 1;
+
+                solvedCluster = true;
+                progress("find_subdivisions", 0);
+                double gap;
+                auto subdiv_res = QuadRetopology::findSubdivisions(
+                    chartData,
+                    chartEdgeLength,
+                    clusterParameters,
+                    gap,
+                    ilpResult);
+                bimdf_results = std::move(subdiv_res.bimdf_results);
+                flow_stats = std::move(subdiv_res.flow_stats);
+                sw_results.push_back(std::move(subdiv_res.stopwatch));
+                ilpTimeLimitReached = ilpTimeLimitReached || subdiv_res.ilpTimeLimitReached;
+                flowResolveSkipped = flowResolveSkipped || subdiv_res.flowResolveSkipped;
+            }
+            else {
+                for (int clusterId = 0; clusterId < lastClusterId; ++clusterId) {
+                    progress("find_subdivisions", static_cast<double>(clusterId) / lastClusterId);
+                    int numInCluster = 0;
 
-            for (int clusterId = 0; clusterId < lastClusterId; ++clusterId) {
-                int numInCluster = 0;
-
-                std::vector<int> result(chartData.subsides.size(), ILP_IGNORE);
-                for (size_t subsideId = 0; subsideId < chartData.subsides.size(); subsideId++) {
-                    if (ilpResult[subsideId] >= 0) {
-                        result[subsideId] = ilpResult[subsideId];
+                    std::vector<int> result(chartData.subsides.size(), ILP_IGNORE);
+                    for (size_t subsideId = 0; subsideId < chartData.subsides.size(); subsideId++) {
+                        if (ilpResult[subsideId] >= 0) {
+                            result[subsideId] = ilpResult[subsideId];
+                        }
                     }
-                }
 
-                for (size_t cId = 0; cId < chartData.charts.size(); ++cId) {
-                    if (chartCluster[cId] == clusterId) {
-                        numInCluster++;
+                    for (size_t cId = 0; cId < chartData.charts.size(); ++cId) {
+                        if (chartCluster[cId] == clusterId) {
+                            numInCluster++;
+                        }
                     }
-                }
 
-                if (numInCluster > 0) {
-                    solvedCluster = true;
-                    for (size_t subsideId = 0; subsideId < chartData.subsides.size(); subsideId++) {
-                        std::array<int, 2> incidentCharts = chartData.subsides[subsideId].incidentCharts;
+                    if (numInCluster > 0) {
+                        solvedCluster = true;
+                        for (size_t subsideId = 0; subsideId < chartData.subsides.size(); subsideId++) {
+                            std::array<int, 2> incidentCharts = chartData.subsides[subsideId].incidentCharts;
 
-                        if ((incidentCharts[0] == -1 || chartCluster[incidentCharts[0]] == clusterId) && (incidentCharts[1] == -1 || chartCluster[incidentCharts[1]] == clusterId)) {
-                            result[subsideId] = ILP_FIND_SUBDIVISION;
+                            if ((incidentCharts[0] == -1 || chartCluster[incidentCharts[0]] == clusterId) && (incidentCharts[1] == -1 || chartCluster[incidentCharts[1]] == clusterId)) {
+                                result[subsideId] = ILP_FIND_SUBDIVISION;
+                            }
                         }
-                    }
 
-                    double gap;
-                    {
-                      auto subdiv_res = QuadRetopology::findSubdivisions(
-                          chartData,
-                          chartEdgeLength,
-                          parameters,
-                          gap,
-                          result);
-                      sw_results.push_back(std::move(subdiv_res.stopwatch));
-                      assert(subdiv_res.bimdf_results.empty()); // Flow does not work on clusters
-                      if (!subdiv_res.ilp_stats.empty()) {
-                          ilp_stats_per_cluster.push_back(std::move(subdiv_res.ilp_stats));
-                      }
-                    }
+                        double gap;
+                        {
+                          auto subdiv_res = QuadRetopology::findSubdivisions(
+                              chartData,
+                              chartEdgeLength,
+                              parameters,
+                              gap,
+                              result);
+                          sw_results.push_back(std::move(subdiv_res.stopwatch));
+                          ilpTimeLimitReached = ilpTimeLimitReached || subdiv_res.ilpTimeLimitReached;
+                          flowResolveSkipped = flowResolveSkipped || subdiv_res.flowResolveSkipped;
+                          assert(subdiv_res.bimdf_results.empty()); // Flow solves all the clusters at once
+                          if (!subdiv_res.ilp_stats.empty()) {
+                              ilp_stats_per_cluster.push_back(std::move(subdiv_res.ilp_stats));
+                          }
+                        }
 
-                    for (size_t subsideId = 0; subsideId < chartData.subsides.size(); subsideId++) {
-                        if (result[subsideId] != ILP_IGNORE && ilpResult[subsideId] == ILP_FIND_SUBDIVISION) {
-                            ilpResult[subsideId] = result[subsideId];
+                        for (size_t subsideId = 0; subsideId < chartData.subsides.size(); subsideId++) {
+                            if (result[subsideId] != ILP_IGNORE && ilpResult[subsideId] == ILP_FIND_SUBDIVISION) {
+                                ilpResult[subsideId] = result[subsideId];
+                            }
                         }
                     }
                 }
@@ -296,6 +378,7 @@ quadrangulationFromPatches(
     }
 
     if (!solvedCluster) {
+        progress("find_subdivisions", 0);
         //Solve ILP to find best side size
         double gap;
         {
@@ -312,6 +395,8 @@ quadrangulationFromPatches(
           }
 
           sw_results.push_back(std::move(subdiv_res.stopwatch));
+          ilpTimeLimitReached = ilpTimeLimitReached || subdiv_res.ilpTimeLimitReached;
+          flowResolveSkipped = flowResolveSkipped || subdiv_res.flowResolveSkipped;
         }
     }
 
@@ -319,6 +404,7 @@ quadrangulationFromPatches(
     std::cout << "quantisation evaluation results: \n " << quant_eval << std::endl;
 
     //Quadrangulate
+    progress("quadrangulate_charts", 0);
     std::vector<size_t> fixedPositionSubsides;
     std::vector<int> quadmeshLabel;
     {
@@ -344,6 +430,8 @@ quadrangulationFromPatches(
         .flow_stats = std::move(flow_stats),
         .ilp_stats_per_cluster = std::move(ilp_stats_per_cluster),
         .eval = std::move(quant_eval),
+        .ilpTimeLimitReached = ilpTimeLimitReached,
+        .flowResolveSkipped = flowResolveSkipped,
         .stopwatch = sw_result};
 }
 
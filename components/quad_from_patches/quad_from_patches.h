@@ -36,6 +36,8 @@ struct QuadrangulationResult {
     std::vector<QuadRetopology::FlowStats> flow_stats;
     std::vector<std::vector<QuadRetopology::ILPStats>> ilp_stats_per_cluster;
     QuadRetopology::QuantizationEvaluation eval;
+    bool ilpTimeLimitReached = false; // an ILP optimization stopped at parameters.timeLimit
+    bool flowResolveSkipped = false; // a flow resolve did not fit in parameters.flowTimeLimit
     Timekeeper::HierarchicalStopWatchResult stopwatch;
 };
 
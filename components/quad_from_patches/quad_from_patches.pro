@@ -51,6 +51,9 @@ INCLUDEPATH += $$VCGLIB_PATH
 #Eigen
 INCLUDEPATH += $$EIGEN_PATH
 
+#Threading
+INCLUDEPATH += ../threading
+
 #Boost
 INCLUDEPATH += $$BOOST_PATH
 
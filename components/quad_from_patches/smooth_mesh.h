@@ -27,12 +27,16 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define SMOOTH_MESH_H
 
 #include <vector>
+#include <array>
+#include <chrono>
+#include <progress.h>
 #include <vcg/complex/algorithms/polygonal_algorithms.h>
 #include <wrap/io_trimesh/export.h>
 #include <vcg/complex/algorithms/implicit_smooth.h>
 #include "local_para_smooth.h"
 #include <vcg/space/distance3.h>
 #include <vcg/space/index/grid_static_ptr.h>
+#include <vcg/space/index/grid_util.h>
 //#include "field_smoother.h"
 
 ///* ----- Triangle mesh ----- */
@@ -118,6 +122,232 @@ void ClosestPointEMesh(const typename BasicMesh::CoordType &Pos,
     }
 }
 
+//uniform grid over the edges of the feature mesh, each edge is stored
+//in all the cells overlapped by its bounding box
+class EdgeMeshGrid
+{
+    typedef BasicMesh::ScalarType ScalarType;
+    typedef BasicMesh::CoordType CoordType;
+
+    vcg::Box3<ScalarType> GridBox;
+    vcg::Point3i Dim;
+    CoordType CellSize;
+    //CSR storage of the edges per cell
+    std::vector<size_t> CellStart;
+    std::vector<size_t> CellEdges;
+
+    vcg::Point3i PointCell(const CoordType &Pos) const
+    {
+        vcg::Point3i Cell;
+        for (int k=0;k<3;k++)
+        {
+            int IndexC=(int)std::floor((Pos[k]-GridBox.min[k])/CellSize[k]);
+            Cell[k]=std::max(0,std::min(IndexC,Dim[k]-1));
+        }
+        return Cell;
+    }
+
+    size_t CellIndex(const int x,const int y,const int z) const
+    {
+        return ((size_t)z*Dim[1]+y)*Dim[0]+x;
+    }
+
+public:
+
+    void Set(const BasicMesh &EdgeMesh)
+    {
+        GridBox.SetNull();
+        CellStart.clear();
+        CellEdges.clear();
+        if (EdgeMesh.edge.size()==0)return;
+
+        for (size_t i=0;i<EdgeMesh.edge.size();i++)
+        {
+            GridBox.Add(EdgeMesh.edge[i].cP(0));
+            GridBox.Add(EdgeMesh.edge[i].cP(1));
+        }
+        ScalarType Eps=std::max(GridBox.Diag()*(ScalarType)0.01,std::numeric_limits<ScalarType>::epsilon());
+        GridBox.Offset(Eps);
+
+        vcg::BestDim((int64_t)EdgeMesh.edge.size(),GridBox.Dim(),Dim);
+        for (int k=0;k<3;k++)
+        {
+            Dim[k]=std::max(Dim[k],1);
+            CellSize[k]=GridBox.Dim()[k]/Dim[k];
+        }
+
+        //each edge is enlarged a bit to be robust to rounding at cell boundaries
+        std::vector<std::pair<vcg::Point3i,vcg::Point3i> > EdgeCells(EdgeMesh.edge.size());
+        CellStart.resize((size_t)Dim[0]*Dim[1]*Dim[2]+1,0);
+        for (size_t i=0;i<EdgeMesh.edge.size();i++)
+        {
+            vcg::Box3<ScalarType> EdgeBox;
+            EdgeBox.Add(EdgeMesh.edge[i].cP(0));
+            EdgeBox.Add(EdgeMesh.edge[i].cP(1));
+            EdgeBox.Offset(Eps*(ScalarType)0.01);
+            EdgeCells[i].first=PointCell(EdgeBox.min);
+            EdgeCells[i].second=PointCell(EdgeBox.max);
+            for (int z=EdgeCells[i].first[2];z<=EdgeCells[i].second[2];z++)
+                for (int y=EdgeCells[i].first[1];y<=EdgeCells[i].second[1];y++)
+                    for (int x=EdgeCells[i].first[0];x<=EdgeCells[i].second[0];x++)
+                        CellStart[CellIndex(x,y,z)+1]++;
+        }
+        for (size_t i=1;i<CellStart.size();i++)
+            CellStart[i]+=CellStart[i-1];
+
+        CellEdges.resize(CellStart.back());
+        std::vector<size_t> CellFill(CellStart.begin(),CellStart.end()-1);
+        for (size_t i=0;i<EdgeMesh.edge.size();i++)
+            for (int z=EdgeCells[i].first[2];z<=EdgeCells[i].second[2];z++)
+                for (int y=EdgeCells[i].first[1];y<=EdgeCells[i].second[1];y++)
+                    for (int x=EdgeCells[i].first[0];x<=EdgeCells[i].second[0];x++)
+                        CellEdges[CellFill[CellIndex(x,y,z)]++]=i;
+    }
+
+    bool IsEmpty()const{return CellEdges.empty();}
+
+    //visit the cells in shells of growing size around the query point, stopping
+    //when the unvisited cells are farther than the closest edge found so far;
+    //it returns the same edge of the linear scan (on ties the highest index)
+    void Closest(const CoordType &Pos,
+                 const BasicMesh &EdgeMesh,
+                 size_t &IndexE,
+                 ScalarType &t,
+                 ScalarType &MinD,
+                 CoordType &Clos)const
+    {
+        MinD=std::numeric_limits<ScalarType>::max();
+        if (IsEmpty())return;
+
+        vcg::Point3i Center=PointCell(Pos);
+        bool Found=false;
+        for (int Ring=0;;Ring++)
+        {
+            vcg::Point3i Min,Max;
+            for (int k=0;k<3;k++)
+            {
+                Min[k]=std::max(Center[k]-Ring,0);
+                Max[k]=std::min(Center[k]+Ring,Dim[k]-1);
+            }
+
+            for (int z=Min[2];z<=Max[2];z++)
+                for (int y=Min[1];y<=Max[1];y++)
+                    for (int x=Min[0];x<=Max[0];x++)
+                    {
+                        //only the cells of the current shell
+                        if ((std::abs(x-Center[0])!=Ring)&&
+                            (std::abs(y-Center[1])!=Ring)&&
+                            (std::abs(z-Center[2])!=Ring))continue;
+
+                        size_t IndexC=CellIndex(x,y,z);
+                        for (size_t j=CellStart[IndexC];j<CellStart[IndexC+1];j++)
+                        {
+                            size_t IndexTest=CellEdges[j];
+                            CoordType P0=EdgeMesh.edge[IndexTest].V(0)->P();
+                            CoordType P1=EdgeMesh.edge[IndexTest].V(1)->P();
+                            vcg::Segment3<ScalarType> STest(P0,P1);
+                            ScalarType testD;
+                            CoordType ClosTest;
+                            vcg::SegmentPointDistance(STest,Pos,ClosTest,testD);
+                            if (testD>MinD)continue;
+                            if ((testD==MinD)&&(IndexTest<IndexE))continue;
+                            Clos=ClosTest;
+                            MinD=testD;
+                            IndexE=IndexTest;
+                            t=1-(Clos-P0).Norm()/(P1-P0).Norm();
+                            Found=true;
+                        }
+                    }
+
+            //lower bound of the distance of the cells out of the visited block
+            bool HasOutside=false;
+            ScalarType OutsideD=std::numeric_limits<ScalarType>::max();
+            for (int k=0;k<3;k++)
+            {
+                if (Min[k]>0)
+                {
+                    HasOutside=true;
+                    ScalarType LowBound=GridBox.min[k]+Min[k]*CellSize[k];
+                    OutsideD=std::min(OutsideD,std::max(Pos[k]-LowBound,(ScalarType)0));
+                }
+                if (Max[k]<Dim[k]-1)
+                {
+                    HasOutside=true;
+                    ScalarType UpBound=GridBox.min[k]+(Max[k]+1)*CellSize[k];
+                    OutsideD=std::min(OutsideD,std::max(UpBound-Pos[k],(ScalarType)0));
+                }
+            }
+            if (!HasOutside)break;
+            if (Found && (OutsideD>MinD))break;
+        }
+    }
+};
+
+//same as ClosestPointEMesh, but using the grid
+inline void ClosestPointEMesh(const typename BasicMesh::CoordType &Pos,
+                              const BasicMesh &EdgeMesh,
+                              const EdgeMeshGrid &EdgeGrid,
+                              size_t &IndexE,
+                              typename BasicMesh::ScalarType &t,
+                              typename BasicMesh::ScalarType &MinD,
+                              typename BasicMesh::CoordType &Clos)
+{
+    EdgeGrid.Closest(Pos,EdgeMesh,IndexE,t,MinD,Clos);
+}
+
+//face marker that keeps its own marks instead of the ones stored in the mesh,
+//so that many closest point queries can run at the same time on the same grid
+template <class MeshType>
+class LocalFaceMarker
+{
+    typedef typename MeshType::FaceType FaceType;
+
+    const MeshType *m=NULL;
+    std::vector<unsigned int> Marks;
+    unsigned int CurrMark=0;
+
+public:
+
+    void SetMesh(const MeshType *_m)
+    {
+        m=_m;
+        Marks.assign(m->face.size(),0);
+        CurrMark=0;
+    }
+
+    void UnMarkAll()
+    {
+        CurrMark++;
+        if (CurrMark==0)
+        {
+            std::fill(Marks.begin(),Marks.end(),0);
+            CurrMark=1;
+        }
+    }
+
+    bool IsMarked(const FaceType *f)const
+    {return (Marks[vcg::tri::Index(*m,f)]==CurrMark);}
+
+    void Mark(const FaceType *f)
+    {Marks[vcg::tri::Index(*m,f)]=CurrMark;}
+};
+
+//same as vcg::tri::GetClosestFaceBase, but with a local marker
+template <class MeshType,class GridType>
+typename MeshType::FaceType *GetClosestFaceLocal(MeshType &mesh,
+                                                 GridType &grid,
+                                                 const typename GridType::CoordType &Pos,
+                                                 const typename GridType::ScalarType MaxD,
+                                                 typename GridType::ScalarType &MinD,
+                                                 typename GridType::CoordType &closestPt,
+                                                 LocalFaceMarker<MeshType> &Marker)
+{
+    (void)mesh;
+    vcg::face::PointDistanceBaseFunctor<typename GridType::ScalarType> PDistFunct;
+    MinD=MaxD;
+    return (grid.GetClosest(PDistFunct,Marker,Pos,MaxD,MinD,closestPt));
+}
+
 //enum VType{Internal,Feature,Corner};
 
 
@@ -465,6 +695,7 @@ void ProjectStepPositions(PolyMeshType &PolyM,TriMeshType &TriM,
 
 template <class PolyMeshType,class TriMeshType>
 void GetProjectionBasis(const BasicMesh &edge_mesh,
+                        const EdgeMeshGrid &edge_grid,
                         TriMeshType &tri_mesh,
                         const std::vector<std::pair<size_t,size_t> > &FeatureTris,
                         const std::vector<size_t> &FeatureTrisC,
@@ -604,8 +835,8 @@ void GetProjectionBasis(const BasicMesh &edge_mesh,
                 ScalarType MinD0,MinD1,t;
                 CoordType Clos;
                 size_t IndexE;
-                ClosestPointEMesh(poly_mesh.vert[IndexV0].cP(),edge_mesh,IndexE,t,MinD0,Clos);
-                ClosestPointEMesh(poly_mesh.vert[IndexV1].cP(),edge_mesh,IndexE,t,MinD1,Clos);
+                ClosestPointEMesh(poly_mesh.vert[IndexV0].cP(),edge_mesh,edge_grid,IndexE,t,MinD0,Clos);
+                ClosestPointEMesh(poly_mesh.vert[IndexV1].cP(),edge_mesh,edge_grid,IndexE,t,MinD1,Clos);
 
                 size_t IndexSharp=BasisMap[keyPatch];
                 assert(IndexSharp<PBasePoly.SharpEdge.size());
@@ -717,121 +948,229 @@ template <class PolyMeshType,class TriMeshType>
 void GetMovingPointOnSurface(PolyMeshType &PolyM,TriMeshType &poly_tris,
                              const typename TriMeshType::CoordType &TestPos,
                              vcg::GridStaticPtr<typename TriMeshType::FaceType,typename TriMeshType::ScalarType> &Poly_tri_Grid,
-                             std::vector<std::vector<typename TriMeshType::CoordType> > &VertMove,
-                             std::vector<std::vector<typename TriMeshType::ScalarType> > &VertWeight)
+                             int &IndexPolyF,
+                             std::array<typename TriMeshType::ScalarType,4> &VertWeight,
+                             typename TriMeshType::CoordType &MoveVect,
+                             LocalFaceMarker<TriMeshType> &Marker)
 {
     typedef typename PolyMeshType::ScalarType ScalarType;
     typedef typename PolyMeshType::CoordType CoordType;
     typedef typename TriMeshType::FaceType TriFaceType;
 
-    assert(VertMove.size()==PolyM.vert.size());
-    assert(VertWeight.size()==PolyM.vert.size());
-
     CoordType closestPt;
     ScalarType MaxD=PolyM.bbox.Diag();
     ScalarType MinD;
-    TriFaceType *f=vcg::tri::GetClosestFaceBase(poly_tris,Poly_tri_Grid,TestPos,MaxD,MinD,closestPt);
+    TriFaceType *f=GetClosestFaceLocal(poly_tris,Poly_tri_Grid,TestPos,MaxD,MinD,closestPt,Marker);
     //assert(f!=NULL);
 
     //retrieve the original face
     int IndexTriF=vcg::tri::Index(poly_tris,f);
-    int IndexPolyF=poly_tris.face[IndexTriF].Q();
+    IndexPolyF=poly_tris.face[IndexTriF].Q();
 
     assert(IndexPolyF>=0);
     assert(IndexPolyF<PolyM.face.size());
 
     std::vector<typename TriMeshType::ScalarType> VertWeigths;
-    //std::cout<<"A"<<std::endl;
     GetQuadInterpW<PolyMeshType,TriMeshType>(poly_tris.face[IndexTriF],
                                              PolyM.face[IndexPolyF],
                                              closestPt,VertWeigths);
-    //std::cout<<"B"<<std::endl;
-    CoordType MoveVect=TestPos-closestPt;
-
     for (size_t j=0;j<4;j++)
-    {
-        int IndexV=vcg::tri::Index(PolyM,PolyM.face[IndexPolyF].V(j));
-        VertMove[IndexV].push_back(MoveVect*VertWeigths[j]);
-        VertWeight[IndexV].push_back(VertWeigths[j]);
-    }
+        VertWeight[j]=VertWeigths[j];
+
+    MoveVect=TestPos-closestPt;
 }
 
+//keeps the triangulated copy of the polygonal mesh and its grid alive across
+//the back projection steps, the topology of the polygonal mesh must not change
 template <class PolyMeshType,class TriMeshType>
-void BackProjectStepPositions(PolyMeshType &PolyM,TriMeshType &TriM,
-                              const ProjectionBase &TriProjBase,
-                              const ProjectionBase &PolyProjBase,
-                              std::vector<typename PolyMeshType::CoordType> &TargetPos)
+class BackProjectionEngine
 {
     typedef typename PolyMeshType::ScalarType ScalarType;
     typedef typename PolyMeshType::CoordType CoordType;
     typedef typename TriMeshType::FaceType TriFaceType;
 
-    assert(TriProjBase.VertProjType.size()==TriM.vert.size());
-    assert(PolyProjBase.VertProjType.size()==PolyM.vert.size());
-    assert(TriProjBase.SharpEdge.size()==PolyProjBase.SharpEdge.size());
-    //assert(PolyProjBase.Corner.size()==PolyProjBase.Corner.size());
-
-    //transform the polygonal mesh into triangle one
-    int t0=clock();
     TriMeshType poly_tris;
-    InitPolyTrisMesh(PolyM,poly_tris);
-
-    std::vector<std::vector<CoordType> > VertMove(PolyM.vert.size());
-    std::vector<std::vector<ScalarType> > VertWeight(PolyM.vert.size());
-    int t1=clock();
-    //first set the internal
-    //then initialize the grid
     vcg::GridStaticPtr<TriFaceType,ScalarType> TriGrid;
-    vcg::Box3<ScalarType> BB=poly_tris.bbox;
-    BB.Offset(BB.Diag()*0.1);
-    TriGrid.Set(poly_tris.face.begin(),poly_tris.face.end(),BB);
-    int t2=clock();
-    for (size_t i=0;i<TriM.vert.size();i++)
+    vcg::Box3<ScalarType> GridBox;
+    vcg::Point3i GridSize;
+    //index of the vertex added in the middle of each polygon
+    std::vector<int> CentroidV;
+    bool Initialized=false;
+
+    //closest polygon, weights and movement of each vertex of the triangle mesh
+    std::vector<int> ClosestPolyF;
+    std::vector<std::array<ScalarType,4> > ClosestWeight;
+    std::vector<CoordType> ClosestMove;
+
+    //contributions of the triangle vertices for each polygonal vertex (CSR)
+    std::vector<size_t> AccumStart;
+    std::vector<CoordType> AccumMove;
+    std::vector<ScalarType> AccumWeight;
+
+    void InitGrid()
     {
-        if (TriProjBase.VertProjType[i]!=ProjSuface)continue;
-
-        CoordType TestPos=TriM.vert[i].P();
-        GetMovingPointOnSurface(PolyM,poly_tris,TestPos,TriGrid,VertMove,VertWeight);
+        GridBox=poly_tris.bbox;
+        GridBox.Offset(GridBox.Diag()*0.1);
+        vcg::BestDim((int64_t)poly_tris.face.size(),GridBox.Dim(),GridSize);
+        TriGrid.Set(poly_tris.face.begin(),poly_tris.face.end(),GridBox,GridSize);
     }
-    int t3=clock();
-    //normalize the weight and average the direction
-    std::vector<CoordType> TargetMov(PolyM.vert.size(),CoordType(0,0,0));
-    for (size_t i=0;i<VertWeight.size();i++)
+
+public:
+
+    void Init(PolyMeshType &PolyM)
     {
-        ScalarType SumW=0;
-        for (size_t j=0;j<VertWeight[i].size();j++)
-            SumW+=VertWeight[i][j];
+        poly_tris.Clear();
+        InitPolyTrisMesh(PolyM,poly_tris);
+
+        CentroidV=std::vector<int>(PolyM.face.size(),-1);
+        for (size_t i=0;i<poly_tris.face.size();i++)
+            for (size_t j=0;j<3;j++)
+            {
+                size_t IndexV=vcg::tri::Index(poly_tris,poly_tris.face[i].V(j));
+                if (IndexV<PolyM.vert.size())continue;
+                CentroidV[(size_t)poly_tris.face[i].Q()]=IndexV;
+            }
 
-        if (SumW==0)continue;
+        InitGrid();
+        Initialized=true;
+    }
 
-        for (size_t j=0;j<VertWeight[i].size();j++)
-            VertWeight[i][j]/=SumW;
+    //update the triangulated mesh after the vertices of the polygonal mesh
+    //moved, the grid is rebuilt with the same cells while it contains the mesh
+    void Refit(PolyMeshType &PolyM)
+    {
+        if (!Initialized)
+        {
+            Init(PolyM);
+            return;
+        }
+        assert(poly_tris.vert.size()==(PolyM.vert.size()+PolyM.face.size()));
 
-        for (size_t j=0;j<VertMove[i].size();j++)
+        for (size_t i=0;i<PolyM.vert.size();i++)
         {
-            TargetMov[i]+=VertMove[i][j]*VertWeight[i][j];
+            PolyM.vert[i].Q()=i;
+            poly_tris.vert[i].P()=PolyM.vert[i].P();
         }
+        for (size_t i=0;i<PolyM.face.size();i++)
+        {
+            PolyM.face[i].Q()=i;
+            assert(CentroidV[i]>=0);
+            poly_tris.vert[CentroidV[i]].P()=vcg::PolyBarycenter(PolyM.face[i]);
+        }
+
+        vcg::tri::UpdateNormal<TriMeshType>::PerFaceNormalized(poly_tris);
+        vcg::tri::UpdateNormal<TriMeshType>::PerVertexNormalized(poly_tris);
+        vcg::tri::UpdateBounding<TriMeshType>::Box(poly_tris);
+
+        if (GridBox.IsIn(poly_tris.bbox.min) && GridBox.IsIn(poly_tris.bbox.max))
+            TriGrid.Set(poly_tris.face.begin(),poly_tris.face.end(),GridBox,GridSize);
+        else
+            InitGrid();
     }
 
-    TargetPos.clear();
-    for (size_t i=0;i<PolyM.vert.size();i++)
+    void Step(PolyMeshType &PolyM,TriMeshType &TriM,
+              const ProjectionBase &TriProjBase,
+              const ProjectionBase &PolyProjBase,
+              std::vector<CoordType> &TargetPos)
     {
-        if ((PolyProjBase.VertProjType[i]==ProjCorner)||
-                (PolyProjBase.VertProjType[i]==ProjNone))
-            TargetPos.push_back(PolyM.vert[i].P());
-        else
-            TargetPos.push_back(PolyM.vert[i].P()+TargetMov[i]);
+        assert(TriProjBase.VertProjType.size()==TriM.vert.size());
+        assert(PolyProjBase.VertProjType.size()==PolyM.vert.size());
+        assert(TriProjBase.SharpEdge.size()==PolyProjBase.SharpEdge.size());
+
+        Refit(PolyM);
+
+        ClosestPolyF.assign(TriM.vert.size(),-1);
+        ClosestWeight.resize(TriM.vert.size());
+        ClosestMove.resize(TriM.vert.size());
+#pragma omp parallel
+        {
+            LocalFaceMarker<TriMeshType> Marker;
+            Marker.SetMesh(&poly_tris);
+
+#pragma omp for schedule(dynamic,256)
+            for (int i=0;i<(int)TriM.vert.size();i++)
+            {
+                if (TriProjBase.VertProjType[i]!=ProjSuface)continue;
+
+                CoordType TestPos=TriM.vert[i].P();
+                GetMovingPointOnSurface(PolyM,poly_tris,TestPos,TriGrid,
+                                        ClosestPolyF[i],ClosestWeight[i],ClosestMove[i],
+                                        Marker);
+            }
+        }
+
+        //gather the contributions in the order of the triangle vertices
+        AccumStart.assign(PolyM.vert.size()+1,0);
+        for (size_t i=0;i<TriM.vert.size();i++)
+        {
+            if (ClosestPolyF[i]<0)continue;
+            for (size_t j=0;j<4;j++)
+            {
+                size_t IndexV=vcg::tri::Index(PolyM,PolyM.face[ClosestPolyF[i]].V(j));
+                AccumStart[IndexV+1]++;
+            }
+        }
+        for (size_t i=1;i<AccumStart.size();i++)
+            AccumStart[i]+=AccumStart[i-1];
+
+        AccumMove.resize(AccumStart.back());
+        AccumWeight.resize(AccumStart.back());
+        std::vector<size_t> AccumFill(AccumStart.begin(),AccumStart.end()-1);
+        for (size_t i=0;i<TriM.vert.size();i++)
+        {
+            if (ClosestPolyF[i]<0)continue;
+            for (size_t j=0;j<4;j++)
+            {
+                size_t IndexV=vcg::tri::Index(PolyM,PolyM.face[ClosestPolyF[i]].V(j));
+                AccumMove[AccumFill[IndexV]]=ClosestMove[i]*ClosestWeight[i][j];
+                AccumWeight[AccumFill[IndexV]]=ClosestWeight[i][j];
+                AccumFill[IndexV]++;
+            }
+        }
+
+        //normalize the weight and average the direction
+        std::vector<CoordType> TargetMov(PolyM.vert.size(),CoordType(0,0,0));
+        for (size_t i=0;i<PolyM.vert.size();i++)
+        {
+            ScalarType SumW=0;
+            for (size_t j=AccumStart[i];j<AccumStart[i+1];j++)
+                SumW+=AccumWeight[j];
+
+            if (SumW==0)continue;
+
+            for (size_t j=AccumStart[i];j<AccumStart[i+1];j++)
+                AccumWeight[j]/=SumW;
+
+            for (size_t j=AccumStart[i];j<AccumStart[i+1];j++)
+                TargetMov[i]+=AccumMove[j]*AccumWeight[j];
+        }
+
+        TargetPos.clear();
+        for (size_t i=0;i<PolyM.vert.size();i++)
+        {
+            if ((PolyProjBase.VertProjType[i]==ProjCorner)||
+                    (PolyProjBase.VertProjType[i]==ProjNone))
+                TargetPos.push_back(PolyM.vert[i].P());
+            else
+                TargetPos.push_back(PolyM.vert[i].P()+TargetMov[i]);
+        }
     }
-    int t4=clock();
-    //    std::cout<<"BProj T0: "<<t1-t0<<std::endl;
-    //    std::cout<<"BProj T1: "<<t2-t1<<std::endl;
-    //    std::cout<<"BProj T2: "<<t3-t2<<std::endl;
-    //    std::cout<<"BProj T3: "<<t4-t3<<std::endl;
+};
+
+template <class PolyMeshType,class TriMeshType>
+void BackProjectStepPositions(PolyMeshType &PolyM,TriMeshType &TriM,
+                              const ProjectionBase &TriProjBase,
+                              const ProjectionBase &PolyProjBase,
+                              std::vector<typename PolyMeshType::CoordType> &TargetPos)
+{
+    BackProjectionEngine<PolyMeshType,TriMeshType> BackProj;
+    BackProj.Step(PolyM,TriM,TriProjBase,PolyProjBase,TargetPos);
 }
 
 template <class PolyMeshType,class TriMeshType>
 void SmoothSharpFeatures(PolyMeshType &PolyM,ProjectionBase &PolyProjBase,
                          const BasicMesh &EdgeM,
+                         const EdgeMeshGrid &EdgeGrid,
                          const typename PolyMeshType::ScalarType Damp,
                          std::vector<bool> &BlockedV)
 {
@@ -858,14 +1197,16 @@ void SmoothSharpFeatures(PolyMeshType &PolyM,ProjectionBase &PolyProjBase,
     }
 
 
-    for (size_t i=0;i<PolyM.vert.size();i++)
+    //each query only reads the edge mesh and the grid
+#pragma omp parallel for schedule(dynamic,256)
+    for (int i=0;i<(int)PolyM.vert.size();i++)
     {
         if (PolyProjBase.VertProjType[i]!=ProjSharp)continue;
         if (BlockedV[i])continue;
         size_t IndexE;
         ScalarType t,MinD;
         CoordType Clos;
-        ClosestPointEMesh(PolyM.vert[i].P(),EdgeM,IndexE,t,MinD,Clos);
+        ClosestPointEMesh(PolyM.vert[i].P(),EdgeM,EdgeGrid,IndexE,t,MinD,Clos);
         //TargetPos.push_back(Clos);
         PolyM.vert[i].P()=Clos;
     }
@@ -876,6 +1217,7 @@ void SmoothInternal(PolyMeshType &PolyM,TriMeshType &TriM,
                     vcg::GridStaticPtr<typename TriMeshType::FaceType,
                     typename TriMeshType::ScalarType> &TriGrid,
                     ProjectionBase &TriProjBase,ProjectionBase &PolyProjBase,
+                    BackProjectionEngine<PolyMeshType,TriMeshType> &BackProj,
                     size_t back_proj_steps,
                     SmoothType SType,
                     const typename PolyMeshType::ScalarType Damp,
@@ -926,7 +1268,7 @@ void SmoothInternal(PolyMeshType &PolyM,TriMeshType &TriM,
 
     for (size_t i=0;i<back_proj_steps;i++)
     {
-        BackProjectStepPositions(PolyM,TriM,TriProjBase,PolyProjBase,TargetPosBackProj);
+        BackProj.Step(PolyM,TriM,TriProjBase,PolyProjBase,TargetPosBackProj);
         for (size_t i=0;i<PolyM.vert.size();i++)
         {
             if (BlockedV[i])continue;
@@ -936,19 +1278,27 @@ void SmoothInternal(PolyMeshType &PolyM,TriMeshType &TriM,
     }
 
     //    int t3=clock();
-    for (size_t i=0;i<PolyM.vert.size();i++)
+    //queries are independent, each thread marks the faces on its own
+#pragma omp parallel
     {
-        if (BlockedV[i])continue;
-        if (PolyProjBase.VertProjType[i]==ProjSuface)
+        LocalFaceMarker<TriMeshType> Marker;
+        Marker.SetMesh(&TriM);
+
+#pragma omp for schedule(dynamic,256)
+        for (int i=0;i<(int)PolyM.vert.size();i++)
         {
-            CoordType TestPos=PolyM.vert[i].P();
-            CoordType closestPt;
-            ScalarType MaxD=PolyM.bbox.Diag();
-            ScalarType MinD;
-            //std::cout<<"Index:"<<i<<std::endl;
-            TriFaceType *f=vcg::tri::GetClosestFaceBase(TriM,TriGrid,TestPos,MaxD,MinD,closestPt);
-            assert(f!=NULL);
-            PolyM.vert[i].P()=closestPt;
+            if (BlockedV[i])continue;
+            if (PolyProjBase.VertProjType[i]==ProjSuface)
+            {
+                CoordType TestPos=PolyM.vert[i].P();
+                CoordType closestPt;
+                ScalarType MaxD=PolyM.bbox.Diag();
+                ScalarType MinD;
+                //std::cout<<"Index:"<<i<<std::endl;
+                TriFaceType *f=GetClosestFaceLocal(TriM,TriGrid,TestPos,MaxD,MinD,closestPt,Marker);
+                assert(f!=NULL);
+                PolyM.vert[i].P()=closestPt;
+            }
         }
     }
 
@@ -994,8 +1344,12 @@ void DeCostrainFace(const PolyMeshType &PolyM,
 }
 
 
+//Runs up to step_num smoothing steps and returns the steps done. It stops
+//earlier when timeLimit (seconds) is over, or when no vertex moved more than
+//convergenceThr*AvEdge in a step (0 disables each of the two checks). Each step
+//is reported to progress, which can cancel the smoothing
 template <class PolyMeshType,class TriMeshType>
-void MultiCostraintSmooth(PolyMeshType &PolyM,
+size_t MultiCostraintSmooth(PolyMeshType &PolyM,
                           TriMeshType &TriM,
                           const std::vector<std::pair<size_t,size_t> > &features,
                           const std::vector<size_t> &featuresC,
@@ -1006,19 +1360,27 @@ void MultiCostraintSmooth(PolyMeshType &PolyM,
                           const typename PolyMeshType::ScalarType Damp,
                           const typename PolyMeshType::ScalarType AvEdge,
                           size_t step_num,
-                          size_t back_proj_steps)
+                          size_t back_proj_steps,
+                          const double timeLimit=0,
+                          const typename PolyMeshType::ScalarType convergenceThr=0,
+                          Progress* progress=nullptr)
 {
     typedef typename PolyMeshType::ScalarType ScalarType;
     typedef typename PolyMeshType::CoordType CoordType;
     typedef typename TriMeshType::FaceType TriFaceType;
 
+    const auto start=std::chrono::steady_clock::now();
+
     std::cout<<"*** Getting Projection basis ***"<<std::endl;
     ProjectionBase TriProjBase,PolyProjBase;
 
     BasicMesh EdgeM;
     ExtractEdgeMesh(TriM,features,EdgeM);
 
-    GetProjectionBasis(EdgeM,TriM,features,featuresC,tri_face_partition,PolyM,
+    EdgeMeshGrid EdgeGrid;
+    EdgeGrid.Set(EdgeM);
+
+    GetProjectionBasis(EdgeM,EdgeGrid,TriM,features,featuresC,tri_face_partition,PolyM,
                        quad_corner,quad_face_partition,AvEdge,
                        TriProjBase,PolyProjBase);
 
@@ -1031,24 +1393,60 @@ void MultiCostraintSmooth(PolyMeshType &PolyM,
     BB.Offset(BB.Diag()*0.1);
     TriGrid.Set(TriM.face.begin(),TriM.face.end(),BB);
 
-    for (size_t s=0;s<step_num;s++)
+    BackProjectionEngine<PolyMeshType,TriMeshType> BackProj;
+
+    std::vector<CoordType> PrevPos;
+    size_t s=0;
+    for (s=0;s<step_num;s++)
     {
+        if (convergenceThr>0)
+        {
+            PrevPos.resize(PolyM.vert.size());
+            for (size_t i=0;i<PolyM.vert.size();i++)
+                PrevPos[i]=PolyM.vert[i].P();
+        }
+
         //std::cout<<"Smoooth Feature step: "<<s<<std::endl;
         //int t0=clock();
-        SmoothSharpFeatures<PolyMeshType,TriMeshType>(PolyM,PolyProjBase,EdgeM,Damp,BlockedV);
+        SmoothSharpFeatures<PolyMeshType,TriMeshType>(PolyM,PolyProjBase,EdgeM,EdgeGrid,Damp,BlockedV);
         //        std::cout<<"Smoooth Internal step: "<<s<<std::endl;
         //        int t1=clock();
 
         SmoothInternal<PolyMeshType,TriMeshType>(PolyM,TriM,TriGrid,
                                                  TriProjBase,PolyProjBase,
+                                                 BackProj,
                                                  back_proj_steps,
                                                  TemplateFit,Damp,
                                                  BlockedV,true);
 
         //        int t2=clock();
         //        std::cout<<"Concluded Smoothing step TFeat:"<<t1-t0<<" TInternal:"<<t2-t1<<std::endl;
-    }
 
+        if (progress!=nullptr)
+            progress->report("smooth",(ScalarType)(s+1)/step_num);
+
+        //stop when the vertices do not move anymore
+        if (convergenceThr>0)
+        {
+            ScalarType MaxMove=0;
+            for (size_t i=0;i<PolyM.vert.size();i++)
+                MaxMove=std::max(MaxMove,(PolyM.vert[i].P()-PrevPos[i]).Norm());
+            if (MaxMove<convergenceThr*AvEdge)
+            {
+                std::cout<<"Smoothing converged after "<<s+1<<" steps"<<std::endl;
+                return s+1;
+            }
+        }
+
+        //or when the time is over
+        const double elapsed=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        if ((timeLimit>0)&&(elapsed>=timeLimit)&&(s+1<step_num))
+        {
+            std::cout<<"Smoothing time limit reached after "<<s+1<<" of "<<step_num<<" steps"<<std::endl;
+            return s+1;
+        }
+    }
+    return s;
 }
 
 
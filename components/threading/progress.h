@@ -0,0 +1,103 @@
+/***************************************************************************/
+/* Copyright(C) 2021
+
+
+The authors of
+
+Reliable Feature-Line Driven Quad-Remeshing
+Siggraph 2021
+
+
+ All rights reserved.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+****************************************************************************/
+
+#ifndef QUADWILD_PROGRESS_H
+#define QUADWILD_PROGRESS_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+//Progress of a long computation, reported by its loops to a callback that can
+//cancel it. Cancellation is cooperative: the loops check it between their
+//steps and unwind with Progress::Cancelled, freeing what they allocated.
+//All the methods can be called from any thread
+class Progress {
+public:
+    //stage running and fraction of it done in [0, 1], return false to cancel
+    typedef std::function<bool(const std::string& stage, double fraction)> Callback;
+
+    class Cancelled : public std::runtime_error {
+    public:
+        Cancelled() : std::runtime_error("cancelled") {}
+    };
+
+    explicit Progress(Callback callback = Callback()) :
+        callback(std::move(callback))
+    {
+
+    }
+
+    Progress(const Progress&) = delete;
+    Progress& operator=(const Progress&) = delete;
+
+    //ask the computation to stop at its next check
+    void cancel()
+    {
+        cancelRequested = true;
+    }
+
+    bool cancelled() const
+    {
+        return cancelRequested;
+    }
+
+    //report without throwing, for the loops that cannot unwind (e.g. OpenMP
+    //regions). Returns false if the computation has to stop
+    bool update(const std::string& stage, const double fraction)
+    {
+        if (cancelRequested)
+            return false;
+        if (callback) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!callback(stage, fraction))
+                cancelRequested = true;
+        }
+        return !cancelRequested;
+    }
+
+    //report and throw Cancelled if the computation has to stop
+    void report(const std::string& stage, const double fraction)
+    {
+        if (!update(stage, fraction))
+            throw Cancelled();
+    }
+
+    //throw Cancelled if the computation has to stop, without reporting
+    void check() const
+    {
+        if (cancelRequested)
+            throw Cancelled();
+    }
+
+private:
+    Callback callback;
+    std::mutex mutex;
+    std::atomic<bool> cancelRequested{false};
+};
+
+#endif // QUADWILD_PROGRESS_H
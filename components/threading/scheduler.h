@@ -0,0 +1,269 @@
+/***************************************************************************/
+/* Copyright(C) 2021
+
+
+The authors of
+
+Reliable Feature-Line Driven Quad-Remeshing
+Siggraph 2021
+
+
+ All rights reserved.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+****************************************************************************/
+
+#ifndef QUADWILD_SCHEDULER_H
+#define QUADWILD_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//Concurrency model shared by quadwild, quad_from_patches and field_computation.
+//The parallel work runs on the OpenMP thread pool: the process has a total
+//number of threads (--threads), each thread has a budget for the parallel
+//regions it starts (Budget), and named stages can be limited further
+//(--stage-threads). Nested parallel regions run serially, so a parallel loop
+//inside a batch job or inside a parallel chart loop never oversubscribes
+namespace Scheduler {
+
+namespace internal {
+
+inline size_t& totalThreads()
+{
+    static size_t total = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return total;
+}
+
+//budget of the calling thread, 0 if it did not open one
+inline size_t& threadBudget()
+{
+    thread_local size_t budget = 0;
+    return budget;
+}
+
+inline std::mutex& stageMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+inline std::map<std::string, size_t>& stageLimits()
+{
+    static std::map<std::string, size_t> limits;
+    return limits;
+}
+
+}
+
+//Total threads of the process (0: all the cores). Call it once at startup,
+//before any parallel region
+inline void setNumThreads(const size_t numThreads)
+{
+    const size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+    internal::totalThreads() = numThreads > 0 ? numThreads : cores;
+#ifdef _OPENMP
+    omp_set_num_threads(static_cast<int>(internal::totalThreads()));
+    omp_set_max_active_levels(1);
+#endif
+}
+
+inline size_t numThreads()
+{
+    return internal::totalThreads();
+}
+
+//Threads available to the parallel regions started by the calling thread
+inline size_t threads()
+{
+#ifdef _OPENMP
+    if (omp_in_parallel())
+        return 1;
+#endif
+    const size_t budget = internal::threadBudget();
+    return budget > 0 ? std::min(budget, numThreads()) : numThreads();
+}
+
+//Maximum threads of a stage (e.g. "trace"), 0 to remove the limit
+inline void setStageThreads(const std::string& stage, const size_t numThreads)
+{
+    std::lock_guard<std::mutex> lock(internal::stageMutex());
+    if (numThreads == 0)
+        internal::stageLimits().erase(stage);
+    else
+        internal::stageLimits()[stage] = numThreads;
+}
+
+inline size_t stageThreads(const std::string& stage)
+{
+    std::lock_guard<std::mutex> lock(internal::stageMutex());
+    auto it = internal::stageLimits().find(stage);
+    return it != internal::stageLimits().end() ? it->second : 0;
+}
+
+//Limit the calling thread, and the OpenMP regions it starts, to numThreads
+//threads until the end of the scope. Threads not created by OpenMP (e.g. the
+//workers of the batch mode) have to open one to get their share
+class Budget {
+public:
+    explicit Budget(const size_t numThreads) :
+        previous(internal::threadBudget())
+    {
+        const size_t available = previous > 0 ? previous : Scheduler::numThreads();
+        internal::threadBudget() = std::max<size_t>(1, std::min(numThreads, available));
+#ifdef _OPENMP
+        previousOmp = omp_get_max_threads();
+        omp_set_num_threads(static_cast<int>(internal::threadBudget()));
+#endif
+    }
+
+    ~Budget()
+    {
+        internal::threadBudget() = previous;
+#ifdef _OPENMP
+        omp_set_num_threads(previousOmp);
+#endif
+    }
+
+    Budget(const Budget&) = delete;
+    Budget& operator=(const Budget&) = delete;
+
+private:
+    size_t previous;
+#ifdef _OPENMP
+    int previousOmp = 1;
+#endif
+};
+
+//Budget of a named stage: the current one, limited by setStageThreads
+class Stage {
+public:
+    explicit Stage(const std::string& name) :
+        budget(stageBudget(name))
+    {
+
+    }
+
+private:
+    static size_t stageBudget(const std::string& name)
+    {
+        const size_t limit = stageThreads(name);
+        return limit > 0 ? limit : threads();
+    }
+
+    Budget budget;
+};
+
+//Run body(i) for i in [begin, end) on the threads of the current budget.
+//Iterations are handed out in blocks of grain indices. An exception thrown by
+//body (e.g. Progress::Cancelled) skips the iterations not started yet and is
+//rethrown once the running ones are over
+template<class Body>
+void parallelFor(const size_t begin, const size_t end, Body&& body, const size_t grain = 1)
+{
+    if (end <= begin)
+        return;
+#ifdef _OPENMP
+    const long long n = static_cast<long long>(end - begin);
+    const int numThreads = static_cast<int>(std::min<size_t>(threads(), (end - begin + grain - 1) / grain));
+    if (numThreads > 1) {
+        std::exception_ptr error;
+        std::atomic<bool> failed{false};
+#pragma omp parallel for schedule(dynamic, grain) num_threads(numThreads)
+        for (long long i = 0; i < n; i++) {
+            if (failed)
+                continue;
+            try {
+                body(begin + static_cast<size_t>(i));
+            }
+            catch (...) {
+#pragma omp critical(scheduler_parallel_for)
+                {
+                    if (!error)
+                        error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+        return;
+    }
+#endif
+    for (size_t i = begin; i < end; i++)
+        body(i);
+}
+
+//Remove --threads N and --stage-threads name=N[,name=N...] from the command
+//line, applying them. Throws on invalid values
+inline void parseOptions(int& argc, char* argv[])
+{
+    size_t total = 0;
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+        if (option != "--threads" && option != "--stage-threads") {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("missing value for '" + option + "'");
+        }
+        const std::string value = argv[++i];
+
+        if (option == "--threads") {
+            char* end;
+            total = std::strtoul(value.c_str(), &end, 10);
+            if (*end != '\0') {
+                throw std::runtime_error("invalid number of threads '" + value + "'");
+            }
+            continue;
+        }
+
+        size_t start = 0;
+        while (start < value.size()) {
+            size_t comma = value.find(',', start);
+            if (comma == std::string::npos)
+                comma = value.size();
+            const std::string entry = value.substr(start, comma - start);
+            const size_t equal = entry.find('=');
+            char* end = nullptr;
+            const size_t limit = equal != std::string::npos ? std::strtoul(entry.c_str() + equal + 1, &end, 10) : 0;
+            if (equal == std::string::npos || equal == 0 || *end != '\0') {
+                throw std::runtime_error("invalid stage threads '" + entry + "', expected <stage>=<threads>");
+            }
+            setStageThreads(entry.substr(0, equal), limit);
+            start = comma + 1;
+        }
+    }
+    argc = kept;
+    argv[argc] = nullptr;
+
+    setNumThreads(total);
+}
+
+}
+
+#endif // QUADWILD_SCHEDULER_H
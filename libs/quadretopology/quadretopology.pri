@@ -8,6 +8,7 @@ SOURCES += \
         $$PWD/quadretopology/includes/qr_convert.cpp \
         $$PWD/quadretopology/includes/qr_ilp.cpp \
         $$PWD/quadretopology/includes/qr_patterns.cpp \
+        $$PWD/quadretopology/includes/qr_pattern_cache.cpp \
         $$PWD/quadretopology/includes/qr_mapping.cpp \
         $$PWD/quadretopology/includes/qr_utils.cpp \
         $$PWD/quadretopology/qr_eval_quantization.cpp \
@@ -22,6 +23,7 @@ HEADERS += \
         $$PWD/quadretopology/includes/qr_ilp.h \
         $$PWD/quadretopology/includes/qr_parameters.h \
         $$PWD/quadretopology/includes/qr_patterns.h \
+        $$PWD/quadretopology/includes/qr_pattern_cache.h \
         $$PWD/quadretopology/includes/qr_mapping.h \
         $$PWD/quadretopology/includes/qr_utils.h \
         $$PWD/quadretopology/qr_eval_quantization.h \
@@ -29,6 +29,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <map>
 #include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
 
 #include "qr_utils.h"
 
@@ -119,5 +121,224 @@ void findChartFacesAndBorderFaces(
     }
 }
 
+//Trace the borders of the chart, splitting them in subsides on the corners of the chart,
+//on the corners of the adjacent charts and where the adjacent chart changes. Work and
+//memory are proportional to the border of the chart
+template<class TriangleMeshType>
+std::vector<ChartBorder> traceChartBorders(
+        TriangleMeshType& mesh,
+        const std::vector<int>& faceLabel,
+        const std::vector<std::vector<size_t>>& corners,
+        const Chart& chart)
+{
+    typedef std::unordered_map<std::pair<size_t, size_t>, int, EdgeHash> EdgeLabelMap;
+
+    std::vector<ChartBorder> chartBorders;
+
+    const int pId = chart.label;
+    std::unordered_set<size_t> cornerSet(corners[pId].begin(), corners[pId].end());
+
+    //Border edges, with the label of the adjacent chart
+    std::vector<std::pair<size_t, size_t>> borderEdges;
+    std::vector<int> borderEdgeLabels;
+    for (const size_t& fId : chart.borderFaces) {
+        typename TriangleMeshType::FaceType* currentFacePointer = &mesh.face[fId];
+        vcg::face::Pos<typename TriangleMeshType::FaceType> pos(currentFacePointer, 0);
+
+        for (int k = 0; k < currentFacePointer->VN(); k++) {
+            pos.FlipF();
+            size_t adjFace = vcg::tri::Index(mesh, pos.F());
+            int adjLabel = faceLabel[adjFace];
+
+            bool isBorderEdge = false;
+            int adjChartLabel = -2;
+
+            if (currentFacePointer == pos.F()) {
+                adjChartLabel = -1;
+                isBorderEdge = true;
+            }
+            else if (adjLabel != chart.label) {
+                adjChartLabel = adjLabel;
+                isBorderEdge = true;
+            }
+            pos.FlipF();
+
+            //For each border edge
+            if (isBorderEdge) {
+                assert(adjChartLabel > -2);
+
+                typename TriangleMeshType::VertexType* vStart = pos.V();
+                pos.FlipV();
+                typename TriangleMeshType::VertexType* vEnd = pos.V();
+                pos.FlipV();
+
+                borderEdges.push_back(std::make_pair(vcg::tri::Index(mesh, vStart), vcg::tri::Index(mesh, vEnd)));
+                borderEdgeLabels.push_back(adjChartLabel);
+            }
+
+            pos.FlipV();
+            pos.FlipE();
+        }
+    }
+
+    if (borderEdges.empty())
+        return chartBorders;
+
+    //Local indices of the border vertices, sorted as the mesh indices
+    std::vector<size_t> borderVertices;
+    borderVertices.reserve(borderEdges.size() * 2);
+    for (const std::pair<size_t, size_t>& edge : borderEdges) {
+        borderVertices.push_back(edge.first);
+        borderVertices.push_back(edge.second);
+    }
+    std::sort(borderVertices.begin(), borderVertices.end());
+    borderVertices.erase(std::unique(borderVertices.begin(), borderVertices.end()), borderVertices.end());
+
+    auto localId = [&borderVertices](const size_t& vId) {
+        return static_cast<size_t>(std::lower_bound(borderVertices.begin(), borderVertices.end(), vId) - borderVertices.begin());
+    };
+
+    //Fill edge map and next vertex map
+    EdgeLabelMap edgeLabelMap;
+    edgeLabelMap.reserve(borderEdges.size());
+    std::vector<std::vector<size_t>> vertexNextMap(borderVertices.size());
+    for (size_t i = 0; i < borderEdges.size(); i++) {
+        size_t vStartId = localId(borderEdges[i].first);
+        size_t vEndId = localId(borderEdges[i].second);
+
+        std::pair<size_t, size_t> edge(vStartId, vEndId);
+        if (edge.first > edge.second) {
+            std::swap(edge.first, edge.second);
+        }
+
+        edgeLabelMap.insert(std::make_pair(edge, borderEdgeLabels[i]));
+        vertexNextMap[vStartId].push_back(vEndId);
+    }
+
+    auto edgeLabel = [&edgeLabelMap](const size_t& v1, const size_t& v2) {
+        std::pair<size_t, size_t> edge(v1, v2);
+        if (edge.first > edge.second) {
+            std::swap(edge.first, edge.second);
+        }
+        return edgeLabelMap.at(edge);
+    };
+
+    std::vector<bool> remainingVertices(borderVertices.size(), true);
+    size_t numRemainingVertices = borderVertices.size();
+    size_t firstRemainingVertex = 0;
+
+    do {
+        //Find first label
+        size_t vStartId;
+        size_t vCurrentId;
+        size_t vNextId;
+
+        bool isCorner = false;
+
+        while (!remainingVertices[firstRemainingVertex]) {
+            firstRemainingVertex++;
+        }
+        vCurrentId = firstRemainingVertex;
+
+        std::vector<size_t> nextConfiguration = findVertexChainPath(vCurrentId, vertexNextMap);
+        vNextId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
+
+        int currentLabel;
+
+        //Iterate in the borders to get the first corner
+        vStartId = vCurrentId;
+        size_t firstCornerIterations = 0;
+        do {
+            //Next border edge
+            vCurrentId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
+            vNextId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
+
+            //Check if it is a corner
+            isCorner = cornerSet.find(borderVertices[vCurrentId]) != cornerSet.end();
+
+            firstCornerIterations++;
+        } while (!isCorner && vCurrentId != vStartId && firstCornerIterations < MAXITERATIONS);
+
+#ifndef NDEBUG
+        if (firstCornerIterations >= MAXITERATIONS) {
+            std::cout << "Error: error iterating! Cannot find the first corner or get back to the start vertex." << std::endl;
+        }
+#endif
+
+#ifndef NDEBUG
+        if (vCurrentId == vStartId) {
+            std::cout << "Warning 1: input mesh is not well-defined: no corners!" << std::endl;
+        }
+#endif
+        vStartId = vCurrentId;
+        vNextId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
+
+        ChartBorder chartBorder;
+
+        do {
+            ChartBorderSubside borderSubside;
+
+            //Get current label on the other side
+            const int adjChartLabel = edgeLabel(vCurrentId, vNextId);
+
+            std::unordered_set<size_t> cornerSetAdj;
+            if (adjChartLabel >= 0)
+                cornerSetAdj.insert(corners[adjChartLabel].begin(), corners[adjChartLabel].end());
+
+            bool firstIteration = true;
+            isCorner = false;
+            bool isAdjCorner = false;
+            size_t vSubSideStartId = vCurrentId;
+            size_t iterations = 0;
+            do {
+                //Check if it is a corner
+                if (!firstIteration) {
+                    isCorner = cornerSet.find(borderVertices[vCurrentId]) != cornerSet.end();
+                    isAdjCorner = cornerSetAdj.find(borderVertices[vCurrentId]) != cornerSetAdj.end();
+                }
+
+                //Get current label on the other subside
+                currentLabel = edgeLabel(vCurrentId, vNextId);
+
+                if (!isCorner && !isAdjCorner && currentLabel == adjChartLabel) {
+                    borderSubside.vertices.push_back(borderVertices[vCurrentId]);
+
+                    firstIteration = false;
+
+                    if (remainingVertices[vCurrentId]) {
+                        remainingVertices[vCurrentId] = false;
+                        numRemainingVertices--;
+                    }
+
+                    //Next border edge
+                    vCurrentId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
+                    vNextId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
+                }
+            } while (!isCorner && !isAdjCorner && currentLabel == adjChartLabel && vCurrentId != vSubSideStartId && iterations < MAXITERATIONS);
+#ifndef NDEBUG
+            if (iterations >= MAXITERATIONS) {
+                std::cout << "Error: error iterating! Cannot find a corner or get back to the start vertex." << std::endl;
+            }
+#endif
+#ifndef NDEBUG
+            if (vCurrentId == vSubSideStartId) {
+                std::cout << "Warning 2: input mesh is not well-defined: single border chart with no corners!" << std::endl;
+            }
+#endif
+
+            //Add last vertex
+            borderSubside.vertices.push_back(borderVertices[vCurrentId]);
+            borderSubside.adjChartLabel = adjChartLabel;
+            borderSubside.isCorner = isCorner;
+
+            chartBorder.push_back(borderSubside);
+        } while (vCurrentId != vStartId);
+
+        chartBorders.push_back(chartBorder);
+    } while (numRemainingVertices > 0);
+
+    return chartBorders;
+}
+
 }
 }
@@ -30,6 +30,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <array>
 #include <set>
 #include <cmath>
+#include <functional>
 
 #define MAXITERATIONS 100000
 
@@ -75,12 +76,36 @@ struct ChartData {
 };
 
 namespace internal {
+
+struct EdgeHash {
+    size_t operator()(const std::pair<size_t, size_t>& edge) const {
+        return std::hash<size_t>()(edge.first) ^ (std::hash<size_t>()(edge.second) + 0x9e3779b97f4a7c15ull + (edge.first << 6) + (edge.first >> 2));
+    }
+};
+
+//Subside traced on the border of a chart, before being matched with the ones of the adjacent charts
+struct ChartBorderSubside {
+    std::vector<size_t> vertices; //All the vertices walked, the last one included
+    int adjChartLabel;
+    bool isCorner; //True if the subside ends in a corner of the chart
+};
+
+//Subsides of a closed border of a chart, in walking order
+typedef std::vector<ChartBorderSubside> ChartBorder;
+
 template<class TriangleMeshType>
 void findChartFacesAndBorderFaces(
         TriangleMeshType& mesh,
         const std::vector<int>& faceLabel,
         ChartData& chartData);
 
+template<class TriangleMeshType>
+std::vector<ChartBorder> traceChartBorders(
+        TriangleMeshType& mesh,
+        const std::vector<int>& faceLabel,
+        const std::vector<std::vector<size_t>>& corners,
+        const Chart& chart);
+
 }
 }
 
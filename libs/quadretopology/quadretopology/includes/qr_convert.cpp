@@ -27,6 +27,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <vcg/complex/complex.h>
 
+#include <algorithm>
+
 namespace QuadRetopology {
 namespace internal {
 
@@ -85,6 +87,62 @@ void VCGToEigen(
     }
 }
 
+//Same output of VCGToEigen on the selected faces, without touching the selection flags
+//of the mesh: vertices and faces are ordered by their index in the mesh
+template<class PolyMeshType>
+void chartToEigen(
+        const PolyMeshType& vcgMesh,
+        const std::vector<size_t>& faces,
+        Eigen::MatrixXd& V,
+        Eigen::MatrixXi& F,
+        std::unordered_map<size_t, int>& vMap,
+        int numVerticesPerFace,
+        int dim)
+{
+    assert(dim >= 2);
+    assert(numVerticesPerFace > 2);
+
+    std::vector<size_t> sortedFaces;
+    sortedFaces.reserve(faces.size());
+    for (const size_t& fId : faces) {
+        if (!vcgMesh.face[fId].IsD()) {
+            sortedFaces.push_back(fId);
+        }
+    }
+    std::sort(sortedFaces.begin(), sortedFaces.end());
+    sortedFaces.erase(std::unique(sortedFaces.begin(), sortedFaces.end()), sortedFaces.end());
+
+    std::vector<size_t> sortedVertices;
+    sortedVertices.reserve(sortedFaces.size() * numVerticesPerFace);
+    for (const size_t& fId : sortedFaces) {
+        for (int j = 0; j < vcgMesh.face[fId].VN(); j++) {
+            sortedVertices.push_back(vcg::tri::Index(vcgMesh, vcgMesh.face[fId].cV(j)));
+        }
+    }
+    std::sort(sortedVertices.begin(), sortedVertices.end());
+    sortedVertices.erase(std::unique(sortedVertices.begin(), sortedVertices.end()), sortedVertices.end());
+
+    V.resize(sortedVertices.size(), dim);
+    F.resize(sortedFaces.size(), numVerticesPerFace);
+
+    vMap.clear();
+    vMap.reserve(sortedVertices.size());
+    for (size_t i = 0; i < sortedVertices.size(); i++) {
+        const size_t& vId = sortedVertices[i];
+        vMap[vId] = static_cast<int>(i);
+        for (int j = 0; j < dim; j++) {
+            V(i, j) = vcgMesh.vert[vId].cP()[j];
+        }
+    }
+
+    for (size_t i = 0; i < sortedFaces.size(); i++) {
+        const size_t& fId = sortedFaces[i];
+        for (int j = 0; j < vcgMesh.face[fId].VN(); j++) {
+            F(i, j) = vMap.at(vcg::tri::Index(vcgMesh, vcgMesh.face[fId].cV(j)));
+        }
+    }
+}
+
 template<class PolyMeshType>
 void eigenToVCG(
         const Eigen::MatrixXd& V,
@@ -28,6 +28,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <Eigen/Core>
 #include <vector>
+#include <unordered_map>
 
 namespace QuadRetopology {
 namespace internal {
@@ -43,6 +44,16 @@ void VCGToEigen(
         int numVerticesPerFace = 3,
         int dim = 3);
 
+template<class PolyMeshType>
+void chartToEigen(
+        const PolyMeshType& vcgMesh,
+        const std::vector<size_t>& faces,
+        Eigen::MatrixXd& V,
+        Eigen::MatrixXi& F,
+        std::unordered_map<size_t, int>& vMap,
+        int numVerticesPerFace = 3,
+        int dim = 3);
+
 template<class PolyMeshType>
 void eigenToVCG(
         const Eigen::MatrixXd& V,
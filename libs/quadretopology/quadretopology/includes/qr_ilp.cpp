@@ -544,6 +544,8 @@ ILPResult solveILP(
 
             //Optimize model
             model.optimize();
+            if (model.get(GRB_IntAttr_Status) == GRB_TIME_LIMIT)
+                ilp_result.timeLimitReached = true;
 
             for (size_t subsideId = 0; subsideId < chartData.subsides.size(); subsideId++) {
                 const ChartSubside& subside = chartData.subsides[subsideId];
@@ -55,6 +55,7 @@ NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ILPStats,
 
 struct ILPResult {
     std::vector<ILPStats> stats;
+    bool timeLimitReached = false; // an optimization stopped at the time limit
 };
 
 enum ILPStatus { SOLUTIONFOUND, SOLUTIONWRONG, INFEASIBLE };
@@ -28,6 +28,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <vector>
 #include <string>
+#include <functional>
 #include <quadretopology/includes/config/gurobi.hh>
 
 #define DEFAULTINITIALREMESHING true
@@ -50,6 +51,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define DEFAULTREPEATLOSINGCONSTRAINTSALIGN false
 #define DEFAULTHARDPARITYCONSTRAINT true
 #define DEFAULTFEASIBILITYFIX false
+#define DEFAULTFLOWPARALLELCOMPONENTS true
+#define DEFAULTFLOWMINCOMPONENTCHARTS 64
+#define DEFAULTFLOWWARMSTART true
+#define DEFAULTFLOWMEASUREWARMSTART false
+#define DEFAULTFLOWCONTRACTNETWORK true
+#define DEFAULTFLOWTIMELIMIT 0 //No limit
 
 #define DEFAULTTIMELIMIT 60 //1 minute
 #define DEFAULTGAPLIMIT 0.0 //Optimal
@@ -59,6 +66,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define DEFAULTQUADRANGULATIONFIXEDSMOOTHINGITERATIONS 5
 #define DEFAULTQUADRANGULATIONNONFIXEDSMOOTHINGITERATIONS 5
 #define DEFAULTDOUBLETREMOVAL true
+#define DEFAULTPARALLELCHARTQUADRANGULATION true
+#define DEFAULTPATTERNCACHE true
 
 #define DEFAULTRESULTSMOOTHINGITERATIONS 5
 #define DEFAULTRESULTSMOOTHINGNRING 3
@@ -97,6 +106,12 @@ struct Parameters {
     bool repeatLosingConstraintsAlign;
     bool feasibilityFix;
     bool hardParityConstraint;
+    bool flowParallelComponents;
+    int flowMinComponentCharts;
+    bool flowWarmStart;
+    bool flowMeasureWarmStart; //also solve the resolve cold, for the timings in FlowResult::stopwatch
+    bool flowContractNetwork;
+    double flowTimeLimit;
 
     double timeLimit;
     double gapLimit;
@@ -108,6 +123,14 @@ struct Parameters {
     int quadrangulationFixedSmoothingIterations;
     int quadrangulationNonFixedSmoothingIterations;
     bool doubletRemoval;
+    bool parallelChartQuadrangulation;
+    bool patternCache;
+    std::string patternCacheFilename;
+
+    //Called with the stage and the fraction of it done (e.g. after each chart
+    //is quadrangulated), possibly from several threads at the same time. The
+    //computation stops with an exception when it returns false
+    std::function<bool(const std::string& stage, double fraction)> progressCallback;
     
     int resultSmoothingIterations;
     double resultSmoothingNRing;
@@ -136,6 +159,12 @@ struct Parameters {
         repeatLosingConstraintsAlign = DEFAULTREPEATLOSINGCONSTRAINTSALIGN;
         hardParityConstraint = DEFAULTHARDPARITYCONSTRAINT;
         feasibilityFix = DEFAULTFEASIBILITYFIX;
+        flowParallelComponents = DEFAULTFLOWPARALLELCOMPONENTS;
+        flowMinComponentCharts = DEFAULTFLOWMINCOMPONENTCHARTS;
+        flowWarmStart = DEFAULTFLOWWARMSTART;
+        flowMeasureWarmStart = DEFAULTFLOWMEASUREWARMSTART;
+        flowContractNetwork = DEFAULTFLOWCONTRACTNETWORK;
+        flowTimeLimit = DEFAULTFLOWTIMELIMIT;
 
         timeLimit = DEFAULTTIMELIMIT;
         gapLimit = DEFAULTGAPLIMIT;
@@ -145,6 +174,8 @@ struct Parameters {
         quadrangulationFixedSmoothingIterations = DEFAULTQUADRANGULATIONFIXEDSMOOTHINGITERATIONS;
         quadrangulationNonFixedSmoothingIterations = DEFAULTQUADRANGULATIONNONFIXEDSMOOTHINGITERATIONS;
         doubletRemoval = DEFAULTDOUBLETREMOVAL;
+        parallelChartQuadrangulation = DEFAULTPARALLELCHARTQUADRANGULATION;
+        patternCache = DEFAULTPATTERNCACHE;
         
         resultSmoothingIterations = DEFAULTRESULTSMOOTHINGITERATIONS;
         resultSmoothingNRing = DEFAULTRESULTSMOOTHINGNRING;
@@ -0,0 +1,366 @@
+/***************************************************************************/
+/* Copyright(C) 2021
+
+
+The authors of
+
+Reliable Feature-Line Driven Quad-Remeshing
+Siggraph 2021
+
+
+ All rights reserved.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+****************************************************************************/
+
+#include "qr_pattern_cache.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <mutex>
+#include <cstdint>
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#define PATTERNCACHEMAGIC "QRPATTERNCACHE"
+#define PATTERNCACHEVERSION 1
+
+namespace QuadRetopology {
+namespace internal {
+
+namespace {
+
+std::vector<int> toKey(const Eigen::VectorXi& l)
+{
+    return std::vector<int>(l.data(), l.data() + l.size());
+}
+
+template<class T>
+void writeValue(std::ofstream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<class T>
+bool readValue(std::ifstream& stream, T& value)
+{
+    stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return static_cast<bool>(stream);
+}
+
+void writeIndices(std::ofstream& stream, const std::vector<size_t>& indices)
+{
+    writeValue(stream, static_cast<uint64_t>(indices.size()));
+    for (const size_t& id : indices) {
+        writeValue(stream, static_cast<uint64_t>(id));
+    }
+}
+
+//True if count elements of elementSize bytes fit in what is left of the file:
+//the counts read from the file are checked before allocating anything
+bool fits(std::ifstream& stream, const uint64_t fileSize, const uint64_t count, const uint64_t elementSize)
+{
+    const std::streamoff position = stream.tellg();
+    if (position < 0 || static_cast<uint64_t>(position) > fileSize)
+        return false;
+    return count <= (fileSize - static_cast<uint64_t>(position)) / elementSize;
+}
+
+//Indices of vertices, all lower than numVertices
+bool readIndices(std::ifstream& stream, const uint64_t fileSize, const uint64_t numVertices, std::vector<size_t>& indices)
+{
+    uint64_t size;
+    if (!readValue(stream, size) || !fits(stream, fileSize, size, sizeof(uint64_t)))
+        return false;
+
+    indices.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        uint64_t id;
+        if (!readValue(stream, id) || id >= numVertices)
+            return false;
+        indices[i] = static_cast<size_t>(id);
+    }
+    return true;
+}
+
+bool readEntry(std::ifstream& stream, const uint64_t fileSize, std::vector<int>& key, PatternCacheEntry& entry)
+{
+    uint32_t n;
+    if (!readValue(stream, n) || n < 2 || !fits(stream, fileSize, n, sizeof(int32_t)))
+        return false;
+
+    key.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+        int32_t value;
+        if (!readValue(stream, value))
+            return false;
+        key[i] = value;
+    }
+
+    uint64_t numVertices, numFaces;
+    if (!readValue(stream, numVertices) || !fits(stream, fileSize, numVertices, 3 * sizeof(double)))
+        return false;
+    entry.patchV.resize(static_cast<Eigen::Index>(numVertices), 3);
+    for (Eigen::Index i = 0; i < entry.patchV.rows(); i++) {
+        for (int j = 0; j < 3; j++) {
+            if (!readValue(stream, entry.patchV(i, j)))
+                return false;
+        }
+    }
+
+    if (!readValue(stream, numFaces) || !fits(stream, fileSize, numFaces, 4 * sizeof(int32_t)))
+        return false;
+    entry.patchF.resize(static_cast<Eigen::Index>(numFaces), 4);
+    for (Eigen::Index i = 0; i < entry.patchF.rows(); i++) {
+        for (int j = 0; j < 4; j++) {
+            int32_t value;
+            if (!readValue(stream, value) || value < 0 || static_cast<uint64_t>(value) >= numVertices)
+                return false;
+            entry.patchF(i, j) = value;
+        }
+    }
+
+    if (!readIndices(stream, fileSize, numVertices, entry.borders) || !readIndices(stream, fileSize, numVertices, entry.corners))
+        return false;
+
+    //one corner and one side for each side of the key, the corners on the borders
+    if (entry.corners.size() != n)
+        return false;
+    for (const size_t& corner : entry.corners) {
+        if (std::find(entry.borders.begin(), entry.borders.end(), corner) == entry.borders.end())
+            return false;
+    }
+
+    entry.sides.resize(n);
+    for (std::vector<size_t>& side : entry.sides) {
+        if (!readIndices(stream, fileSize, numVertices, side))
+            return false;
+    }
+
+    return true;
+}
+
+}
+
+PatternCache& PatternCache::instance()
+{
+    static PatternCache cache;
+    return cache;
+}
+
+int PatternCache::canonicalRotation(const Eigen::VectorXi& l)
+{
+    const int n = static_cast<int>(l.size());
+
+    int best = 0;
+    for (int r = 1; r < n; r++) {
+        for (int i = 0; i < n; i++) {
+            const int a = l((i + r) % n);
+            const int b = l((i + best) % n);
+            if (a != b) {
+                if (a < b)
+                    best = r;
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+Eigen::VectorXi PatternCache::rotate(const Eigen::VectorXi& l, const int rotation)
+{
+    const int n = static_cast<int>(l.size());
+
+    Eigen::VectorXi rotated(n);
+    for (int i = 0; i < n; i++) {
+        rotated(i) = l((i + rotation) % n);
+    }
+    return rotated;
+}
+
+//Given the entry of the canonical vector lc, with lc[i] = l[(i + rotation) % n],
+//get the entry of l: the side j of l is the side (j - rotation) % n of lc
+void PatternCache::rotate(const PatternCacheEntry& canonicalEntry, const int rotation, PatternCacheEntry& entry)
+{
+    const size_t n = canonicalEntry.corners.size();
+
+    entry.patchV = canonicalEntry.patchV;
+    entry.patchF = canonicalEntry.patchF;
+
+    entry.corners.resize(n);
+    entry.sides.resize(n);
+    for (size_t j = 0; j < n; j++) {
+        const size_t canonicalId = (j + n - rotation) % n;
+        entry.corners[j] = canonicalEntry.corners[canonicalId];
+        entry.sides[j] = canonicalEntry.sides[canonicalId];
+    }
+
+    //Borders start from the first corner
+    const std::vector<size_t>& borders = canonicalEntry.borders;
+    std::vector<size_t>::const_iterator firstIt = std::find(borders.begin(), borders.end(), entry.corners[0]);
+    assert(firstIt != borders.end());
+
+    entry.borders.clear();
+    entry.borders.reserve(borders.size());
+    entry.borders.insert(entry.borders.end(), firstIt, borders.end());
+    entry.borders.insert(entry.borders.end(), borders.begin(), firstIt);
+}
+
+bool PatternCache::find(const Eigen::VectorXi& l, PatternCacheEntry& entry, PatternCacheCounters* counters)
+{
+    const int rotation = canonicalRotation(l);
+    const std::vector<int> key = toKey(rotate(l, rotation));
+
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    std::map<std::vector<int>, PatternCacheEntry>::const_iterator it = entries.find(key);
+    if (it == entries.end()) {
+        if (counters != nullptr)
+            counters->misses++;
+        return false;
+    }
+
+    rotate(it->second, rotation, entry);
+    if (counters != nullptr)
+        counters->hits++;
+    return true;
+}
+
+//The entry has to be the pattern of the canonical rotation of l
+void PatternCache::insert(const Eigen::VectorXi& l, const PatternCacheEntry& entry)
+{
+    assert(canonicalRotation(l) == 0);
+    const std::vector<int> key = toKey(l);
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    entries.emplace(key, entry);
+}
+
+size_t PatternCache::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return entries.size();
+}
+
+void PatternCache::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    entries.clear();
+}
+
+bool PatternCache::load(const std::string& filename)
+{
+    std::ifstream stream(filename, std::ios::binary | std::ios::ate);
+    if (!stream.is_open())
+        return false;
+    const std::streamoff end = stream.tellg();
+    stream.seekg(0);
+    const uint64_t fileSize = end > 0 ? static_cast<uint64_t>(end) : 0;
+
+    const std::string magic(PATTERNCACHEMAGIC);
+    std::string fileMagic(magic.size(), '\0');
+    stream.read(&fileMagic[0], magic.size());
+    uint32_t version;
+    uint64_t numEntries;
+    bool valid = stream && fileMagic == magic &&
+            readValue(stream, version) && version == PATTERNCACHEVERSION &&
+            readValue(stream, numEntries);
+
+    std::map<std::vector<int>, PatternCacheEntry> loadedEntries;
+    for (uint64_t e = 0; valid && e < numEntries; e++) {
+        std::vector<int> key;
+        PatternCacheEntry entry;
+        valid = readEntry(stream, fileSize, key, entry);
+        if (valid)
+            loadedEntries.emplace(key, entry);
+    }
+
+    if (!valid) {
+        std::cout << "Pattern cache " << filename << " is not valid. It will be ignored." << std::endl;
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    entries.merge(loadedEntries);
+
+    return true;
+}
+
+//Written to a temporary file renamed at the end, so that concurrent jobs
+//saving the same cache never interleave and a reader never sees a partial file
+bool PatternCache::save(const std::string& filename) const
+{
+    std::ostringstream tmpName;
+    tmpName << filename << ".tmp." << std::hash<std::thread::id>()(std::this_thread::get_id())
+            << "." << std::chrono::steady_clock::now().time_since_epoch().count();
+    const std::string tmpFilename = tmpName.str();
+
+    std::ofstream stream(tmpFilename, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open())
+        return false;
+
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        const std::string magic(PATTERNCACHEMAGIC);
+        stream.write(magic.data(), magic.size());
+        writeValue(stream, static_cast<uint32_t>(PATTERNCACHEVERSION));
+        writeValue(stream, static_cast<uint64_t>(entries.size()));
+
+        for (const std::pair<const std::vector<int>, PatternCacheEntry>& it : entries) {
+            const std::vector<int>& key = it.first;
+            const PatternCacheEntry& entry = it.second;
+
+            writeValue(stream, static_cast<uint32_t>(key.size()));
+            for (const int& value : key) {
+                writeValue(stream, static_cast<int32_t>(value));
+            }
+
+            writeValue(stream, static_cast<uint64_t>(entry.patchV.rows()));
+            for (int i = 0; i < entry.patchV.rows(); i++) {
+                for (int j = 0; j < 3; j++) {
+                    writeValue(stream, entry.patchV(i, j));
+                }
+            }
+
+            writeValue(stream, static_cast<uint64_t>(entry.patchF.rows()));
+            for (int i = 0; i < entry.patchF.rows(); i++) {
+                for (int j = 0; j < 4; j++) {
+                    writeValue(stream, static_cast<int32_t>(entry.patchF(i, j)));
+                }
+            }
+
+            writeIndices(stream, entry.borders);
+            writeIndices(stream, entry.corners);
+            for (const std::vector<size_t>& side : entry.sides) {
+                writeIndices(stream, side);
+            }
+        }
+    }
+
+    stream.close();
+    if (!stream || std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        std::remove(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+}
+}
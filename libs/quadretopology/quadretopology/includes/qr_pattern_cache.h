@@ -0,0 +1,97 @@
+/***************************************************************************/
+/* Copyright(C) 2021
+
+
+The authors of
+
+Reliable Feature-Line Driven Quad-Remeshing
+Siggraph 2021
+
+
+ All rights reserved.
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+****************************************************************************/
+
+#ifndef QR_PATTERN_CACHE_H
+#define QR_PATTERN_CACHE_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <atomic>
+#include <shared_mutex>
+
+#include <Eigen/Core>
+
+#include <nlohmann/json.hpp>
+
+namespace QuadRetopology {
+namespace internal {
+
+struct PatternCacheEntry {
+    Eigen::MatrixXd patchV;
+    Eigen::MatrixXi patchF;
+    std::vector<size_t> borders;
+    std::vector<size_t> corners;
+    std::vector<std::vector<size_t>> sides;
+};
+
+struct PatternCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t size = 0;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(PatternCacheStats,
+                                   hits,
+                                   misses,
+                                   size)
+
+//Lookups of one quadrangulation. The cache is shared by the concurrent jobs of
+//the process, so each call counts its own hits and misses
+struct PatternCacheCounters {
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+};
+
+//Thread-safe cache of the patterns computed by patchgen. The patterns are stored
+//for the canonical rotation of the subdivision vector l (the lexicographically
+//smallest one) and they are rotated back on lookup
+class PatternCache {
+
+public:
+    static PatternCache& instance();
+
+    bool find(const Eigen::VectorXi& l, PatternCacheEntry& entry, PatternCacheCounters* counters = nullptr);
+    void insert(const Eigen::VectorXi& l, const PatternCacheEntry& entry);
+
+    size_t size() const;
+    void clear();
+
+    bool load(const std::string& filename);
+    bool save(const std::string& filename) const;
+
+    static int canonicalRotation(const Eigen::VectorXi& l);
+    static Eigen::VectorXi rotate(const Eigen::VectorXi& l, const int rotation);
+    static void rotate(const PatternCacheEntry& canonicalEntry, const int rotation, PatternCacheEntry& entry);
+
+private:
+    mutable std::shared_mutex mutex;
+    std::map<std::vector<int>, PatternCacheEntry> entries;
+};
+
+}
+}
+
+#endif // QR_PATTERN_CACHE_H
@@ -28,6 +28,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "qr_convert.h"
 
 #include <patterns/generate_patch.h>
+#include <patterns/patchgen/decl.h>
 
 namespace QuadRetopology {
 namespace internal {
@@ -40,8 +41,42 @@ void computePattern(
         PolyMesh& patchMesh,
         std::vector<size_t>& borders,
         std::vector<size_t>& corners,
-        std::vector<std::vector<size_t>>& sides)
+        std::vector<std::vector<size_t>>& sides,
+        PatternCache* cache,
+        PatternCacheCounters* counters)
 {
+    if (cache != nullptr) {
+        PatternCacheEntry entry;
+        if (!cache->find(l, entry, counters)) {
+            //Compute the pattern of the canonical rotation, so that the cached
+            //entry does not depend on which rotation has been requested first
+            const int rotation = PatternCache::canonicalRotation(l);
+            const Eigen::VectorXi canonicalL = PatternCache::rotate(l, rotation);
+
+            PatternCacheEntry canonicalEntry;
+            PolyMesh canonicalMesh;
+            computePattern(canonicalL, canonicalEntry.patchV, canonicalEntry.patchF, canonicalMesh, canonicalEntry.borders, canonicalEntry.corners, canonicalEntry.sides);
+
+            if (canonicalEntry.sides.size() != static_cast<size_t>(l.size()))
+                return;
+
+            cache->insert(canonicalL, canonicalEntry);
+            PatternCache::rotate(canonicalEntry, rotation, entry);
+        }
+
+        patchV = entry.patchV;
+        patchF = entry.patchF;
+        borders = entry.borders;
+        corners = entry.corners;
+        sides = entry.sides;
+
+        eigenToVCG(patchV, patchF, patchMesh, 4, 3);
+
+        vcg::tri::UpdateTopology<PolyMesh>::FaceFace(patchMesh);
+
+        return;
+    }
+
     long int num_sides = l.size();
     if (num_sides < 2 || 6 < num_sides) {
         std::cout << "num_sides=" << num_sides << " is unsupported.\n";
@@ -135,5 +170,19 @@ void computePattern(
     } while (cId != startCornerId);
 }
 
+//The constraint matrices and the variable indicators of the patterns are lazily
+//initialized static tables: build them all before calling computePattern from
+//multiple threads
+inline void initPatternTables()
+{
+    const int numPatterns[] = { 2, 4, 5, 5, 4 };
+    for (int numSides = 2; numSides <= 6; numSides++) {
+        for (int patternId = 0; patternId < numPatterns[numSides - 2]; patternId++) {
+            patchgen::get_constraint_matrix(numSides, patternId);
+            patchgen::get_variable_indicators(numSides, patternId);
+        }
+    }
+}
+
 }
 }
@@ -30,6 +30,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <Eigen/Core>
 
+#include "qr_pattern_cache.h"
+
 namespace QuadRetopology {
 namespace internal {
 
@@ -41,7 +43,11 @@ void computePattern(
         PolyMesh& patchMesh,
         std::vector<size_t>& borders,
         std::vector<size_t>& corners,
-        std::vector<std::vector<size_t>>& sides);
+        std::vector<std::vector<size_t>>& sides,
+        PatternCache* cache = nullptr,
+        PatternCacheCounters* counters = nullptr);
+
+inline void initPatternTables();
 
 }
 }
@@ -31,6 +31,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <vector>
 #include <memory>
 #include <optional>
+#include <exception>
+#include <chrono>
 
 #include <libsatsuma/Problems/BiMDF.hh>
 #include <libsatsuma/Extra/Highlevel.hh>
@@ -51,6 +53,12 @@ struct FlowProblem {
     std::vector<Edge> unpaired_edges;
     std::vector<Edge> paired_edges;
     std::vector<Edge> pair_unaligners;
+    std::vector<bool> chart_mask; // empty if the network covers all charts
+    // per chart, per inner connection: the free edges carrying the throughflow
+    std::vector<std::vector<std::vector<Edge>>> chart_inner_edges;
+    Edge boundary_loop = lemon::INVALID;
+    // constant part of the costs dropped when contracting the network
+    double cost_offset = 0;
 };
 
 #define EMERGENCY 1
@@ -122,12 +130,20 @@ static FlowProblem make_bimdf(
         const std::vector<bool> &satisfied_regularity,
         /// empty or per-pair satisfaction
         //const std::vector<bool> &satisfied_alignment
+        /// empty or per-chart: only build the network for these charts
+        const std::vector<bool> &chart_mask,
+        /// empty or per-subside: given value (>= 0) or free
+        const std::vector<int> &fixed_subsides,
         const FlowProblem *previous_problem = nullptr,
         const Satsuma::BiMDF::Solution *previous_sol = nullptr
         )
 {
     assert(satisfied_regularity.empty() || satisfied_regularity.size() == chart_data.charts.size());
+    assert(chart_mask.empty() || chart_mask.size() == chart_data.charts.size());
 
+    auto in_mask = [&](int id) -> bool {
+        return id == -1 || chart_mask.empty() || chart_mask[id];
+    };
     auto should_use_chart = [&](int id) -> bool {
         if (id == -1) { // boundary
             return true;
@@ -140,6 +156,12 @@ static FlowProblem make_bimdf(
     std::cout << "using " << spi.pairs.size() << " singularity pairs" << std::endl;
 
     FlowProblem problem;
+    problem.chart_mask = chart_mask;
+    problem.chart_inner_edges.resize(chart_data.charts.size());
+
+    // warm start: use the previous flow as guess for the free edges,
+    // the initial rounding of the solver starts from the guesses.
+    const bool warm_start = parameters.flowWarmStart && previous_problem && previous_sol;
 
     auto& bimdf = *problem.bimdf;
     auto &g = bimdf.g;
@@ -162,8 +184,10 @@ static FlowProblem make_bimdf(
     // 1 edge per subside: connect incident side nodes (free)
     //
     // side nodes aid simple implementation, but increase network size.
-    //    TODO PERF: if a side has only 1 subside, we can skip the side node.
-    //    alternatively, we might want to simplify using a postprocess in libsatsuma?
+    //    the side nodes are where the inner edges of the chart attach, but the
+    //    inner node of an unpaired subside only passes the flow from one quadratic
+    //    cost to the other: with flowContractNetwork, we merge the two into a single
+    //    edge (see below).
 
     // TODO: reserve emergency_neighbor_per_valence
     // TODO: reserve emergency_sideloops_per_valence
@@ -196,7 +220,24 @@ static FlowProblem make_bimdf(
                            .lower = lower, // subsides must be quantized to >= 1
                            .upper = BiMDF::inf()});
     };
-    // TODO PERF:  g.reserveNode(..); g.reserveEdge(..);
+    {
+        // upper bound of the network size
+        size_t n_nodes = 1;
+        size_t n_edges = 1;
+        for (size_t chart_id = 0; chart_id < chart_data.charts.size(); ++chart_id)
+        {
+            if (!in_mask(chart_id) || !should_use_chart(chart_id)) {
+                continue;
+            }
+            const size_t valence = chart_data.charts[chart_id].chartSides.size();
+            n_nodes += 2 * valence;
+            n_edges += 10 * valence + 12;
+        }
+        n_nodes += 2 * chart_data.subsides.size();
+        n_edges += 6 * chart_data.subsides.size();
+        g.reserveNode(n_nodes);
+        g.reserveEdge(n_edges);
+    }
 
     std::vector<std::vector<Node>> chart_side_nodes(chart_data.charts.size());
     std::vector<std::vector<std::array<Node,2>>> chart_side_node_pairs(chart_data.charts.size());
@@ -205,6 +246,9 @@ static FlowProblem make_bimdf(
     for (size_t chart_id = 0; chart_id < chart_data.charts.size(); ++chart_id)
     {
         const Chart& chart = chart_data.charts.at(chart_id);
+        if (!in_mask(chart_id)) {
+            continue;
+        }
         if (!should_use_chart(chart_id)) {
             ++n_unused_charts;
             continue;
@@ -252,14 +296,30 @@ static FlowProblem make_bimdf(
         }
 
 
-        auto connect_chart_sides = [&](Node a, Node b, BiMDF::TargetScalar estimate, size_t valence) {
+        auto connect_chart_sides = [&](Node a, Node b, BiMDF::TargetScalar estimate, size_t valence,
+                                       std::vector<Edge> &out_edges,
+                                       const std::vector<Edge> &old_edges, size_t n_connections) {
             assert (a != lemon::INVALID);
             assert (b != lemon::INVALID);
 
-            bimdf.add_edge({.u=a, .v=b, .u_head=false, .v_head=false,
+            if (!old_edges.empty()) {
+                // the same connections as before take over their old flow one by one,
+                // a dropped pair sums up the flow of its connections
+                if (old_edges.size() == n_connections) {
+                    estimate = (*previous_sol)[old_edges[out_edges.size()]];
+                } else {
+                    estimate = 0;
+                    for (const auto &e: old_edges) {
+                        estimate += (*previous_sol)[e];
+                    }
+                    estimate /= n_connections;
+                }
+            }
+            auto free_edge = bimdf.add_edge({.u=a, .v=b, .u_head=false, .v_head=false,
                             .cost_function = Satsuma::CostFunction::Zero{.guess=estimate},
                             .lower=(valence == 4 ? 0 : 1),
                             .upper=bimdf.inf()});
+            out_edges.push_back(free_edge);
             if (valence != 4 // no costs here in ILP formulation
     #if 0
                     && valence !=6 // ILP formulation only allows parity >= 6, this approximates it, but is too limiting
@@ -390,6 +450,8 @@ static FlowProblem make_bimdf(
         // a valance-4 patch will visit the same side/other pairs twice if we loop until "valence",
         // avoid that:
         const size_t n_inner_edges = valence == 4 ? 2: valence;
+        auto &inner_edges = problem.chart_inner_edges[chart_id];
+        inner_edges.resize(n_inner_edges);
         for (size_t side_idx = 0; side_idx < n_inner_edges; side_idx++) {
             const ChartSide& this_side = chart.chartSides.at(side_idx);
             auto this_target= this_side.length / chart_edge_length[chart_id];
@@ -399,28 +461,35 @@ static FlowProblem make_bimdf(
             // estimate likely throughflow to set a decent target for initial rounding
             auto estimate = .25 * (this_target + other_target);
 
+            const size_t n_connections = (valence == 4 && side_paired[side_idx] && side_paired[other_idx]) ? 2 : 1;
+            static const std::vector<Edge> no_edges;
+            const auto &old_edges = (warm_start && previous_problem->chart_inner_edges[chart_id].size() == n_inner_edges)
+                    ? previous_problem->chart_inner_edges[chart_id][side_idx]
+                    : no_edges;
+
+            auto &out_edges = inner_edges[side_idx];
             if (side_paired[side_idx]) {
                 if (side_paired[other_idx]) {
                     // both paired:
-                    connect_chart_sides(side_node_pairs[side_idx][1], side_node_pairs[other_idx][0], estimate, valence);
+                    connect_chart_sides(side_node_pairs[side_idx][1], side_node_pairs[other_idx][0], estimate, valence, out_edges, old_edges, n_connections);
                     if (valence == 4) { // because we only loop 2 times, not 4 - connect both!
-                        connect_chart_sides(side_node_pairs[side_idx][0], side_node_pairs[other_idx][1], estimate, valence);
+                        connect_chart_sides(side_node_pairs[side_idx][0], side_node_pairs[other_idx][1], estimate, valence, out_edges, old_edges, n_connections);
                     }
                 } else {
                     assert(valence != 4);
                     // side paired, other regular
-                    connect_chart_sides(side_node_pairs[side_idx][1], side_nodes[other_idx], estimate, valence);
+                    connect_chart_sides(side_node_pairs[side_idx][1], side_nodes[other_idx], estimate, valence, out_edges, old_edges, n_connections);
                 }
             } else {
                 if (side_paired[other_idx]) {
                     // side regular, other paired
                     assert(valence != 4);
                     // use other-0, as the iteration where the current other_idx is side_idx will connect other-1:
-                    connect_chart_sides(side_node_pairs[other_idx][0], side_nodes[side_idx], estimate, valence);
+                    connect_chart_sides(side_node_pairs[other_idx][0], side_nodes[side_idx], estimate, valence, out_edges, old_edges, n_connections);
                 } else {
                     // TODO: is this edge is added twice?
                     // no pairing:
-                    connect_chart_sides(side_nodes[side_idx], side_nodes[other_idx], estimate, valence);
+                    connect_chart_sides(side_nodes[side_idx], side_nodes[other_idx], estimate, valence, out_edges, old_edges, n_connections);
                 }
             }
         }
@@ -430,6 +499,7 @@ static FlowProblem make_bimdf(
 
     Node boundary = bimdf.add_node();
     double bnd_target = 0;
+    size_t n_contracted = 0;
 
     for (size_t subside_id = 0; subside_id < chart_data.subsides.size(); subside_id++)
     {
@@ -441,6 +511,36 @@ static FlowProblem make_bimdf(
         int left_side_idx = subside.incidentChartSideId[0];
         int right_side_idx = subside.incidentChartSideId[1];
 
+        auto &edges = problem.subside_edges[subside_id];
+
+        const int fixed_value = fixed_subsides.empty() ? -1 : fixed_subsides[subside_id];
+        if (fixed_value >= 0) {
+            // the flow through the subside is given: each incident chart we solve for
+            // receives it from the boundary node. This keeps the balance of the charts
+            // unchanged, the parity of the boundary node follows from the one of the charts.
+            for (int i = 0; i < 2; ++i) {
+                const int chart_id = subside.incidentCharts[i];
+                if (chart_id == -1 || !in_mask(chart_id) || !should_use_chart(chart_id)) {
+                    continue;
+                }
+                const int side_idx = subside.incidentChartSideId[i];
+                assert(!spi.paired_sides[chart_id][side_idx]);
+                auto e = bimdf.add_edge({.u = chart_side_nodes.at(chart_id).at(side_idx), .v = boundary,
+                                         .u_head = true, .v_head = true,
+                                         .cost_function = Satsuma::CostFunction::Zero{.guess = static_cast<double>(fixed_value)},
+                                         .lower = fixed_value, .upper = fixed_value});
+                if (edges[0] == lemon::INVALID) {
+                    edges[0] = e;
+                }
+                bnd_target += fixed_value;
+            }
+            continue;
+        }
+
+        if (!in_mask(left_chart_id) || !in_mask(right_chart_id)) {
+            // belongs to another component
+            continue;
+        }
         if (!should_use_chart(left_chart_id) || !should_use_chart(right_chart_id)) {
             // if this really happens, we should probably constrain all its subsides to 0?
             std::cerr << "WARNING: should not use chart!" << std::endl;
@@ -479,7 +579,6 @@ static FlowProblem make_bimdf(
         double avg_valence = .5 * (left_n_subsides + right_n_subsides);
         double unaligned_cost = regularity_weight * parameters.alignSingularitiesWeight * .5 / avg_valence;
 
-        auto &edges = problem.subside_edges[subside_id];
         if (right_chart_id == -1) {
             if (left_paired) {
                 assert(false); // this should never happen
@@ -595,11 +694,26 @@ static FlowProblem make_bimdf(
 #endif
 
             } else if (!left_paired && !right_paired) {
-                Node inter = bimdf.add_node(); // only used to model sum of quadratic functions
-                edges[0] = add_subside_edge(left_single, true, inter, true, left_target, left_iso_weight);
-                auto other_edge = add_subside_edge(inter, false, right_single, true, right_target, right_iso_weight);
-                problem.unpaired_edges.push_back(edges[0]);
-                problem.unpaired_edges.push_back(other_edge);
+                if (parameters.flowContractNetwork) {
+                    // both halves carry the same flow, use a single edge with the sum of their costs:
+                    // wl * (x-tl)^2 + wr * (x-tr)^2 = (wl+wr) * (x-t)^2 + wl*wr/(wl+wr) * (tl-tr)^2
+                    double weight = left_iso_weight + right_iso_weight;
+                    double target = .5 * (left_target + right_target);
+                    if (weight > 0) {
+                        target = (left_iso_weight * left_target + right_iso_weight * right_target) / weight;
+                        double diff = left_target - right_target;
+                        problem.cost_offset += left_iso_weight * right_iso_weight / weight * diff * diff;
+                    }
+                    edges[0] = add_subside_edge(left_single, true, right_single, true, target, weight);
+                    problem.unpaired_edges.push_back(edges[0]);
+                    ++n_contracted;
+                } else {
+                    Node inter = bimdf.add_node(); // only used to model sum of quadratic functions
+                    edges[0] = add_subside_edge(left_single, true, inter, true, left_target, left_iso_weight);
+                    auto other_edge = add_subside_edge(inter, false, right_single, true, right_target, right_iso_weight);
+                    problem.unpaired_edges.push_back(edges[0]);
+                    problem.unpaired_edges.push_back(other_edge);
+                }
             } else if (!left_paired && right_paired) {
                 assert(false); // i think this case should not happen.
             } else if ( left_paired && !right_paired) {
@@ -607,15 +721,23 @@ static FlowProblem make_bimdf(
             }
         }
     }
-    [[maybe_unused]] auto bnd_loop = bimdf.add_edge({ .u = boundary,
+    double bnd_guess = bnd_target / 2;
+    if (warm_start && previous_problem->boundary_loop != lemon::INVALID) {
+        bnd_guess = (*previous_sol)[previous_problem->boundary_loop];
+    }
+    problem.boundary_loop = bimdf.add_edge({ .u = boundary,
                      .v = boundary,
                      .u_head = false,
                      .v_head = false,
-                     .cost_function = Satsuma::CostFunction::Zero{.guess=bnd_target/2}
+                     .cost_function = Satsuma::CostFunction::Zero{.guess=bnd_guess}
                    });
     std::cout << "\tbimdf problem: "
               << g.maxNodeId() + 1 << " nodes, "
-              << g.maxArcId() + 1 << " arcs.\n";
+              << g.maxArcId() + 1 << " arcs";
+    if (n_contracted > 0) {
+        std::cout << ", " << n_contracted << " pass-through nodes contracted";
+    }
+    std::cout << ".\n";
 
     return problem;
 
@@ -624,11 +746,16 @@ static FlowProblem make_bimdf(
 
 bool is_valid_quantisation(
         const ChartData& chart_data,
-        const std::vector<int>& lens)
+        const std::vector<int>& lens,
+        /// empty or per-chart: only check these charts
+        const std::vector<bool>& chart_mask = {})
 {
     bool valid = true;
     for (size_t chart_id = 0; chart_id < chart_data.charts.size(); ++chart_id)
     {
+        if (!chart_mask.empty() && !chart_mask[chart_id]) {
+            continue;
+        }
         const Chart& chart = chart_data.charts.at(chart_id);
         size_t boundary_sum = 0;
         for (size_t side_idx = 0; side_idx < chart.chartSides.size(); side_idx++) {
@@ -661,6 +788,83 @@ bool is_valid_quantisation(
 
 
 
+/// Group the charts in connected components, charts only interact through
+/// the subsides they share. Components with less than min_charts charts are
+/// gathered in a single group, as they are not worth a solver call each.
+/// Subsides with a given value do not connect charts.
+/// Returns one chart mask per group, or the mask of all the computable
+/// charts (empty if all) if there is nothing to split.
+static std::vector<std::vector<bool>> find_flow_components(
+        const ChartData& chart_data,
+        const std::vector<bool>& computable,
+        const std::vector<int>& fixed_subsides,
+        size_t min_charts)
+{
+    const size_t n_charts = chart_data.charts.size();
+    std::vector<int> component(n_charts, -1);
+    std::vector<std::vector<size_t>> components;
+
+    auto is_free_chart = [&](int chart_id) -> bool {
+        return component[chart_id] == -1
+                && !chart_data.charts[chart_id].faces.empty()
+                && (computable.empty() || computable[chart_id]);
+    };
+
+    for (size_t start_id = 0; start_id < n_charts; ++start_id)
+    {
+        if (!is_free_chart(start_id)) {
+            continue;
+        }
+        const int component_id = components.size();
+        components.emplace_back();
+        std::vector<size_t> stack = {start_id};
+        component[start_id] = component_id;
+        while (!stack.empty()) {
+            size_t chart_id = stack.back();
+            stack.pop_back();
+            components.back().push_back(chart_id);
+            for (const auto subside_id: chart_data.charts[chart_id].chartSubsides) {
+                if (!fixed_subsides.empty() && fixed_subsides[subside_id] >= 0) {
+                    continue;
+                }
+                for (const int adj_id: chart_data.subsides[subside_id].incidentCharts) {
+                    if (adj_id < 0 || !is_free_chart(adj_id)) {
+                        continue;
+                    }
+                    component[adj_id] = component_id;
+                    stack.push_back(adj_id);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<bool>> masks;
+    int small_group = -1;
+    for (const auto &charts: components) {
+        int group;
+        if (charts.size() < min_charts) {
+            if (small_group == -1) {
+                small_group = masks.size();
+                masks.emplace_back(n_charts, false);
+            }
+            group = small_group;
+        } else {
+            group = masks.size();
+            masks.emplace_back(n_charts, false);
+        }
+        for (const auto chart_id: charts) {
+            masks[group][chart_id] = true;
+        }
+    }
+    std::cout << "flow: " << components.size() << " connected components, "
+              << masks.size() << " problems." << std::endl;
+
+    if (masks.size() <= 1) {
+        return {computable};
+    }
+    return masks;
+}
+
 #define ILP_FIND_SUBDIVISION -1
 #define ILP_IGNORE -2
 
@@ -706,19 +910,49 @@ FlowResult findSubdivisionsFlow(
     HSW sw_singularity_pairs{"find_singularity_pairs", sw_root};
     HSW sw_setup{"setup", sw_root};
     HSW sw_analysis{"analysis", sw_root};
+    HSW sw_solve_initial{"solve_initial", sw_root};
+    HSW sw_solve_resolve{"solve_resolve", sw_root};
+    HSW sw_solve_resolve_cold{"solve_resolve_cold", sw_root};
     sw_root.resume();
+    const auto start = std::chrono::steady_clock::now();
 
     auto flow_config = get_json_config<FlowConfig>(parameters.flow_config_filename);
     auto satsuma_config = get_json_config<Satsuma::BiMDFSolverConfig>(parameters.satsuma_config_filename);
 
     std::vector<FlowStats> stats;
 
+    // subsides can be free, given (>= 0) or belong to another cluster (ignored),
+    // charts incident to an ignored subside are not solved for.
     assert(out_results.size() == chart_data.subsides.size());
+    const std::vector<int> fixed_subsides = out_results;
+    std::vector<bool> computable;
     for (size_t subside_id = 0; subside_id < out_results.size(); ++subside_id)
     {
         auto val = out_results[subside_id];
-        assert (val == ILP_FIND_SUBDIVISION); // we don't handle anything else yet
+        if (val == ILP_IGNORE) {
+            if (computable.empty()) {
+                computable.resize(chart_data.charts.size(), true);
+            }
+            for (const int chart_id: chart_data.subsides[subside_id].incidentCharts) {
+                if (chart_id >= 0) {
+                    computable[chart_id] = false;
+                }
+            }
+        } else if (val != ILP_FIND_SUBDIVISION && val < 0) {
+            throw std::runtime_error("flow: invalid input value for subside " + std::to_string(subside_id));
+        }
     }
+    auto is_computable = [&](size_t chart_id) -> bool {
+        return computable.empty() || computable[chart_id];
+    };
+    auto is_fixed_side = [&](size_t chart_id, int side_idx) -> bool {
+        for (const auto subside_id: chart_data.charts[chart_id].chartSides.at(side_idx).subsides) {
+            if (fixed_subsides[subside_id] >= 0) {
+                return true;
+            }
+        }
+        return false;
+    };
 
     std::vector<bool> satisfied_regularity;
     std::vector<bool> satisfied_alignment;
@@ -730,15 +964,34 @@ FlowResult findSubdivisionsFlow(
                   spi.paired_sides.end(),
                 PairedSides{false,false,false,false,false, false});
         spi.pairs.clear();
+    } else {
+        // only align singularities in the charts we solve for, along free subsides
+        std::vector<bool> keep_pair(spi.pairs.size(), true);
+        bool drop_pairs = false;
+        for (size_t pair_id = 0; pair_id < spi.pairs.size(); ++pair_id)
+        {
+            const auto &pair = spi.pairs[pair_id];
+            bool keep = true;
+            for (int i = 0; i < 2; ++i) {
+                keep = keep && is_computable(pair.charts[i]) && !is_fixed_side(pair.charts[i], pair.side_idx[i]);
+            }
+            for (const auto &quad: pair.quads) {
+                for (int i = 0; i < 2; ++i) {
+                    keep = keep && is_computable(quad.chart) && !is_fixed_side(quad.chart, quad.side_idx[i]);
+                }
+            }
+            keep_pair[pair_id] = keep;
+            drop_pairs = drop_pairs || !keep;
+        }
+        if (drop_pairs) {
+            spi.remove_unaligned_pairs(keep_pair);
+        }
     }
 
 
 
     std::vector<Satsuma::BiMDFFullResult> bimdf_results;
-    auto solve_and_apply = [&](FlowProblem const &problem) {
-
-        std::cout << "\nflow problem setup complete, solving..." << std::endl;
-        auto res = solve_bimdf(*problem.bimdf, satsuma_config);
+    auto apply = [&](FlowProblem const &problem, Satsuma::BiMDFFullResult &&res) {
 
         const auto &sol = *res.solution.get();
         bimdf_results.push_back(std::move(res));
@@ -747,14 +1000,18 @@ FlowResult findSubdivisionsFlow(
         if (!problem.bimdf->is_valid(sol)) {
             throw std::runtime_error("Internal error: BiMDF solution invalid");
         }
-        double bimdf_cost = problem.bimdf->cost(sol);
+        double bimdf_cost = problem.bimdf->cost(sol) + problem.cost_offset;
         std::cout << "flow solved. cost:  " << bimdf_cost << std::endl;
 
         assert(out_results.size() == chart_data.subsides.size());
         for (size_t i = 0; i < out_results.size(); ++i) {
             const auto &edges = problem.subside_edges[i];
 
-            assert (edges[0] != lemon::INVALID);
+            if (edges[0] == lemon::INVALID) {
+                // subside of another component or given value outside of the problem
+                assert(!problem.chart_mask.empty() || fixed_subsides[i] >= 0);
+                continue;
+            }
             auto val = sol[edges[0]];
 
             if (edges[1] != lemon::INVALID) {
@@ -797,7 +1054,7 @@ FlowResult findSubdivisionsFlow(
         //debug_costs(problem.emergency_sideloops_per_valence[5]);
         stats.push_back(FlowStats{
                             .n_pair_unaligners_used = count_uses(problem.pair_unaligners),
-                            .cost_iso_nonpaired = sum_costs(problem.unpaired_edges),
+                            .cost_iso_nonpaired = sum_costs(problem.unpaired_edges) + problem.cost_offset,
                             .cost_iso_paired = sum_costs(problem.paired_edges),
                             .cost_regularity_neighbor_v3 = sum_costs(problem.emergency_neighbor_per_valence[3]),
                             .cost_regularity_neighbor_v4 = sum_costs(problem.emergency_neighbor_per_valence[4]),
@@ -831,12 +1088,50 @@ FlowResult findSubdivisionsFlow(
                       << ")." << std::endl;
         }
 #endif
+    };
 
-        if (is_valid_quantisation(chart_data, out_results)) {
+    /// solve the independent problems concurrently
+    auto solve_all = [&](std::vector<FlowProblem> const &problems, HSW &sw_solve) {
+
+        std::cout << "\nflow problem setup complete, solving "
+                  << problems.size() << " problem(s)..." << std::endl;
+
+        Timekeeper::ScopedStopWatch _{sw_solve};
+        std::vector<std::optional<Satsuma::BiMDFFullResult>> results(problems.size());
+        std::vector<std::exception_ptr> errors(problems.size());
+#pragma omp parallel for schedule(dynamic, 1) if(problems.size() > 1)
+        for (int i = 0; i < static_cast<int>(problems.size()); ++i) {
+            try {
+                results[i].emplace(solve_bimdf(*problems[i].bimdf, satsuma_config));
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+        for (size_t i = 0; i < problems.size(); ++i) {
+            if (errors[i]) {
+                std::rethrow_exception(errors[i]);
+            }
+        }
+        return results;
+    };
+
+    /// solve the independent problems, then apply the solutions in order
+    /// returns the wall time of the solve in seconds
+    auto solve_and_apply = [&](std::vector<FlowProblem> const &problems, HSW &sw_solve) -> double {
+        const auto solve_start = std::chrono::steady_clock::now();
+        auto results = solve_all(problems, sw_solve);
+        const std::chrono::duration<double> solve_time = std::chrono::steady_clock::now() - solve_start;
+
+        for (size_t i = 0; i < problems.size(); ++i) {
+            apply(problems[i], std::move(*results[i]));
+        }
+
+        if (is_valid_quantisation(chart_data, out_results, computable)) {
             //std::cout << "\tvalidation of hard constraints successful." << std::endl;
         } else {
             throw std::runtime_error("flow quantisation resulted in infeasible result.");
         }
+        return solve_time.count();
     };
 
 
@@ -857,6 +1152,10 @@ FlowResult findSubdivisionsFlow(
         size_t n_unsat_reg = 0;
         for (size_t chart_id = 0; chart_id < chart_data.charts.size(); ++chart_id)
         {
+            if (!is_computable(chart_id)) {
+                satisfied_regularity[chart_id] = true;
+                continue;
+            }
             const size_t valence = chart_data.charts[chart_id].chartSides.size();
             // NB: 1 is still okay, it means the singlarity is on the boundary
             int max_ok = valence == 4 ? 0 : 1;
@@ -919,38 +1218,76 @@ FlowResult findSubdivisionsFlow(
 
     sw_setup.resume();
 
-    FlowProblem problem = make_bimdf(
-            flow_config,
-            chart_data,
-            chart_edge_length,
-            parameters,
-            spi,
-            satisfied_regularity);
-    sw_setup.stop();
-
-    solve_and_apply(problem);
+    std::vector<std::vector<bool>> chart_masks = {computable};
+    if (parameters.flowParallelComponents) {
+        chart_masks = find_flow_components(chart_data, computable, fixed_subsides, parameters.flowMinComponentCharts);
+    }
 
-    sw_analysis.resume();
-    std::cout << "\nflow round one finished. stats:\n"
-              << evaluate_quantization(chart_data, chart_edge_length, parameters, out_results)
-              << std::endl;
-    sw_analysis.stop();
-    bool updated = update_satisfaction();
-    if (updated) {
-        // TODO PERF: pass old solution as x0 (need to handle dropped alignment constraints!)
-        sw_setup.resume();
-        auto new_problem = make_bimdf(
+    std::vector<FlowProblem> problems;
+    problems.reserve(chart_masks.size());
+    for (const auto &chart_mask: chart_masks) {
+        problems.push_back(make_bimdf(
                 flow_config,
                 chart_data,
                 chart_edge_length,
                 parameters,
                 spi,
                 satisfied_regularity,
-                &problem,
-                bimdf_results.back().solution.get());
+                chart_mask,
+                fixed_subsides));
+    }
+    sw_setup.stop();
+
+    const double initial_solve_time = solve_and_apply(problems, sw_solve_initial);
 
-        sw_setup.stop();
-        solve_and_apply(new_problem);
+    if (computable.empty()) {
+        sw_analysis.resume();
+        std::cout << "\nflow round one finished. stats:\n"
+                  << evaluate_quantization(chart_data, chart_edge_length, parameters, out_results)
+                  << std::endl;
+        sw_analysis.stop();
+    }
+    bool updated = update_satisfaction();
+    bool resolve_skipped = false;
+    //the resolve costs about as much as the initial solve: with a time limit,
+    //keep the initial solution if there is no time left for it
+    if (updated && parameters.flowTimeLimit > 0 &&
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() + initial_solve_time > parameters.flowTimeLimit) {
+        std::cout << "flow resolve skipped: " << initial_solve_time << "s would exceed the time limit of "
+                  << parameters.flowTimeLimit << "s." << std::endl;
+        updated = false;
+        resolve_skipped = true;
+    }
+    if (updated) {
+        // with flowWarmStart, the previous solution is used as starting point
+        auto make_new_problems = [&](const Parameters &new_parameters) {
+            Timekeeper::ScopedStopWatch _{sw_setup};
+            std::vector<FlowProblem> new_problems;
+            new_problems.reserve(problems.size());
+            for (size_t i = 0; i < problems.size(); ++i) {
+                new_problems.push_back(make_bimdf(
+                        flow_config,
+                        chart_data,
+                        chart_edge_length,
+                        new_parameters,
+                        spi,
+                        satisfied_regularity,
+                        chart_masks[i],
+                        fixed_subsides,
+                        &problems[i],
+                        bimdf_results[i].solution.get()));
+            }
+            return new_problems;
+        };
+
+        if (parameters.flowWarmStart && parameters.flowMeasureWarmStart) {
+            // the same problems without the previous flow as guesses: comparing
+            // solve_resolve_cold with solve_resolve gives what the warm start saves
+            Parameters cold_parameters = parameters;
+            cold_parameters.flowWarmStart = false;
+            solve_all(make_new_problems(cold_parameters), sw_solve_resolve_cold);
+        }
+        solve_and_apply(make_new_problems(parameters), sw_solve_resolve);
     }
 
     out_gap = 0;
@@ -967,6 +1304,7 @@ FlowResult findSubdivisionsFlow(
 
     return {.bimdf_results = std::move(bimdf_results),
             .stats = std::move(stats),
+            .resolveSkipped = resolve_skipped,
             .stopwatch = std::move(sw_result)};
 }
 
@@ -80,6 +80,7 @@ NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(FlowStats,
 struct FlowResult {
     std::vector<Satsuma::BiMDFFullResult> bimdf_results;
     std::vector<FlowStats> stats;
+    bool resolveSkipped = false; // the resolve did not fit in flowTimeLimit
     Timekeeper::HierarchicalStopWatchResult stopwatch;
 };
 
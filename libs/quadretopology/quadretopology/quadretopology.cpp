@@ -156,6 +156,7 @@ FindSubdivisionsResult findSubdivisions(
                 ilpResults);
         return {.bimdf_results = std::move(res.bimdf_results),
                 .flow_stats = std::move(res.stats),
+                .flowResolveSkipped = res.resolveSkipped,
                 .stopwatch = std::move(res.stopwatch)};
     } else {
         Timekeeper::HierarchicalStopWatch sw{"ilp"};
@@ -187,6 +188,7 @@ FindSubdivisionsResult findSubdivisions(
         sw.stop();
         return {
             .ilp_stats = ilp_result.stats,
+            .ilpTimeLimitReached = ilp_result.timeLimitReached,
             .stopwatch = sw};
     }
 }
@@ -258,7 +260,7 @@ ILPResult findSubdivisions(
     else if (status == ILPStatus::SOLUTIONWRONG && !hardParityConstraint) {
         std::cout << std::endl << " >>>>>> Solution wrong! Trying with hard constraints for parity. It should not happen..." << std::endl << std::endl;
 
-        return findSubdivisions(
+        ILPResult retry = findSubdivisions(
             chartData,
             chartEdgeLength,
             method,
@@ -282,6 +284,8 @@ ILPResult findSubdivisions(
             minimumGap,
             gap,
             ilpResults);
+        retry.timeLimitReached = retry.timeLimitReached || ilp_result.timeLimitReached;
+        return retry;
     }
     else if (method != ILPMethod::ABS ||
              alignSingularities ||
@@ -292,7 +296,7 @@ ILPResult findSubdivisions(
     {
         std::cout << std::endl << " >>>>>> Minimum gap has been not reached. Trying with ABS (linear optimization method), singularity align disabled, minimum gap 1.0 and timeLimit x10. Gap was: " << gap << std::endl << std::endl;
 
-        return findSubdivisions(
+        ILPResult retry = findSubdivisions(
             chartData,
             chartEdgeLength,
             ILPMethod::ABS,
@@ -316,6 +320,8 @@ ILPResult findSubdivisions(
             1.0,
             gap,
             ilpResults);
+        retry.timeLimitReached = retry.timeLimitReached || ilp_result.timeLimitReached;
+        return retry;
     } else {
         assert(false);
         return {};
@@ -28,6 +28,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <vector>
 #include <optional>
+#include <functional>
+#include <string>
 
 #include <Eigen/Core>
 
@@ -37,6 +39,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "includes/qr_ilp.h"
 #include "qr_flow.h"
 #include "includes/qr_parameters.h"
+#include "includes/qr_pattern_cache.h"
 
 namespace QuadRetopology {
 
@@ -44,6 +47,8 @@ struct FindSubdivisionsResult {
     std::vector<Satsuma::BiMDFFullResult> bimdf_results; // empty if ILP was used
     std::vector<FlowStats> flow_stats; // Empty if ILP was used
     std::vector<ILPStats> ilp_stats; // Empty if flow was used
+    bool ilpTimeLimitReached = false;
+    bool flowResolveSkipped = false;
     Timekeeper::HierarchicalStopWatchResult stopwatch;
 };
 
@@ -117,10 +122,14 @@ void quadrangulate(
         const int quadrangulationFixedSmoothingIterations,
         const int quadrangulationNonFixedSmoothingIterations,
         const bool doubletsRemoval,
+        const bool parallelCharts,
+        const bool usePatternCache,
         PolyMeshType& quadrangulation,
         std::vector<int>& quadrangulationFaceLabel,
         std::vector<std::vector<size_t>>& quadrangulationPartitions,
-        std::vector<std::vector<size_t>>& quadrangulationCorners);
+        std::vector<std::vector<size_t>>& quadrangulationCorners,
+        const std::function<bool(const std::string&, double)>& progressCallback = std::function<bool(const std::string&, double)>(),
+        internal::PatternCacheCounters* patternCacheCounters = nullptr);
 
 }
 
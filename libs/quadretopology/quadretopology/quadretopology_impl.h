@@ -31,7 +31,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "includes/qr_patterns.h"
 #include "includes/qr_mapping.h"
 #include "qr_flow.h"
+#include <atomic>
 #include <map>
+#include <stdexcept>
+#include <unordered_map>
 
 #include <vcg/complex/algorithms/polygonal_algorithms.h>
 
@@ -66,8 +69,7 @@ ChartData computeChartData(
         const std::vector<int>& faceLabel,
         const std::vector<std::vector<size_t>>& corners)
 {
-    typedef std::map<std::pair<size_t, size_t>, std::pair<int, int>> EdgeLabelMap;
-    typedef std::map<std::pair<size_t, size_t>, int> EdgeSubSideMap;
+    typedef std::unordered_map<std::pair<size_t, size_t>, int, internal::EdgeHash> EdgeSubSideMap;
 
     ChartData chartData;
 
@@ -79,238 +81,88 @@ ChartData computeChartData(
     //Region growing algorithm for getting charts
     internal::findChartFacesAndBorderFaces(mesh, faceLabel, chartData);
 
-    //TODO SPLIT IN FUNCTIONS
-    EdgeSubSideMap edgeSubSideMap;
-    for (const int& pId : chartData.labels) {
-        Chart& chart = chartData.charts[pId];
+    const std::vector<int> labels(chartData.labels.begin(), chartData.labels.end());
+
+    //Trace the borders of the charts, independently for each label
+    std::vector<std::vector<internal::ChartBorder>> chartBorders(chartData.charts.size());
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(labels.size()); i++) {
+        const int& pId = labels[i];
+        const Chart& chart = chartData.charts[pId];
 
         assert(chart.label == pId);
 
         if (chart.faces.size() == 0)
             continue;
 
-        std::unordered_set<size_t> cornerSet(corners[pId].begin(), corners[pId].end());
-
 #ifndef NDEBUG
+        std::unordered_set<size_t> cornerSet(corners[pId].begin(), corners[pId].end());
         if (cornerSet.size() < 3 || cornerSet.size() > 6) {
             std::cout << "Warning 3: Given as input for " << pId << ": " << cornerSet.size() << " sides." << std::endl;
         }
 #endif
 
-        EdgeLabelMap edgeLabelMap;
-        std::vector<std::vector<size_t>> vertexNextMap(mesh.vert.size());
-
-        std::set<size_t> remainingVertices;
-
-        //Fill edge map and next vertex map
-        for (const size_t& fId : chart.borderFaces) {
-            typename TriangleMeshType::FaceType* currentFacePointer = &mesh.face[fId];
-            vcg::face::Pos<typename TriangleMeshType::FaceType> pos(currentFacePointer, 0);
-
-            for (int k = 0; k < currentFacePointer->VN(); k++) {
-                pos.FlipF();
-                size_t adjFace = vcg::tri::Index(mesh, pos.F());
-                int adjLabel = faceLabel[adjFace];
-
-                bool isBorderEdge = false;
-                int adjChartLabel = -2;
-
-                if (currentFacePointer == pos.F()) {
-                    adjChartLabel = -1;
-                    isBorderEdge = true;
-                }
-                else if (adjLabel != chart.label) {
-                    adjChartLabel = adjLabel;
-                    isBorderEdge = true;
-                }
-                pos.FlipF();
-
-                //For each border edge
-                if (isBorderEdge) {
-                    assert(adjChartLabel > -2);
-
-                    typename TriangleMeshType::VertexType* vStart = pos.V();
-                    pos.FlipV();
-                    typename TriangleMeshType::VertexType* vEnd = pos.V();
-                    pos.FlipV();
-
-                    size_t vStartId = vcg::tri::Index(mesh, vStart);
-                    size_t vEndId = vcg::tri::Index(mesh, vEnd);
-
-                    std::pair<size_t, size_t> edge(vStartId, vEndId);
-                    if (edge.first > edge.second) {
-                        std::swap(edge.first, edge.second);
-                    }
-
-                    edgeLabelMap.insert(std::make_pair(edge, std::make_pair(chart.label, adjChartLabel)));
-                    vertexNextMap[vStartId].push_back(vEndId);
-
-                    remainingVertices.insert(vStartId);
-                    remainingVertices.insert(vEndId);
-                }
-
-                pos.FlipV();
-                pos.FlipE();
-            }
-        }
-
-        do {
-            //Find first label
-            size_t vStartId;
-            size_t vCurrentId;
-            size_t vNextId;
-
-            //Corner detection variables
-            typename TriangleMeshType::CoordType lastEdgeVec;
-            bool isCorner = false;
-
-            vCurrentId = *remainingVertices.begin();
-
-            std::vector<size_t> nextConfiguration = internal::findVertexChainPath(vCurrentId, vertexNextMap);
-            vNextId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
-
-            //Get last edge vector
-            lastEdgeVec = mesh.vert[vNextId].P() - mesh.vert[vCurrentId].P();
-            lastEdgeVec.Normalize();
-
-//            std::pair<size_t, size_t> startEdge(vCurrentId, vNextId);
-//            if (startEdge.first > startEdge.second) {
-//                std::swap(startEdge.first, startEdge.second);
-//            }
-
-            int currentLabel;
-
-            //Iterate in the borders to get the first corner
-            vStartId = vCurrentId;
-            size_t firstCornerIterations = 0;
-            do {
-                //Next border edge
-                vCurrentId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
-                vNextId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
-
-                typename TriangleMeshType::CoordType currentEdgeVec = mesh.vert[vNextId].P() - mesh.vert[vCurrentId].P();
-                currentEdgeVec.Normalize();
-
-                //Check if it is a corner
-                isCorner = cornerSet.find(vCurrentId) != cornerSet.end();
-
-                lastEdgeVec = currentEdgeVec;
-
-                firstCornerIterations++;
-            } while (!isCorner && vCurrentId != vStartId && firstCornerIterations < MAXITERATIONS);
+        chartBorders[pId] = internal::traceChartBorders(mesh, faceLabel, corners, chart);
+    }
 
-#ifndef NDEBUG
-            if (firstCornerIterations >= MAXITERATIONS) {
-                std::cout << "Error: error iterating! Cannot find the first corner or get back to the start vertex." << std::endl;
-            }
-#endif
+    //Match the traced subsides of the charts, in label order
+    EdgeSubSideMap edgeSubSideMap;
+    for (const int& pId : labels) {
+        Chart& chart = chartData.charts[pId];
 
-#ifndef NDEBUG
-            if (vCurrentId == vStartId) {
-                std::cout << "Warning 1: input mesh is not well-defined: no corners!" << std::endl;
-            }
-#endif
-            vStartId = vCurrentId;
-            vNextId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
+        if (chart.faces.size() == 0)
+            continue;
 
+        for (const internal::ChartBorder& chartBorder : chartBorders[pId]) {
             ChartSide currentSide;
             size_t chartSideId = 0;
             currentSide.length = 0;
             currentSide.size = 0;
 
-
-            int adjChartLabel;
-            do {
+            bool isCorner = false;
+            for (const internal::ChartBorderSubside& borderSubside : chartBorder) {
                 size_t subsideId = chartData.subsides.size();
                 ChartSubside currentSubSide;
 
-                //Get edge
-                std::pair<size_t, size_t> edge(vCurrentId, vNextId);
-                if (edge.first > edge.second) {
-                    std::swap(edge.first, edge.second);
-                }
-                //Get current label on the other side
-                const std::pair<int,int>& currentEdgeLabels = edgeLabelMap.at(edge);
-                assert(currentEdgeLabels.first == chart.label || currentEdgeLabels.second == chart.label);
-                adjChartLabel = currentEdgeLabels.first == chart.label ? currentEdgeLabels.second : currentEdgeLabels.first;
-
-                std::unordered_set<size_t> cornerSetAdj;
-                if (adjChartLabel >= 0)
-                    cornerSetAdj.insert(corners[adjChartLabel].begin(), corners[adjChartLabel].end());
+                const int& adjChartLabel = borderSubside.adjChartLabel;
+                isCorner = borderSubside.isCorner;
 
                 double length = 0;
 
                 bool newSubSide = false;
 
-                bool firstIteration = true;
-                isCorner = false;
-                bool isAdjCorner = false;
-                size_t vSubSideStartId = vCurrentId;
-                size_t iterations = 0;
-                do {
-                    typename TriangleMeshType::CoordType currentEdgeVec = mesh.vert[vNextId].P() - mesh.vert[vCurrentId].P();
-                    currentEdgeVec.Normalize();
+                for (size_t k = 0; k < borderSubside.vertices.size() - 1; k++) {
+                    const size_t& vCurrentId = borderSubside.vertices[k];
+                    const size_t& vNextId = borderSubside.vertices[k + 1];
 
                     std::pair<size_t, size_t> edge(vCurrentId, vNextId);
                     if (edge.first > edge.second) {
                         std::swap(edge.first, edge.second);
                     }
 
-                    //Check if it is a corner
-                    if (!firstIteration) {
-                        isCorner = cornerSet.find(vCurrentId) != cornerSet.end();
-                        isAdjCorner = cornerSetAdj.find(vCurrentId) != cornerSetAdj.end();
-                    }
-
-                    //Get current label on the other subside
-                    const std::pair<int,int>& currentEdgeLabels = edgeLabelMap.at(edge);
-                    assert(currentEdgeLabels.first == chart.label || currentEdgeLabels.second == chart.label);
-                    currentLabel = currentEdgeLabels.first == chart.label ? currentEdgeLabels.second : currentEdgeLabels.first;
+                    EdgeSubSideMap::iterator findIt = edgeSubSideMap.find(edge);
 
-                    if (!isCorner && !isAdjCorner && currentLabel == adjChartLabel) {
-                        EdgeSubSideMap::iterator findIt = edgeSubSideMap.find(edge);
+                    //If the subside has already been processed
+                    if (findIt == edgeSubSideMap.end()) {
+                        currentSubSide.vertices.push_back(vCurrentId);
 
-                        //If the subside has already been processed
-                        if (findIt == edgeSubSideMap.end()) {
-                            currentSubSide.vertices.push_back(vCurrentId);
+                        length += (mesh.vert[vNextId].P() - mesh.vert[vCurrentId].P()).Norm();
 
-                            length += (mesh.vert[vNextId].P() - mesh.vert[vCurrentId].P()).Norm();
+                        edgeSubSideMap.insert(std::make_pair(edge, subsideId));
 
-                            edgeSubSideMap.insert(std::make_pair(edge, subsideId));
-
-                            newSubSide = true;
-                        }
-                        else if (firstIteration) {
-                            subsideId = findIt->second;
-                        }
-                        firstIteration = false;
-
-                        remainingVertices.erase(vCurrentId);
-
-                        //Next border edge
-                        vCurrentId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
-                        vNextId = vertexNextMap[vCurrentId][nextConfiguration[vCurrentId]];
-
-                        lastEdgeVec = currentEdgeVec;
+                        newSubSide = true;
+                    }
+                    else if (k == 0) {
+                        subsideId = findIt->second;
                     }
-                } while (!isCorner && !isAdjCorner && currentLabel == adjChartLabel && vCurrentId != vSubSideStartId && iterations < MAXITERATIONS);
-#ifndef NDEBUG
-                if (iterations >= MAXITERATIONS) {
-                    std::cout << "Error: error iterating! Cannot find a corner or get back to the start vertex." << std::endl;
-                }
-#endif
-#ifndef NDEBUG
-                if (vCurrentId == vSubSideStartId) {
-                    std::cout << "Warning 2: input mesh is not well-defined: single border chart with no corners!" << std::endl;
                 }
-#endif
 
                 //True if the subside is reversed (from the last to the first vertex)
                 bool reversed;
 
                 if (newSubSide) {
                     //Add last vertex
-                    currentSubSide.vertices.push_back(vCurrentId);
+                    currentSubSide.vertices.push_back(borderSubside.vertices.back());
 
                     //Create new side
                     chart.chartSubsides.push_back(subsideId);
@@ -392,16 +244,14 @@ ChartData computeChartData(
                     currentSide = ChartSide();
                     chartSideId++;
                 }
-
-            } while (vCurrentId != vStartId);
+            }
 
 #ifndef NDEBUG
             if (!isCorner) {
                 std::cout << "Warning 4: Chart has no final corner!" << std::endl;
             }
 #endif
-
-        } while (!remainingVertices.empty());
+        }
 
 #ifndef NDEBUG
         if (chart.chartSides.size() < 3 || chart.chartSides.size() > 6) {
@@ -426,7 +276,15 @@ void quadrangulate(
         std::vector<std::vector<size_t>>& quadrangulationPartitions,
         std::vector<std::vector<size_t>>& quadrangulationCorners)
 {
-    return QuadRetopology::quadrangulate(
+    internal::PatternCache& patternCache = internal::PatternCache::instance();
+    if (parameters.patternCache && !parameters.patternCacheFilename.empty()) {
+        if (patternCache.load(parameters.patternCacheFilename)) {
+            std::cout << "Pattern cache loaded from " << parameters.patternCacheFilename << "." << std::endl;
+        }
+    }
+    internal::PatternCacheCounters patternCacheCounters;
+
+    QuadRetopology::quadrangulate(
             newSurface,
             chartData,
             fixedPositionSubsides,
@@ -435,10 +293,28 @@ void quadrangulate(
             parameters.quadrangulationFixedSmoothingIterations,
             parameters.quadrangulationNonFixedSmoothingIterations,
             parameters.doubletRemoval,
+            parameters.parallelChartQuadrangulation,
+            parameters.patternCache,
             quadrangulation,
             quadrangulationFaceLabel,
             quadrangulationPartitions,
-            quadrangulationCorners);
+            quadrangulationCorners,
+            parameters.progressCallback,
+            &patternCacheCounters);
+
+    if (parameters.patternCache) {
+        internal::PatternCacheStats stats;
+        stats.hits = patternCacheCounters.hits;
+        stats.misses = patternCacheCounters.misses;
+        stats.size = patternCache.size();
+        std::cout << "Pattern cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.size << " patterns." << std::endl;
+
+        if (!parameters.patternCacheFilename.empty() && stats.misses > 0) {
+            if (!patternCache.save(parameters.patternCacheFilename)) {
+                std::cout << "Warning: impossible to save the pattern cache in " << parameters.patternCacheFilename << "." << std::endl;
+            }
+        }
+    }
 }
 
 template<class TriangleMeshType, class PolyMeshType>
@@ -451,10 +327,14 @@ void quadrangulate(
         const int quadrangulationFixedSmoothingIterations,
         const int quadrangulationNonFixedSmoothingIterations,
         const bool doubletRemoval,
+        const bool parallelCharts,
+        const bool usePatternCache,
         PolyMeshType& quadrangulation,
         std::vector<int>& quadrangulationFaceLabel,
         std::vector<std::vector<size_t>>& quadrangulationPartitions,
-        std::vector<std::vector<size_t>>& quadrangulationCorners)
+        std::vector<std::vector<size_t>>& quadrangulationCorners,
+        const std::function<bool(const std::string&, double)>& progressCallback,
+        internal::PatternCacheCounters* patternCacheCounters)
 {
     if (newSurface.face.size() <= 0)
         return;
@@ -583,16 +463,47 @@ void quadrangulate(
     }
 
 
+    //Charts are quadrangulated independently (in parallel if requested), then they
+    //are stitched together in chart order: the result does not depend on the scheduling
+    enum ChartStatus { CHART_EMPTY, CHART_WRONG_SIDES, CHART_ILP_NOT_SOLVED, CHART_COMPUTED };
+    struct ChartQuadrangulation {
+        ChartStatus status = CHART_EMPTY;
+        PolyMeshType mesh;
+        std::vector<std::vector<size_t>> patchSides;
+    };
+    std::vector<ChartQuadrangulation> chartQuadrangulations(chartData.charts.size());
+
+    QuadRetopology::internal::initPatternTables();
+    QuadRetopology::internal::PatternCache* patternCache = usePatternCache ? &QuadRetopology::internal::PatternCache::instance() : nullptr;
+
+    const TriangleMeshType& constSurface = newSurface;
+    const int numCharts = static_cast<int>(chartData.charts.size());
+
+    //Exceptions cannot leave the parallel loop: once the progress callback
+    //asks to stop, the remaining charts are skipped
+    std::atomic<bool> cancelled(false);
+    std::atomic<int> chartsDone(0);
+
     //For each chart
-    for (size_t cId = 0; cId < chartData.charts.size(); cId++) {
+#pragma omp parallel for schedule(dynamic, 1) if(parallelCharts)
+    for (int cId = 0; cId < numCharts; cId++) {
         const Chart& chart = chartData.charts[cId];
+        ChartQuadrangulation& chartQuadrangulation = chartQuadrangulations[cId];
+
+        if (cancelled)
+            continue;
+        if (progressCallback) {
+            const int done = chartsDone++;
+            if (!progressCallback("quadrangulate_charts", static_cast<double>(done) / numCharts))
+                cancelled = true;
+        }
 
         if (chart.faces.size() == 0)
             continue;
 
         const std::vector<ChartSide>& chartSides = chart.chartSides;
         if (chartSides.size() < 3 || chartSides.size() > 6) {
-            std::cout << "Chart " << cId << " with corners less than 3 or greater than 6!" << std::endl;
+            chartQuadrangulation.status = CHART_WRONG_SIDES;
             continue;
         }
 
@@ -603,23 +514,15 @@ void quadrangulate(
         }
 
         if (!ilpSolvedForAll) {
-            std::cout << "Chart " << cId << " not computed. ILP was not solved." << std::endl;
+            chartQuadrangulation.status = CHART_ILP_NOT_SOLVED;
             continue;
         }
 
         //Input mesh
         Eigen::MatrixXd chartV;
         Eigen::MatrixXi chartF;
-        vcg::tri::UpdateFlags<TriangleMeshType>::FaceClearS(newSurface);
-        vcg::tri::UpdateFlags<TriangleMeshType>::VertexClearS(newSurface);
-        for (const size_t& fId : chart.faces) {
-            newSurface.face[fId].SetS();
-            for (int k = 0; k < newSurface.face[fId].VN(); k++) {
-                newSurface.face[fId].V(k)->SetS();
-            }
-        }
-        std::vector<int> vMap, fMap;
-        QuadRetopology::internal::VCGToEigen(newSurface, chartV, chartF, vMap, fMap, true, 3);
+        std::unordered_map<size_t, int> vMap;
+        QuadRetopology::internal::chartToEigen(constSurface, chart.faces, chartV, chartF, vMap, 3);
 
         //Input subdivisions
         Eigen::VectorXi l(chartSides.size());
@@ -640,10 +543,7 @@ void quadrangulate(
                 const size_t& subSideId = chartSides[i].subsides[j];
                 const ChartSubside& subSide = chartData.subsides[subSideId];
 
-                if (ilpResult[subSideId] < 0) {
-                    std::cout << "Error: ILP not valid" << std::endl;
-                    return;
-                }
+                assert(ilpResult[subSideId] >= 0);
 
                 targetSideSubdivision += ilpResult[subSideId];
 
@@ -657,8 +557,8 @@ void quadrangulate(
 
                 for (size_t k = 0; k < chartSideVertices[i][j].size(); k++) {
                     size_t vId = chartSideVertices[i][j][k];
-                    assert(vMap[vId] >= 0);
-                    chartSideVertices[i][j][k] = vMap[vId];
+                    assert(vMap.find(vId) != vMap.end());
+                    chartSideVertices[i][j][k] = vMap.at(vId);
                 }
 
             }
@@ -672,8 +572,8 @@ void quadrangulate(
         std::vector<size_t> patchBorders;
         std::vector<size_t> patchCorners;
         PolyMeshType patchMesh;
-        std::vector<std::vector<size_t>> patchSides;
-        QuadRetopology::internal::computePattern(l, patchV, patchF, patchMesh, patchBorders, patchCorners, patchSides);
+        std::vector<std::vector<size_t>>& patchSides = chartQuadrangulation.patchSides;
+        QuadRetopology::internal::computePattern(l, patchV, patchF, patchMesh, patchBorders, patchCorners, patchSides, patternCache, patternCacheCounters);
 
 #ifdef QUADRETOPOLOGY_DEBUG_SAVE_MESHES
         igl::writeOBJ(std::string("results/") + std::to_string(cId) + std::string("_patch.obj"), patchV, patchF);
@@ -707,7 +607,7 @@ void quadrangulate(
         assert(chartV.rows() == uvMapV.rows());
 
         //Get polymesh
-        PolyMeshType quadrangulatedChartMesh;
+        PolyMeshType& quadrangulatedChartMesh = chartQuadrangulation.mesh;
         QuadRetopology::internal::eigenToVCG(quadrangulationV, quadrangulationF, quadrangulatedChartMesh, 4);
 
 #ifdef QUADRETOPOLOGY_DEBUG_SAVE_MESHES
@@ -723,6 +623,33 @@ void quadrangulate(
             vcg::PolygonalAlgorithm<PolyMeshType>::LaplacianReproject(quadrangulatedChartMesh, chartSmoothingIterations, 0.5, true);
         }
 
+        chartQuadrangulation.status = CHART_COMPUTED;
+    }
+
+    if (cancelled) {
+        throw std::runtime_error("quadrangulation cancelled");
+    }
+
+    //Stitch the quadrangulated charts
+    for (size_t cId = 0; cId < chartData.charts.size(); cId++) {
+        const Chart& chart = chartData.charts[cId];
+        ChartQuadrangulation& chartQuadrangulation = chartQuadrangulations[cId];
+
+        if (chartQuadrangulation.status == CHART_WRONG_SIDES) {
+            std::cout << "Chart " << cId << " with corners less than 3 or greater than 6!" << std::endl;
+            continue;
+        }
+        if (chartQuadrangulation.status == CHART_ILP_NOT_SOLVED) {
+            std::cout << "Chart " << cId << " not computed. ILP was not solved." << std::endl;
+            continue;
+        }
+        if (chartQuadrangulation.status != CHART_COMPUTED)
+            continue;
+
+        const std::vector<ChartSide>& chartSides = chart.chartSides;
+        const std::vector<std::vector<size_t>>& patchSides = chartQuadrangulation.patchSides;
+        PolyMeshType& quadrangulatedChartMesh = chartQuadrangulation.mesh;
+
         std::vector<int> currentVertexMap(quadrangulatedChartMesh.vert.size(), -1);
 
         //Map subsides on the vertices of the current mesh (create if necessary)
@@ -849,6 +776,9 @@ void quadrangulate(
 
             quadrangulationCorners[chart.label].push_back(cornerVertices.at(vStart));
         }
+
+        //Release the chart quadrangulation
+        quadrangulatedChartMesh.Clear();
     }
 
 #ifdef QUADRETOPOLOGY_DEBUG_SAVE_MESHES
@@ -0,0 +1,328 @@
+#include "batch.h"
+#include "functions.h"
+#include "deadline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+#include <libTimekeeper/StopWatchPrinting.hh>
+#include <libTimekeeper/json.hh>
+
+void parseJobArguments(const std::vector<std::string>& arguments, BatchJob& job)
+{
+    //--deadline <time> can be anywhere, the other arguments are positional
+    std::vector<std::string> args;
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (arguments[i] != "--deadline") {
+            args.push_back(arguments[i]);
+            continue;
+        }
+        if (i + 1 >= arguments.size()) {
+            throw std::runtime_error("missing value for '--deadline'");
+        }
+        job.deadline = Deadline::parseSeconds(arguments[++i]);
+    }
+
+    if (args.empty()) {
+        throw std::runtime_error("missing mesh filename");
+    }
+
+    job.meshFilename = args[0];
+    if (job.meshFilename.size() < 4) {
+        throw std::runtime_error("invalid mesh filename '" + job.meshFilename + "'");
+    }
+
+    if (args.size() >= 2) {
+        job.stopAfterStep = std::atoi(args[1].c_str());
+        if (job.stopAfterStep < 1 || job.stopAfterStep > 3) {
+            throw std::runtime_error("unknown step '" + args[1] + "' to stop after. valid: 1, 2, 3");
+        }
+    }
+
+    for (size_t i = 2; i < args.size(); i++) {
+        const std::string& pathTest = args[i];
+
+        if (pathTest.find(".sharp") != std::string::npos) {
+            job.sharpFilename = pathTest;
+        }
+        else if (pathTest.find(".txt") != std::string::npos) {
+            job.configFilename = pathTest;
+        }
+        else if (pathTest.find(".rosy") != std::string::npos) {
+            job.fieldFilename = pathTest;
+        }
+        else if (pathTest.find(".json") != std::string::npos) {
+            job.statsFilename = pathTest;
+        }
+        else {
+            throw std::runtime_error("don't know what to do with optional parameter '" + pathTest +
+                                     "'. Please supply .sharp, .txt, .rosy or .json files.");
+        }
+    }
+}
+
+std::vector<BatchJob> loadBatchManifest(const std::string& filename)
+{
+    std::ifstream input(filename);
+    if (!input.is_open()) {
+        throw std::runtime_error("failed to open batch manifest '" + filename + "'");
+    }
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(input, line)) {
+        lineNumber++;
+
+        std::istringstream lineStream(line);
+        std::vector<std::string> args;
+        std::string arg;
+        while (lineStream >> arg)
+            args.push_back(arg);
+
+        if (args.empty() || args[0][0] == '#')
+            continue;
+
+        BatchJob job;
+        try {
+            parseJobArguments(args, job);
+        }
+        catch (std::runtime_error& e) {
+            throw std::runtime_error(filename + ":" + std::to_string(lineNumber) + ": " + e.what());
+        }
+        jobs.push_back(job);
+    }
+
+    return jobs;
+}
+
+static Parameters jobParameters(const BatchJob& job, const Parameters& config)
+{
+    Parameters parameters = config;
+    parameters.hasFeature = !job.sharpFilename.empty();
+    parameters.hasField = !job.fieldFilename.empty();
+    return parameters;
+}
+
+void runJob(const BatchJob& job)
+{
+    RunStats stats("quadwild");
+
+    Parameters config;
+    {
+        RunStats::Scope scope(&stats, "load_config");
+        loadConfigFile(job.configFilename, config);
+    }
+
+    Deadline deadline(job.deadline);
+    processMesh(job.meshFilename, job.sharpFilename, job.fieldFilename, jobParameters(job, config), job.stopAfterStep, &stats, &deadline);
+
+    stats.finish();
+    std::cout << "\n" << stats.stopWatchResult() << std::endl;
+    deadline.print();
+    if (!job.statsFilename.empty()) {
+        nlohmann::json statsJson = stats.toJson();
+        if (deadline.limited())
+            statsJson["deadline"] = deadline.toJson();
+        std::ofstream statsFile(job.statsFilename);
+        statsFile << std::setw(4) << statsJson << std::endl;
+    }
+}
+
+static size_t inputFileSize(const BatchJob& job)
+{
+    std::ifstream input(job.meshFilename, std::ios::binary | std::ios::ate);
+    if (!input.is_open())
+        return 0;
+
+    return static_cast<size_t>(input.tellg());
+}
+
+std::vector<std::string> jobOutputs(const BatchJob& job)
+{
+    const std::string prefix(job.meshFilename.begin(), job.meshFilename.end() - 4);
+
+    std::vector<std::string> candidates = {prefix + "_rem.obj", prefix + "_rem.rosy", prefix + "_rem.sharp"};
+    if (job.stopAfterStep >= 2) {
+        candidates.push_back(prefix + "_rem_p0.obj");
+        candidates.push_back(prefix + "_rem_p0.patch");
+    }
+    if (job.stopAfterStep >= 3) {
+        candidates.push_back(prefix + "_rem_p0_quadrangulation.obj");
+        candidates.push_back(prefix + "_rem_p0_quadrangulation_smooth.obj");
+    }
+
+    std::vector<std::string> outputs;
+    for (const std::string& candidate : candidates) {
+        if (std::ifstream(candidate).good())
+            outputs.push_back(candidate);
+    }
+    return outputs;
+}
+
+size_t runBatch(const std::vector<BatchJob>& jobs, const BatchOptions& options)
+{
+    if (jobs.empty())
+        return 0;
+
+    //Parse each config file once
+    std::map<std::string, Parameters> configs;
+    std::map<std::string, std::string> configErrors;
+    for (const BatchJob& job : jobs) {
+        if (configs.count(job.configFilename) || configErrors.count(job.configFilename))
+            continue;
+        try {
+            Parameters config;
+            loadConfigFile(job.configFilename, config);
+            configs[job.configFilename] = config;
+        }
+        catch (std::runtime_error& e) {
+            configErrors[job.configFilename] = e.what();
+        }
+    }
+
+    const size_t totalThreads = Scheduler::numThreads();
+    size_t numWorkers = options.jobs > 0 ? options.jobs : std::max<size_t>(1, totalThreads / 4);
+    numWorkers = std::min(numWorkers, jobs.size());
+    const size_t threadsPerJob = options.threadsPerJob > 0 ? options.threadsPerJob : std::max<size_t>(1, totalThreads / numWorkers);
+
+    std::cout << "Batch: " << jobs.size() << " meshes, " << numWorkers << " at a time with "
+              << threadsPerJob << " threads each";
+    if (options.memoryBudgetMB > 0)
+        std::cout << ", memory budget " << options.memoryBudgetMB << " MB at "
+                  << options.memoryPerInputByte << " bytes per input byte";
+    std::cout << std::endl;
+
+    //Largest meshes first, so that the small ones fill the gaps at the end
+    std::vector<size_t> fileSize(jobs.size());
+    std::vector<size_t> memoryMB(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        fileSize[i] = inputFileSize(jobs[i]);
+        memoryMB[i] = fileSize[i] * options.memoryPerInputByte / (1024 * 1024);
+    }
+
+    std::vector<size_t> pending(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+        pending[i] = i;
+    std::stable_sort(pending.begin(), pending.end(), [&memoryMB](const size_t& a, const size_t& b) {
+        return memoryMB[a] > memoryMB[b];
+    });
+
+    std::mutex mutex;
+    std::condition_variable released;
+    size_t usedMemoryMB = 0;
+    size_t running = 0;
+    size_t failed = 0;
+
+    //Next job fitting in the memory budget. A job larger than the whole
+    //budget is started only when nothing else is running
+    auto acquireJob = [&](size_t& jobId) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (pending.empty())
+                return false;
+
+            for (size_t k = 0; k < pending.size(); k++) {
+                const size_t i = pending[k];
+                if (options.memoryBudgetMB == 0 || running == 0 || usedMemoryMB + memoryMB[i] <= options.memoryBudgetMB) {
+                    pending.erase(pending.begin() + static_cast<std::ptrdiff_t>(k));
+                    usedMemoryMB += memoryMB[i];
+                    running++;
+                    jobId = i;
+                    return true;
+                }
+            }
+
+            released.wait(lock);
+        }
+    };
+
+    auto worker = [&]() {
+        Scheduler::Budget budget(threadsPerJob);
+        size_t jobId;
+        while (acquireJob(jobId)) {
+            const BatchJob& job = jobs[jobId];
+
+            nlohmann::json result;
+            result["mesh"] = job.meshFilename;
+            result["config"] = job.configFilename;
+            result["stop_after_step"] = job.stopAfterStep;
+            result["estimated_memory_mb"] = memoryMB[jobId];
+
+            //the peak RSS of a stage is only its own if no other mesh is running
+            RunStats stats("quadwild", numWorkers == 1);
+
+            auto start = std::chrono::steady_clock::now();
+            Deadline deadline(job.deadline);
+            std::string error;
+            try {
+                auto configIt = configs.find(job.configFilename);
+                if (configIt == configs.end()) {
+                    throw std::runtime_error(configErrors.at(job.configFilename));
+                }
+                StageCacheReport report = processMesh(job.meshFilename, job.sharpFilename, job.fieldFilename, jobParameters(job, configIt->second), job.stopAfterStep, &stats, &deadline);
+                for (const std::pair<std::string, std::string>& stage : report.stages)
+                    result["stages"][stage.first] = stage.second;
+            }
+            catch (std::exception& e) {
+                error = e.what();
+            }
+            catch (...) {
+                error = "unknown error";
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            stats.finish();
+
+            //measured value for --memory-per-byte, the peak RSS is the one of
+            //this mesh only when a single mesh runs at a time
+            const nlohmann::json memory = stats.memoryJson();
+            if (numWorkers == 1 && fileSize[jobId] > 0)
+                result["memory_per_input_byte"] = memory["peak_rss_bytes"].get<size_t>() / fileSize[jobId];
+
+            result["success"] = error.empty();
+            if (!error.empty())
+                result["error"] = error;
+            result["seconds"] = elapsed.count();
+            result["outputs"] = jobOutputs(job);
+            if (deadline.limited())
+                result["deadline"] = deadline.toJson();
+            result.update(stats.toJson());
+
+            const std::string resultFilename = std::string(job.meshFilename.begin(), job.meshFilename.end() - 4) + "_result.json";
+            std::ofstream resultFile(resultFilename);
+            resultFile << std::setw(4) << result << std::endl;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (error.empty()) {
+                std::cout << "Batch: done " << job.meshFilename << " in " << elapsed.count() << " s" << std::endl;
+            }
+            else {
+                std::cerr << "Batch: failed " << job.meshFilename << ": " << error << std::endl;
+                failed++;
+            }
+            usedMemoryMB -= memoryMB[jobId];
+            running--;
+            released.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < numWorkers; w++)
+        workers.emplace_back(worker);
+    for (std::thread& t : workers)
+        t.join();
+
+    std::cout << "Batch: " << (jobs.size() - failed) << " succeeded, " << failed << " failed" << std::endl;
+
+    return failed;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//A mesh to process, as given on the command line or in a line of the manifest:
+//  <mesh.{obj,ply}> [1|2|3] [*.sharp|*.rosy|*.txt|*.json]... [--deadline <time>]
+struct BatchJob {
+    std::string meshFilename;
+    std::string sharpFilename;
+    std::string fieldFilename;
+    std::string configFilename = "basic_setup.txt";
+    std::string statsFilename; //timing and memory report, batch mode writes it to the results file
+    int stopAfterStep = 3;
+    double deadline = 0; //seconds for the whole pipeline, 0 for no limit
+};
+
+struct BatchOptions {
+    size_t jobs = 0;           //meshes processed at the same time (0: automatic)
+    size_t threadsPerJob = 0;  //threads used inside each mesh (0: cores / jobs)
+    size_t memoryBudgetMB = 0; //estimated memory of the running meshes (0: unlimited)
+    //peak memory of a mesh per byte of its input file, for the memory budget.
+    //Runs with --jobs 1 report the measured value as memory_per_input_byte
+    size_t memoryPerInputByte = 64;
+};
+
+//fill the job from the arguments following the executable name, throws on invalid arguments
+void parseJobArguments(const std::vector<std::string>& args, BatchJob& job);
+
+//one job per non empty line, lines starting with '#' are comments
+std::vector<BatchJob> loadBatchManifest(const std::string& filename);
+
+//run a single mesh, errors are reported as std::runtime_error
+void runJob(const BatchJob& job);
+
+//output files of the job found on disk
+std::vector<std::string> jobOutputs(const BatchJob& job);
+
+//run all the jobs, writing <mesh>_result.json for each of them.
+//A failing mesh does not stop the others, returns the number of failed meshes
+size_t runBatch(const std::vector<BatchJob>& jobs, const BatchOptions& options);
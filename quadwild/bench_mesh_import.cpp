@@ -0,0 +1,97 @@
+#include <triangle_mesh_type.h>
+#include <fast_mesh_import.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//Compare the load time of FastMeshImporter with the vcg importers, and check
+//that both produce the same mesh
+//  bench_mesh_import [--repeat N] <mesh.{obj,ply}>...
+
+typedef std::chrono::steady_clock Clock;
+
+static bool loadVCG(FieldTriMesh& mesh, const std::string& filename)
+{
+    mesh.Clear();
+    if (filename.find(".ply") != std::string::npos)
+        return vcg::tri::io::ImporterPLY<FieldTriMesh>::Open(mesh, filename.c_str()) == vcg::ply::E_NOERROR;
+
+    int mask;
+    vcg::tri::io::ImporterOBJ<FieldTriMesh>::LoadMask(filename.c_str(), mask);
+    int err = vcg::tri::io::ImporterOBJ<FieldTriMesh>::Open(mesh, filename.c_str(), mask);
+    return (err == 0) || (err == 5);
+}
+
+static bool sameMesh(const FieldTriMesh& a, const FieldTriMesh& b)
+{
+    if (a.vert.size() != b.vert.size() || a.face.size() != b.face.size())
+        return false;
+    for (size_t i = 0; i < a.vert.size(); i++) {
+        if (a.vert[i].cP() != b.vert[i].cP())
+            return false;
+    }
+    for (size_t i = 0; i < a.face.size(); i++) {
+        for (int j = 0; j < 3; j++) {
+            if (vcg::tri::Index(a, a.face[i].cV(j)) != vcg::tri::Index(b, b.face[i].cV(j)))
+                return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int repeat = 3;
+    std::vector<std::string> filenames;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else
+            filenames.push_back(arg);
+    }
+    if (filenames.empty()) {
+        std::cerr << "usage: " << argv[0] << " [--repeat N] <mesh.{obj,ply}>..." << std::endl;
+        return 1;
+    }
+
+    int failed = 0;
+    for (const std::string& filename : filenames) {
+        FieldTriMesh vcgMesh, fastMesh;
+        double vcgTime = 0, fastTime = 0;
+        bool vcgLoaded = true, fastLoaded = true;
+
+        for (int r = 0; r < repeat; r++) {
+            Clock::time_point start = Clock::now();
+            vcgLoaded = loadVCG(vcgMesh, filename);
+            vcgTime += std::chrono::duration<double>(Clock::now() - start).count();
+
+            start = Clock::now();
+            fastLoaded = FastMeshImporter<FieldTriMesh>::Open(fastMesh, filename);
+            fastTime += std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        std::cout << filename << std::endl;
+        if (!vcgLoaded) {
+            std::cout << "  vcg importer failed" << std::endl;
+            failed++;
+            continue;
+        }
+        std::cout << "  " << vcgMesh.vert.size() << " vertices, " << vcgMesh.face.size() << " faces" << std::endl;
+        std::cout << "  vcg:  " << vcgTime / repeat << " s" << std::endl;
+        if (!fastLoaded) {
+            std::cout << "  fast: not handled, the vcg importer is used" << std::endl;
+            continue;
+        }
+        std::cout << "  fast: " << fastTime / repeat << " s (" << vcgTime / fastTime << "x)" << std::endl;
+        if (!sameMesh(vcgMesh, fastMesh)) {
+            std::cout << "  MISMATCH between the loaded meshes" << std::endl;
+            failed++;
+        }
+    }
+
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,148 @@
+#include "deadline.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+//Share of the time of each stage, roughly their cost on typical models
+static double stageShare(const std::string& stage)
+{
+    static const std::map<std::string, double> shares = {
+        {"remesh_and_field", 0.35},
+        {"trace", 0.2},
+        {"quadrangulate", 0.45}};
+
+    auto it = shares.find(stage);
+    return it != shares.end() ? it->second : 0.1;
+}
+
+//A stage that starts after the deadline still gets this much time, enough to
+//run its cheapest variant
+static const double minimumStageSeconds = 0.1;
+
+Deadline::Deadline(double seconds) :
+    seconds(seconds),
+    start(Clock::now())
+{
+
+}
+
+double Deadline::elapsed() const
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void Deadline::setStages(const std::vector<std::string>& stages)
+{
+    pending = stages;
+}
+
+void Deadline::beginStage(const std::string& stage)
+{
+    stages.emplace_back();
+    current = &stages.back();
+    current->name = stage;
+    current->start = elapsed();
+
+    //share of the time left among this stage and the ones still to run
+    double totalShare = stageShare(stage);
+    auto it = std::find(pending.begin(), pending.end(), stage);
+    if (it != pending.end()) {
+        for (auto next = it + 1; next != pending.end(); ++next)
+            totalShare += stageShare(*next);
+        pending.erase(pending.begin(), it + 1);
+    }
+
+    if (limited()) {
+        const double left = std::max(0.0, seconds - current->start);
+        current->budget = std::max(minimumStageSeconds, left * stageShare(stage) / totalShare);
+    }
+}
+
+void Deadline::endStage()
+{
+    if (current == nullptr)
+        return;
+    current->spent = elapsed() - current->start;
+    current = nullptr;
+}
+
+double Deadline::stageRemaining() const
+{
+    if (!limited() || current == nullptr)
+        return 0;
+    return std::max(minimumStageSeconds, current->budget - (elapsed() - current->start));
+}
+
+void Deadline::degrade(const std::string& what)
+{
+    if (current == nullptr)
+        return;
+    current->degradations.push_back(what);
+    std::cout << "Deadline: " << current->name << ": " << what << std::endl;
+}
+
+bool Deadline::degraded(const std::string& stage) const
+{
+    for (const Stage& s : stages) {
+        if (s.name == stage && !s.degradations.empty())
+            return true;
+    }
+    return false;
+}
+
+nlohmann::json Deadline::toJson() const
+{
+    nlohmann::json j = {
+        {"seconds", seconds},
+        {"elapsed", elapsed()},
+        {"stages", nlohmann::json::array()}};
+    for (const Stage& s : stages) {
+        nlohmann::json stage = {
+            {"name", s.name},
+            {"budget", s.budget},
+            {"spent", s.spent},
+            {"degraded", s.degradations}};
+        j["stages"].push_back(stage);
+    }
+    return j;
+}
+
+void Deadline::print() const
+{
+    if (!limited())
+        return;
+
+    std::cout << "Deadline: " << elapsed() << " s of " << seconds << " s" << std::endl;
+    for (const Stage& s : stages) {
+        std::cout << "  " << s.name << ": " << s.spent << " s of " << s.budget << " s" << std::endl;
+        for (const std::string& what : s.degradations)
+            std::cout << "    " << what << std::endl;
+    }
+}
+
+double Deadline::parseSeconds(const std::string& str)
+{
+    size_t end = 0;
+    double value = 0;
+    try {
+        value = std::stod(str, &end);
+    }
+    catch (std::exception&) {
+        throw std::runtime_error("invalid duration '" + str + "'");
+    }
+
+    const std::string unit = str.substr(end);
+    if (unit == "ms")
+        value /= 1000;
+    else if (unit == "m" || unit == "min")
+        value *= 60;
+    else if (!unit.empty() && unit != "s")
+        throw std::runtime_error("invalid duration '" + str + "'");
+
+    if (value < 0) {
+        throw std::runtime_error("invalid duration '" + str + "'");
+    }
+    return value;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+//End-to-end time budget of a run. Each stage gets its share of the time left
+//when it starts, so the time saved (or overrun) by a stage goes to the next
+//ones. Stages use their budget to reduce their work, and record what they
+//reduced. Without a limit every budget is 0, meaning unlimited
+class Deadline {
+public:
+    //seconds of the whole run, 0 for no limit
+    explicit Deadline(double seconds = 0);
+
+    bool limited() const { return seconds > 0; }
+    double elapsed() const;
+
+    //stages still to run, in order, with their share of the time
+    void setStages(const std::vector<std::string>& stages);
+
+    void beginStage(const std::string& stage);
+    void endStage();
+
+    //time left to the current stage, 0 if there is no limit and never below
+    //a small positive amount otherwise
+    double stageRemaining() const;
+
+    //a stage reduced its work to fit its budget
+    void degrade(const std::string& what);
+    bool degraded(const std::string& stage) const;
+
+    nlohmann::json toJson() const;
+    void print() const;
+
+    //a stage of the run until the end of the scope, does nothing without a deadline
+    class Scope {
+    public:
+        Scope(Deadline* deadline, const std::string& stage) :
+            deadline(deadline)
+        {
+            if (deadline != nullptr)
+                deadline->beginStage(stage);
+        }
+
+        ~Scope()
+        {
+            if (deadline != nullptr)
+                deadline->endStage();
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Deadline* deadline;
+    };
+
+    //parse a duration as 90, 90s, 500ms or 2m
+    static double parseSeconds(const std::string& str);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stage {
+        std::string name;
+        double budget = 0;
+        double start = 0;
+        double spent = 0;
+        std::vector<std::string> degradations;
+    };
+
+    double seconds;
+    Clock::time_point start;
+    std::vector<std::string> pending;
+    std::vector<Stage> stages;
+    Stage* current = nullptr;
+};
@@ -1,14 +1,11 @@
 #include "functions.h"
 #include "trace.h"
 
-inline void remeshAndField(
-        FieldTriMesh& trimesh,
+inline void remeshAndFieldParameters(
         const Parameters& parameters,
-        const std::string& meshFilename,
-        const std::string& sharpFilename,
-        const std::string& fieldFilename)
+        typename MeshPrepocess<FieldTriMesh>::BatchParam& BPar,
+        typename vcg::tri::FieldSmoother<FieldTriMesh>::SmoothParam& FieldParam)
 {
-    typename MeshPrepocess<FieldTriMesh>::BatchParam BPar;
     BPar.DoRemesh=parameters.remesh;
     BPar.feature_erode_dilate=4;
     BPar.remesher_aspect_ratio=0.35; // from field_computation/basic_setup*.txt
@@ -19,45 +16,149 @@ inline void remeshAndField(
     BPar.surf_dist_check=true;
     BPar.UpdateSharp=(!parameters.hasFeature);
 
-    typename vcg::tri::FieldSmoother<FieldTriMesh>::SmoothParam FieldParam;
     FieldParam.alpha_curv=0.3;
     FieldParam.curv_thr=0.8;
+    if (parameters.iterativeField)
+        FieldParam.SmoothM=vcg::tri::SMNPolyIterative;
+    FieldParam.solve_tol=parameters.fieldTolerance;
+}
+
+inline std::string remeshAndFieldKey(const Parameters& parameters)
+{
+    typename MeshPrepocess<FieldTriMesh>::BatchParam BPar;
+    typename vcg::tri::FieldSmoother<FieldTriMesh>::SmoothParam FieldParam;
+    remeshAndFieldParameters(parameters, BPar, FieldParam);
+
+    std::ostringstream key;
+    key << "remesh_field"
+        << " has_feature " << parameters.hasFeature
+        << " has_field " << parameters.hasField
+        << " DoRemesh " << BPar.DoRemesh
+        << " feature_erode_dilate " << BPar.feature_erode_dilate
+        << " remesher_aspect_ratio " << BPar.remesher_aspect_ratio
+        << " remesher_iterations " << BPar.remesher_iterations
+        << " remesher_termination_delta " << BPar.remesher_termination_delta
+        << " SharpFactor " << BPar.SharpFactor
+        << " sharp_feature_thr " << BPar.sharp_feature_thr
+        << " surf_dist_check " << BPar.surf_dist_check
+        << " UpdateSharp " << BPar.UpdateSharp
+        << " alpha_curv " << FieldParam.alpha_curv
+        << " curv_thr " << FieldParam.curv_thr;
+    //the direct solver ignores the tolerance
+    if (FieldParam.SmoothM==vcg::tri::SMNPolyIterative)
+        key << " iterative_field solve_tol " << FieldParam.solve_tol
+            << " iterative_soft " << FieldParam.iterative_soft;
+    return key.str();
+}
+
+inline void remeshAndField(
+        FieldTriMesh& trimesh,
+        const Parameters& parameters,
+        const std::string& meshFilename,
+        const std::string& sharpFilename,
+        const std::string& fieldFilename,
+        const bool saveData,
+        RunStats* stats,
+        Deadline* deadline,
+        Progress* progress)
+{
+    typename MeshPrepocess<FieldTriMesh>::BatchParam BPar;
+    typename vcg::tri::FieldSmoother<FieldTriMesh>::SmoothParam FieldParam;
+    remeshAndFieldParameters(parameters, BPar, FieldParam);
+
+    //the remeshing is most of the stage, leave the rest to the field
+    if (deadline != nullptr && deadline->limited())
+        BPar.remesher_time_limit=0.7*deadline->stageRemaining();
+
+    BPar.progress=progress;
+
+    //one stage for each step of the batch processing
+    std::optional<RunStats::Scope> scope;
+    BPar.StageCallback = [&scope, stats](const std::string& name) {
+        scope.reset();
+        if (!name.empty())
+            scope.emplace(stats, name);
+    };
 
     if (parameters.hasFeature) {
+        scope.emplace(stats, "load_sharp_features");
         bool loaded=trimesh.LoadSharpFeatures(sharpFilename);
         if (!loaded)
         {
-            std::cout<<"ERROR: Wrong Sharp Feature File"<<std::endl;
-            exit(0);
+            throw std::runtime_error(std::string("failed to load sharp features from '") + sharpFilename + "'");
         }
         std::cout<<"Sharp Feature Length:"<<trimesh.SharpLenght()<<std::endl;
+        scope.reset();
     }
     if (!parameters.hasField) {
         MeshPrepocess<FieldTriMesh>::BatchProcess(trimesh,BPar,FieldParam);
+        if (BPar.DoRemesh && BPar.remesher_time_limit > 0 && BPar.remesher_iterations_done < static_cast<int>(BPar.remesher_iterations)) {
+            deadline->degrade("remeshed with " + std::to_string(BPar.remesher_iterations_done) + " of " +
+                              std::to_string(BPar.remesher_iterations) + " iterations");
+        }
     }
     else {
+        scope.emplace(stats, "load_field");
         bool success = trimesh.LoadField(fieldFilename.c_str());
         if (!success) {
             throw std::runtime_error(std::string("failed to load field  from '") + fieldFilename + "'");
         }
     }
 
-    MeshPrepocess<FieldTriMesh>::SaveAllData(trimesh,meshFilename);
+    scope.reset();
+
+    if (saveData) {
+        RunStats::Scope saveScope(stats, "save");
+        MeshPrepocess<FieldTriMesh>::SaveAllData(trimesh,meshFilename);
+    }
 }
 
+inline void fieldToTraceMesh(
+        FieldTriMesh& trimesh,
+        TraceMesh& traceTrimesh)
+{
+    //same data the tracer reads back from the _rem.obj/.rosy/.sharp files
+    vcg::tri::Allocator<FieldTriMesh>::CompactEveryVector(trimesh);
 
-inline void quadrangulate(
+    traceTrimesh.Clear();
+    vcg::tri::Allocator<TraceMesh>::AddVertices(traceTrimesh,trimesh.vert.size());
+    vcg::tri::Allocator<TraceMesh>::AddFaces(traceTrimesh,trimesh.face.size());
+
+    for (size_t i=0;i<trimesh.vert.size();i++)
+        traceTrimesh.vert[i].P()=TraceMesh::CoordType::Construct(trimesh.vert[i].P());
+
+    for (size_t i=0;i<trimesh.face.size();i++)
+    {
+        for (int j=0;j<3;j++)
+        {
+            size_t IndexV=vcg::tri::Index(trimesh,trimesh.face[i].V(j));
+            traceTrimesh.face[i].V(j)=&traceTrimesh.vert[IndexV];
+        }
+
+        //field
+        traceTrimesh.face[i].PD1()=TraceMesh::CoordType::Construct(trimesh.face[i].PD1());
+        traceTrimesh.face[i].PD2()=TraceMesh::CoordType::Construct(trimesh.face[i].PD2());
+
+        //sharp features
+        for (int j=0;j<3;j++)
+            if (trimesh.face[i].IsFaceEdgeS(j))
+                traceTrimesh.face[i].SetFaceEdgeS(j);
+    }
+
+    traceTrimesh.UpdateAttributes();
+    vcg::tri::CrossField<TraceMesh>::OrientDirectionFaceCoherently(traceTrimesh);
+    vcg::tri::CrossField<TraceMesh>::UpdateSingularByCross(traceTrimesh,true);
+    traceTrimesh.UpdateAttributes();
+}
+
+
+inline void loadTracedPatches(
         const std::string& filename,
         TriangleMesh& trimeshToQuadrangulate,
-        PolyMesh& quadmesh,
         std::vector<std::vector<size_t>>& trimeshPartitions,
         std::vector<std::vector<size_t>>& trimeshCorners,
         std::vector<std::pair<size_t,size_t>>& trimeshFeatures,
-        std::vector<size_t>& trimeshFeaturesC,
-        std::vector<std::vector<size_t>> quadmeshPartitions,
-        std::vector<std::vector<size_t>> quadmeshCorners,
-        std::vector<int> ilpResult,
-        const Parameters& parameters)
+        std::vector<size_t>& trimeshFeaturesC)
 {
     //Get base filename
     std::string baseFilename=filename;
@@ -66,37 +167,105 @@ inline void quadrangulate(
     std::string meshFilename=baseFilename;
     meshFilename.append("_p0.obj");
 
-    int mask;
-    vcg::tri::io::ImporterOBJ<TriangleMesh>::LoadMask(meshFilename.c_str(), mask);
-    int err = vcg::tri::io::ImporterOBJ<TriangleMesh>::Open(trimeshToQuadrangulate, meshFilename.c_str(), mask);
-    if ((err!=0)&&(err!=5)) {
-        throw std::runtime_error("error importing obj file " + meshFilename);
+    if (!FastMeshImporter<TriangleMesh>::OpenOBJ(trimeshToQuadrangulate, meshFilename)) {
+        int mask;
+        vcg::tri::io::ImporterOBJ<TriangleMesh>::LoadMask(meshFilename.c_str(), mask);
+        int err = vcg::tri::io::ImporterOBJ<TriangleMesh>::Open(trimeshToQuadrangulate, meshFilename.c_str(), mask);
+        if ((err!=0)&&(err!=5)) {
+            throw std::runtime_error("error importing obj file " + meshFilename);
+        }
     }
 
-    //FACE PARTITIONS
+    //PATCH DECOMPOSITION, from the binary container if it is up to date
+    std::string decompositionFilename = baseFilename;
+    decompositionFilename.append("_p0.pdec");
     std::string partitionFilename = baseFilename;
     partitionFilename.append("_p0.patch");
-    trimeshPartitions = loadPatches(partitionFilename);
-    std::cout<<"Loaded "<<trimeshPartitions.size()<<" patches"<<std::endl;
-
-    //PATCH CORNERS
-    std::string cornerFilename = baseFilename;
-    cornerFilename.append("_p0.corners");
-    trimeshCorners = loadCorners(cornerFilename);
-    std::cout<<"Loaded "<<trimeshCorners.size()<<" corners set"<<std::endl;
-
-    //FEATURES
-    std::string featureFilename = baseFilename;
-    featureFilename.append("_p0.feature");
-    trimeshFeatures = LoadFeatures(featureFilename);
-    std::cout<<"Loaded "<<trimeshFeatures.size()<<" features"<<std::endl;
-
-    //FEATURE CORNERS
-    std::string featureCFilename = baseFilename;
-    featureCFilename.append("_p0.c_feature");
-    trimeshFeaturesC = loadFeatureCorners(featureCFilename);
-    std::cout<<"Loaded "<<trimeshFeaturesC.size()<<" corner features"<<std::endl;
-    loadFeatureCorners(featureCFilename);
+
+    std::error_code ec;
+    bool useBinary = std::filesystem::exists(decompositionFilename, ec) &&
+            isPatchDecompositionCurrent(decompositionFilename, partitionFilename);
+
+    if (useBinary) {
+        loadPatchDecomposition(decompositionFilename, trimeshPartitions, trimeshCorners, trimeshFeatures, trimeshFeaturesC);
+        std::cout<<"Loaded "<<decompositionFilename<<std::endl;
+        std::cout<<"Loaded "<<trimeshPartitions.size()<<" patches"<<std::endl;
+        std::cout<<"Loaded "<<trimeshCorners.size()<<" corners set"<<std::endl;
+        std::cout<<"Loaded "<<trimeshFeatures.size()<<" features"<<std::endl;
+        std::cout<<"Loaded "<<trimeshFeaturesC.size()<<" corner features"<<std::endl;
+    }
+    else {
+        //FACE PARTITIONS
+        trimeshPartitions = loadPatches(partitionFilename);
+        std::cout<<"Loaded "<<trimeshPartitions.size()<<" patches"<<std::endl;
+
+        //PATCH CORNERS
+        std::string cornerFilename = baseFilename;
+        cornerFilename.append("_p0.corners");
+        trimeshCorners = loadCorners(cornerFilename);
+        std::cout<<"Loaded "<<trimeshCorners.size()<<" corners set"<<std::endl;
+
+        //FEATURES
+        std::string featureFilename = baseFilename;
+        featureFilename.append("_p0.feature");
+        trimeshFeatures = LoadFeatures(featureFilename);
+        std::cout<<"Loaded "<<trimeshFeatures.size()<<" features"<<std::endl;
+
+        //FEATURE CORNERS
+        std::string featureCFilename = baseFilename;
+        featureCFilename.append("_p0.c_feature");
+        trimeshFeaturesC = loadFeatureCorners(featureCFilename);
+        std::cout<<"Loaded "<<trimeshFeaturesC.size()<<" corner features"<<std::endl;
+    }
+}
+
+inline void traceToQuadrangulateMesh(
+        const TraceMesh& traceTrimesh,
+        TriangleMesh& trimeshToQuadrangulate)
+{
+    //same data the quadrangulation reads back from the _p0.obj file, the
+    //patch decomposition indexes the faces and vertices of the traced mesh
+    trimeshToQuadrangulate.Clear();
+    vcg::tri::Allocator<TriangleMesh>::AddVertices(trimeshToQuadrangulate,traceTrimesh.vert.size());
+    vcg::tri::Allocator<TriangleMesh>::AddFaces(trimeshToQuadrangulate,traceTrimesh.face.size());
+
+    for (size_t i=0;i<traceTrimesh.vert.size();i++)
+        trimeshToQuadrangulate.vert[i].P()=TriangleMesh::CoordType::Construct(traceTrimesh.vert[i].cP());
+
+    for (size_t i=0;i<traceTrimesh.face.size();i++)
+        for (int j=0;j<3;j++)
+        {
+            size_t IndexV=vcg::tri::Index(traceTrimesh,traceTrimesh.face[i].cV(j));
+            trimeshToQuadrangulate.face[i].V(j)=&trimeshToQuadrangulate.vert[IndexV];
+        }
+}
+
+inline void quadrangulate(
+        const std::string& filename,
+        TriangleMesh& trimeshToQuadrangulate,
+        PolyMesh& quadmesh,
+        std::vector<std::vector<size_t>>& trimeshPartitions,
+        std::vector<std::vector<size_t>>& trimeshCorners,
+        std::vector<std::pair<size_t,size_t>>& trimeshFeatures,
+        std::vector<size_t>& trimeshFeaturesC,
+        std::vector<std::vector<size_t>> quadmeshPartitions,
+        std::vector<std::vector<size_t>> quadmeshCorners,
+        std::vector<int> ilpResult,
+        const Parameters& parameters,
+        const bool loadData,
+        RunStats* stats,
+        Deadline* deadline,
+        Progress* progress)
+{
+    std::optional<RunStats::Scope> scope;
+    scope.emplace(stats, "load");
+
+    //Get base filename
+    std::string baseFilename=filename;
+    baseFilename.erase(baseFilename.find_last_of("."));
+
+    if (loadData)
+        loadTracedPatches(filename, trimeshToQuadrangulate, trimeshPartitions, trimeshCorners, trimeshFeatures, trimeshFeaturesC);
 
     std::cout<<"Alpha: "<<parameters.alpha<<std::endl;
 
@@ -122,6 +291,21 @@ inline void quadrangulate(
     qParameters.callbackTimeLimit.push_back(90.0);
     qParameters.callbackTimeLimit.push_back(120.0);
 
+    //with a deadline, half of the stage goes to the ILP and to the flow, the
+    //rest to the smoothing
+    const bool limited = deadline != nullptr && deadline->limited();
+    bool ilpLimited = false;
+    if (limited) {
+        const double solverLimit = 0.5*deadline->stageRemaining();
+        if (solverLimit < qParameters.timeLimit) {
+            ilpLimited = true;
+            qParameters.timeLimit=solverLimit;
+            while (!qParameters.callbackTimeLimit.empty() && qParameters.callbackTimeLimit.back() >= solverLimit)
+                qParameters.callbackTimeLimit.pop_back();
+        }
+        qParameters.flowTimeLimit=solverLimit;
+    }
+
     qParameters.callbackGapLimit.push_back(0.005);
     qParameters.callbackGapLimit.push_back(0.02);
     qParameters.callbackGapLimit.push_back(0.05);
@@ -164,18 +348,39 @@ inline void quadrangulate(
     qParameters.quadrangulationFixedSmoothingIterations = 0; //Smoothing with fixed borders of the patches
     qParameters.quadrangulationNonFixedSmoothingIterations = 0; //Smoothing with fixed borders of the quadrangulation
     qParameters.feasibilityFix = false;
+    qParameters.patternCacheFilename = parameters.patternCacheFile;
 
     double edgeSize=avgEdge(trimeshToQuadrangulate)*scaleFactor;
     std::cout<<"Edge size: "<<edgeSize<<std::endl;
     const std::vector<double> edgeFactor(trimeshPartitions.size(), edgeSize);
 
-    qfp::quadrangulationFromPatches(trimeshToQuadrangulate, trimeshPartitions, trimeshCorners, edgeFactor, qParameters, fixedChartClusters, quadmesh, quadmeshPartitions, quadmeshCorners, ilpResult);
+    scope.reset();
+    scope.emplace(stats, "quadrangulation_from_patches");
+    //a cancellation throws out of quadrangulationFromPatches, but only from the
+    //calling thread, after the parallel chart loop; the stage scopes unwind it
+    if (progress != nullptr) {
+        qParameters.progressCallback = [progress](const std::string& stage, double fraction) {
+            return progress->update(stage, fraction);
+        };
+    }
+    auto qfpResult = qfp::quadrangulationFromPatches(trimeshToQuadrangulate, trimeshPartitions, trimeshCorners, edgeFactor, qParameters, fixedChartClusters, quadmesh, quadmeshPartitions, quadmeshCorners, ilpResult);
+    if (stats != nullptr)
+        stats->addStopWatch(qfpResult.stopwatch);
+    if (ilpLimited && qfpResult.ilpTimeLimitReached)
+        deadline->degrade("ILP stopped at its time limit");
+    if (limited && qfpResult.flowResolveSkipped)
+        deadline->degrade("skipped the flow resolve");
 
     //SAVE OUTPUT
+    scope.reset();
+    scope.emplace(stats, "save");
     std::string outputFilename = baseFilename;
     outputFilename+=std::string("_quadrangulation")+std::string(".obj");
     vcg::tri::io::ExporterOBJ<PolyMesh>::Save(quadmesh, outputFilename.c_str(),0);
 
+    scope.reset();
+    scope.emplace(stats, "multi_constraint_smooth");
+
 
     //SMOOTH
     std::vector<size_t> QuadPart(quadmesh.face.size(),0);
@@ -198,7 +403,18 @@ inline void quadrangulate(
     QuadCornersVect.erase(last, QuadCornersVect.end());
 
     std::cout<<"** SMOOTHING **"<<std::endl;
-    MultiCostraintSmooth(quadmesh,trimeshToQuadrangulate,trimeshFeatures,trimeshFeaturesC,TriPart,QuadCornersVect,QuadPart,0.5,edgeSize,30,1);
+    //with a deadline, stop at convergence or when the stage is over
+    const size_t smoothSteps=30;
+    const double smoothLimit=limited ? deadline->stageRemaining() : 0;
+    const auto smoothStart=std::chrono::steady_clock::now();
+    const size_t stepsDone=MultiCostraintSmooth(quadmesh,trimeshToQuadrangulate,trimeshFeatures,trimeshFeaturesC,TriPart,QuadCornersVect,QuadPart,0.5,edgeSize,smoothSteps,1,
+                                                smoothLimit,limited ? 1e-3 : 0,progress);
+    if (limited && stepsDone < smoothSteps &&
+            std::chrono::duration<double>(std::chrono::steady_clock::now()-smoothStart).count() >= smoothLimit)
+        deadline->degrade("smoothed with " + std::to_string(stepsDone) + " of " + std::to_string(smoothSteps) + " steps");
+
+    scope.reset();
+    scope.emplace(stats, "save");
 
     //SAVE OUTPUT
     std::string smoothOutputFilename = baseFilename;
@@ -226,30 +442,249 @@ inline typename TriangleMesh::ScalarType avgEdge(const TriangleMesh& trimesh)
 
 inline bool loadConfigFile(const std::string& filename, Parameters& parameters)
 {
-    FILE *f=fopen(filename.c_str(),"rt");
+    std::ifstream f(filename);
 
-    if (f==NULL) {
+    if (!f.is_open()) {
         throw std::runtime_error(std::string("Failed to open config file ") + filename);
     }
 
     std::cout<<"READ CONFIG FILE"<<std::endl;
 
-    int IntVar;
-    fscanf(f,"do_remesh %d\n",&IntVar);
-    if (IntVar==0)
-        parameters.remesh=false;
-    else
-        parameters.remesh=true;
+    //flags are written as 0/1
+    auto readFlag = [](std::istream& stream, bool& flag) {
+        int value;
+        if (!(stream >> value))
+            return false;
+        flag = (value != 0);
+        return true;
+    };
+
+    //one "key value" per line, in any order; keys not given keep their default
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(f, line)) {
+        lineNumber++;
+        std::istringstream stream(line);
+        std::string key;
+        if (!(stream >> key))
+            continue;
+
+        bool valid = true;
+        if (key == "do_remesh")
+            valid = readFlag(stream, parameters.remesh);
+        else if (key == "sharp_feature_thr")
+            valid = static_cast<bool>(stream >> parameters.sharpAngle);
+        else if (key == "alpha")
+            valid = static_cast<bool>(stream >> parameters.alpha);
+        else if (key == "scaleFact")
+            valid = static_cast<bool>(stream >> parameters.scaleFact);
+        else if (key == "in_memory")
+            valid = readFlag(stream, parameters.inMemory);
+        else if (key == "save_intermediate")
+            valid = readFlag(stream, parameters.saveIntermediate);
+        else if (key == "binary_patches")
+            valid = readFlag(stream, parameters.binaryPatches);
+        else if (key == "cache_dir")
+            valid = static_cast<bool>(stream >> parameters.cacheDir);
+        else if (key == "iterative_field")
+            valid = readFlag(stream, parameters.iterativeField);
+        else if (key == "field_tolerance")
+            valid = static_cast<bool>(stream >> parameters.fieldTolerance);
+        else if (key == "pattern_cache")
+            valid = static_cast<bool>(stream >> parameters.patternCacheFile);
+        else {
+            std::cout << "Warning: unknown key '" << key << "' in config file " << filename
+                      << " at line " << lineNumber << ", ignored" << std::endl;
+            continue;
+        }
 
-    fscanf(f,"sharp_feature_thr %f\n",&parameters.sharpAngle);
+        if (!valid) {
+            throw std::runtime_error("invalid value for '" + key + "' in config file " + filename +
+                                     " at line " + std::to_string(lineNumber));
+        }
+    }
+
+    std::cout << "Successful config import" << std::endl;
+
+    return true;
+}
+
+inline StageCacheReport processMesh(
+        const std::string& meshFilename,
+        const std::string& sharpFilename,
+        const std::string& fieldFilename,
+        const Parameters& parameters,
+        const int stopAfterStep,
+        RunStats* stats,
+        Deadline* deadline,
+        Progress* progress)
+{
+    FieldTriMesh trimesh;
+    TraceMesh traceTrimesh;
 
-    fscanf(f,"alpha %f\n",&parameters.alpha);
+    TriangleMesh trimeshToQuadrangulate;
+    std::vector<std::vector<size_t>> trimeshPartitions;
+    std::vector<std::vector<size_t>> trimeshCorners;
+    std::vector<std::pair<size_t,size_t> > trimeshFeatures;
+    std::vector<size_t> trimeshFeaturesC;
 
-    fscanf(f,"scaleFact %f\n",&parameters.scaleFact);
+    TracedPatches tracedPatches;
+    bool tracedInMemory = false;
 
-    fclose(f);
+    PolyMesh quadmesh;
+    std::vector<std::vector<size_t>> quadmeshPartitions;
+    std::vector<std::vector<size_t>> quadmeshCorners;
+    std::vector<int> ilpResult;
 
-    std::cout << "Successful config import" << std::endl;
+    StageCacheReport report;
 
-    return true;
+    if (meshFilename.size() < 4) {
+        throw std::runtime_error(std::string("invalid mesh filename '") + meshFilename + "'");
+    }
+    auto meshFilenamePrefix = std::string(meshFilename.begin(), meshFilename.end() - 4);
+    const std::string remeshedPrefix = meshFilenamePrefix + "_rem";
+    const std::string tracedPrefix = remeshedPrefix + "_p0";
+
+    //Keys of the cached stages: each one depends on the previous one
+    StageCache cache(parameters.cacheDir);
+    uint64_t remeshKey = 0;
+    uint64_t traceKey = 0;
+    TraceSettings traceSettings;
+    if (cache.enabled()) {
+        remeshKey = StageCache::hashFile(meshFilename);
+        if (parameters.hasFeature)
+            remeshKey = StageCache::hashFile(sharpFilename, remeshKey);
+        if (parameters.hasField)
+            remeshKey = StageCache::hashFile(fieldFilename, remeshKey);
+        remeshKey = StageCache::hashString(remeshAndFieldKey(parameters), remeshKey);
+        traceKey = StageCache::hashString(traceSettings.key(), remeshKey);
+    }
+
+    bool traceHit = false;
+    bool remeshHit = false;
+    if (cache.enabled()) {
+        RunStats::Scope scope(stats, "stage_cache");
+        traceHit = stopAfterStep >= 2 && cache.restore("trace", traceKey, tracedPrefix);
+        remeshHit = cache.restore("remesh_field", remeshKey, remeshedPrefix);
+    }
+
+    //the stages still to run share the time of the deadline
+    if (deadline != nullptr) {
+        std::vector<std::string> stages;
+        if (!remeshHit && !traceHit)
+            stages.push_back("remesh_and_field");
+        if (stopAfterStep >= 2 && !traceHit)
+            stages.push_back("trace");
+        if (stopAfterStep >= 3)
+            stages.push_back("quadrangulate");
+        deadline->setStages(stages);
+    }
+
+    std::cout<<std::endl<<"--------------------- 1 - Remesh and field ---------------------"<<std::endl;
+    if (remeshHit) {
+        std::cout<<"Restored "<<remeshedPrefix<<" from the stage cache"<<std::endl;
+        report.add("1 - Remesh and field", "hit");
+    }
+    else if (traceHit) {
+        report.add("1 - Remesh and field", "skipped");
+    }
+    else {
+        std::cout<<"Loading:"<<meshFilename.c_str()<<std::endl;
+
+        {
+            RunStats::Scope scope(stats, "load_mesh");
+            bool allQuad;
+            bool loaded=trimesh.LoadTriMesh(meshFilename,allQuad);
+            if (!loaded) {
+                throw std::runtime_error(std::string("failed to load mesh from '") + meshFilename + "'");
+            }
+            trimesh.UpdateDataStructures();
+        }
+
+        std::cout<<"Loaded "<<trimesh.fn<<" faces and "<<trimesh.vn<<" vertices"<<std::endl;
+
+        bool saveRemeshed = !parameters.inMemory || parameters.saveIntermediate || stopAfterStep == 1 || cache.enabled();
+        {
+            RunStats::Scope scope(stats, "remesh_and_field");
+            Scheduler::Stage threads("remesh_and_field");
+            Deadline::Scope deadlineScope(deadline, "remesh_and_field");
+            remeshAndField(trimesh, parameters, meshFilename, sharpFilename, fieldFilename, saveRemeshed, stats, deadline, progress);
+        }
+        //a result degraded to meet the deadline is not reused by other runs
+        if (deadline != nullptr && deadline->degraded("remesh_and_field")) {
+            report.add("1 - Remesh and field", "degraded");
+        }
+        else {
+            cache.store("remesh_field", remeshKey, remeshedPrefix);
+            report.add("1 - Remesh and field", "computed");
+        }
+    }
+    if (stopAfterStep == 1) {
+        report.print();
+        return report;
+    }
+
+    std::cout<<std::endl<<"--------------------- 2 - Tracing ---------------------"<<std::endl;
+    if (traceHit) {
+        std::cout<<"Restored "<<tracedPrefix<<" from the stage cache"<<std::endl;
+        report.add("2 - Tracing", "hit");
+    }
+    else {
+        RunStats::Scope scope(stats, "trace");
+        Scheduler::Stage threads("trace");
+        Deadline::Scope deadlineScope(deadline, "trace");
+        //the patch decomposition goes to the quadrangulation in memory, the
+        //files are written only when they are kept or reloaded
+        const bool saveTraced = parameters.saveIntermediate || stopAfterStep == 2 || cache.enabled();
+        const bool saveBinary = saveTraced && parameters.binaryPatches;
+        TracedPatches* patches = (stopAfterStep >= 3 || saveBinary) ? &tracedPatches : nullptr;
+
+        //the remeshed mesh is in memory only if stage 1 was computed
+        if (parameters.inMemory && !remeshHit) {
+            fieldToTraceMesh(trimesh, traceTrimesh);
+            traceLoadedMesh(remeshedPrefix, traceTrimesh, traceSettings, stats, deadline, progress, patches, saveTraced);
+        }
+        else if (!trace(remeshedPrefix, traceTrimesh, traceSettings, stats, deadline, progress, patches, saveTraced)) {
+            throw std::runtime_error(std::string("failed to trace '") + remeshedPrefix + "'");
+        }
+        //the tracer writes text files, keep a binary copy for the next runs
+        if (saveBinary) {
+            RunStats::Scope binaryScope(stats, "save_binary");
+            savePatchDecomposition(tracedPrefix + ".pdec", tracedPatches.partitions, tracedPatches.corners,
+                                   tracedPatches.features, tracedPatches.featuresC, tracedPrefix + ".patch");
+        }
+        if (stopAfterStep >= 3) {
+            RunStats::Scope copyScope(stats, "copy_mesh");
+            traceToQuadrangulateMesh(traceTrimesh, trimeshToQuadrangulate);
+            trimeshPartitions = std::move(tracedPatches.partitions);
+            trimeshCorners = std::move(tracedPatches.corners);
+            trimeshFeatures = std::move(tracedPatches.features);
+            trimeshFeaturesC = std::move(tracedPatches.featuresC);
+            tracedInMemory = true;
+        }
+        //the cached trace key assumes a full remeshing
+        if (deadline != nullptr && (deadline->degraded("remesh_and_field") || deadline->degraded("trace"))) {
+            report.add("2 - Tracing", "degraded");
+        }
+        else {
+            cache.store("trace", traceKey, tracedPrefix);
+            report.add("2 - Tracing", "computed");
+        }
+    }
+    if (stopAfterStep == 2) {
+        report.print();
+        return report;
+    }
+
+    std::cout<<std::endl<<"--------------------- 3 - Quadrangulation ---------------------"<<std::endl;
+    {
+        RunStats::Scope scope(stats, "quadrangulate");
+        Scheduler::Stage threads("quadrangulate");
+        Deadline::Scope deadlineScope(deadline, "quadrangulate");
+        quadrangulate(remeshedPrefix + ".obj", trimeshToQuadrangulate, quadmesh, trimeshPartitions, trimeshCorners, trimeshFeatures, trimeshFeaturesC, quadmeshPartitions, quadmeshCorners, ilpResult, parameters, !tracedInMemory, stats, deadline, progress);
+    }
+    report.add("3 - Quadrangulation", deadline != nullptr && deadline->degraded("quadrangulate") ? "degraded" : "computed");
+
+    report.print();
+    return report;
 }
@@ -11,6 +11,19 @@
 #include <smooth_mesh.h>
 #include <quad_from_patches.h>
 #include <quad_mesh_tracer.h>
+#include <scheduler.h>
+#include <progress.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include "deadline.h"
+#include "run_stats.h"
+#include "stage_cache.h"
 
 struct Parameters {
     Parameters() :
@@ -19,7 +32,14 @@ struct Parameters {
         alpha(0.02),
         scaleFact(1),
         hasFeature(false),
-        hasField(false)
+        hasField(false),
+        inMemory(false),
+        saveIntermediate(true),
+        binaryPatches(true),
+        cacheDir(),
+        iterativeField(false),
+        fieldTolerance(1e-6),
+        patternCacheFile()
     {
 
     }
@@ -30,6 +50,13 @@ struct Parameters {
     float scaleFact;
     bool hasFeature;
     bool hasField;
+    bool inMemory;         //pass the remeshed mesh to the tracer without reloading it
+    bool saveIntermediate; //save the _rem files also when they are not reloaded
+    bool binaryPatches;    //save the patch decomposition also as .pdec, read when a trace is reloaded
+    std::string cacheDir;  //directory of the stage cache, empty to disable it
+    bool iterativeField;   //solve the field iteratively (multigrid CG), for meshes too big to factorize
+    float fieldTolerance;  //relative residual at which the iterative field solver stops
+    std::string patternCacheFile; //file keeping the quadrangulation patterns between runs, empty for none
 };
 
 void remeshAndField(
@@ -37,8 +64,32 @@ void remeshAndField(
         const Parameters& parameters,
         const std::string& meshFilename,
         const std::string& sharpFilename,
-        const std::string& fieldFilename);
+        const std::string& fieldFilename,
+        const bool saveData = true,
+        RunStats* stats = nullptr,
+        Deadline* deadline = nullptr,
+        Progress* progress = nullptr);
+
+void fieldToTraceMesh(
+        FieldTriMesh& trimesh,
+        TraceMesh& traceTrimesh);
+
+//read the traced mesh <path without extension>_p0.obj and its patch
+//decomposition, from the .pdec if it is up to date
+void loadTracedPatches(
+        const std::string& path,
+        TriangleMesh& trimeshToQuadrangulate,
+        std::vector<std::vector<size_t>>& trimeshPartitions,
+        std::vector<std::vector<size_t>>& trimeshCorners,
+        std::vector<std::pair<size_t,size_t>>& trimeshFeatures,
+        std::vector<size_t>& trimeshFeaturesC);
 
+void traceToQuadrangulateMesh(
+        const TraceMesh& traceTrimesh,
+        TriangleMesh& trimeshToQuadrangulate);
+
+//with loadData, the traced mesh and its patches are read by loadTracedPatches,
+//otherwise they are given
 void quadrangulate(
         const std::string& path,
         TriangleMesh& trimeshToQuadrangulate,
@@ -50,11 +101,31 @@ void quadrangulate(
         std::vector<std::vector<size_t>> quadmeshPartitions,
         std::vector<std::vector<size_t>> quadmeshCorners,
         std::vector<int> ilpResult,
-        const Parameters& parameters);
+        const Parameters& parameters,
+        const bool loadData = true,
+        RunStats* stats = nullptr,
+        Deadline* deadline = nullptr,
+        Progress* progress = nullptr);
 
 typename TriangleMesh::ScalarType avgEdge(const TriangleMesh& trimesh);
 bool loadConfigFile(const std::string& filename, Parameters& parameters);
 
+//run the pipeline on a single mesh, stopping after step 1 (remesh and field),
+//2 (tracing) or 3 (quadrangulation). Stages whose inputs did not change are
+//restored from the stage cache, timing and memory of the stages are recorded
+//in stats if given. With a deadline, each stage fits its work in its share of
+//the time. The long loops report to progress, cancelling it stops the run with
+//Progress::Cancelled. Errors are reported as std::runtime_error
+StageCacheReport processMesh(
+        const std::string& meshFilename,
+        const std::string& sharpFilename,
+        const std::string& fieldFilename,
+        const Parameters& parameters,
+        const int stopAfterStep,
+        RunStats* stats = nullptr,
+        Deadline* deadline = nullptr,
+        Progress* progress = nullptr);
+
 #include "functions.cpp"
 
 #endif // FUNCTIONS_H
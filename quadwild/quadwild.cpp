@@ -26,7 +26,15 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <iomanip>
 #include <clocale>
 
-#include "functions.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "server.h"
+
+#include <scheduler.h>
 #ifdef _WIN32
 #  include <windows.h>
 #  include <stdlib.h>
@@ -41,130 +49,121 @@ int actual_main(int argc, char* argv[])
     // any signs of a an application crash!
     SetErrorMode(0);
 #endif
-    Parameters parameters;
-
-    FieldTriMesh trimesh;
-    TraceMesh traceTrimesh;
-
-    TriangleMesh trimeshToQuadrangulate;
-    std::vector<std::vector<size_t>> trimeshPartitions;
-    std::vector<std::vector<size_t>> trimeshCorners;
-    std::vector<std::pair<size_t,size_t> > trimeshFeatures;
-    std::vector<size_t> trimeshFeaturesC;
-
-    PolyMesh quadmesh;
-    std::vector<std::vector<size_t>> quadmeshPartitions;
-    std::vector<std::vector<size_t>> quadmeshCorners;
-    std::vector<int> ilpResult;
+    Scheduler::parseOptions(argc, argv);
 
     if (argc < 2)
     {
         std::cerr << "usage: " << argv[0]
                   << " <mesh.{obj,ply}>"
                      " [1|2|3]"
-                     " [*.sharp|*.rosy|*.txt]....\n"
+                     " [*.sharp|*.rosy|*.txt|*.json].... [--deadline <time>]\n"
                      " The 1|2|3 parameter determines after which step to stop:\n"
                      "   1: Remesh and field\n"
                      "   2: Tracing\n"
-                     "   3: Quadrangulation (default)\n";
+                     "   3: Quadrangulation (default)\n"
+                     " A .json file receives the timing and memory report of the stages.\n"
+                     " --deadline (e.g. 60s, 500ms, 2m) splits the time among the stages, which\n"
+                     "   do less work to meet it. Where the time went is reported at the end.\n"
+                  << "       " << argv[0]
+                  << " --batch <manifest.txt> [--jobs N] [--threads-per-job N] [--memory-mb N] [--memory-per-byte N]\n"
+                     " Each line of the manifest holds the arguments of a single mesh.\n"
+                     " The results of each mesh are written to <mesh>_result.json.\n"
+                     " --memory-mb starts meshes only while their estimated memory fits, the\n"
+                     "   estimate being --memory-per-byte (default 64) times the mesh file size.\n"
+                     "   With --jobs 1, memory_per_input_byte in the results is the measured one.\n"
+                  << "       " << argv[0]
+                  << " --serve [--socket <path>] [--jobs N] [--threads-per-job N]\n"
+                     " Process the jobs received as JSON lines on the socket (or stdin).\n"
+                  << "       " << argv[0]
+                  << " --client <path>\n"
+                     " Send the JSON lines of stdin to a server and print its answers.\n"
+                     "Options of all the modes:\n"
+                     " --threads N: threads used by the process (default: all the cores)\n"
+                     " --stage-threads <stage>=N[,<stage>=N...]: limit the threads of the stages\n"
+                     "   remesh_and_field, trace and quadrangulate\n";
         return 1;
     }
 
-    std::string meshFilename=argv[1];
-    if (meshFilename.size() < 4) {
-        std::cerr << "invalid mesh filename '" << meshFilename << "'" << std::endl;
-        return 1;
-    }
-    auto meshFilenamePrefix = std::string(meshFilename.begin(), meshFilename.end() - 4);
-
-    int stopAfterStep = 3;
-    if (argc >= 2) {
-        stopAfterStep = std::atoi(argv[2]);
-        if (stopAfterStep < 1 || stopAfterStep > 3) {
-            std::cerr << "unknown step '" << argv[2]
-                << "' to stop after. valid: 1, 2, 3" << std::endl;
-            return 1;
-        }
-    }
-
-
-    std::string sharpFilename;
-    std::string fieldFilename;
-
     //Use "." as decimal separator
     std::setlocale(LC_NUMERIC, "en_US.UTF-8");
 
-    std::cout<<"Reading input..."<<std::endl;
-
-    std::string configFile = "basic_setup.txt";
-    for (int i=3;i<argc;i++)
+    if (std::string(argv[1]) == "--batch")
     {
-        int position;
-
-        std::string pathTest=std::string(argv[i]);
-
-        position=pathTest.find(".sharp");
-        if (position!=-1)
-        {
-            sharpFilename=pathTest;
-            parameters.hasFeature=true;
-            continue;
+        if (argc < 3) {
+            std::cerr << "missing batch manifest" << std::endl;
+            return 1;
         }
 
-        position=pathTest.find(".txt");
-        if (position!=-1)
+        BatchOptions options;
+        for (int i=3;i<argc;i++)
         {
-           configFile = pathTest;
-           loadConfigFile(pathTest.c_str(), parameters);
-           continue;
+            std::string option=argv[i];
+            if (i+1 >= argc) {
+                std::cerr << "missing value for '" << option << "'" << std::endl;
+                return 1;
+            }
+            size_t value=std::strtoul(argv[++i], nullptr, 10);
+            if (option == "--jobs")
+                options.jobs=value;
+            else if (option == "--threads-per-job")
+                options.threadsPerJob=value;
+            else if (option == "--memory-mb")
+                options.memoryBudgetMB=value;
+            else if (option == "--memory-per-byte")
+                options.memoryPerInputByte=value;
+            else {
+                std::cerr << "unknown batch option '" << option << "'" << std::endl;
+                return 1;
+            }
         }
 
-        position=pathTest.find(".rosy");
-        if (position!=-1)
-        {
-           fieldFilename=pathTest;
-           parameters.hasField=true;
-           continue;
-        }
-        std::cerr << "don't know what to do with optional parameter '"
-                  << pathTest
-                  << "'. Please supply .sharp, .txt or .rosy files."
-                  << std::endl;
-        return 1;
+        std::vector<BatchJob> jobs=loadBatchManifest(argv[2]);
+        size_t failed=runBatch(jobs, options);
+        return failed > 0 ? 1 : 0;
     }
-    loadConfigFile(configFile, parameters);
-
 
-    std::cout<<"Loading:"<<meshFilename.c_str()<<std::endl;
-
-    bool allQuad;
-    bool loaded=trimesh.LoadTriMesh(meshFilename,allQuad);
-    trimesh.UpdateDataStructures();
-
-    if (!loaded)
+    if (std::string(argv[1]) == "--serve")
     {
-        std::cout<<"Wrong mesh filename"<<std::endl;
-        exit(0);
-    }
-
-    std::cout<<"Loaded "<<trimesh.fn<<" faces and "<<trimesh.vn<<" vertices"<<std::endl;
+        ServerOptions options;
+        for (int i=2;i<argc;i++)
+        {
+            std::string option=argv[i];
+            if (i+1 >= argc) {
+                std::cerr << "missing value for '" << option << "'" << std::endl;
+                return 1;
+            }
+            std::string value=argv[++i];
+            if (option == "--socket")
+                options.socketPath=value;
+            else if (option == "--jobs")
+                options.jobs=std::strtoul(value.c_str(), nullptr, 10);
+            else if (option == "--threads-per-job")
+                options.threadsPerJob=std::strtoul(value.c_str(), nullptr, 10);
+            else {
+                std::cerr << "unknown server option '" << option << "'" << std::endl;
+                return 1;
+            }
+        }
 
-    std::cout<<std::endl<<"--------------------- 1 - Remesh and field ---------------------"<<std::endl;
-    remeshAndField(trimesh, parameters, meshFilename, sharpFilename, fieldFilename);
-    if (stopAfterStep == 1) {
+        runServer(options);
         return 0;
     }
 
-    std::cout<<std::endl<<"--------------------- 2 - Tracing ---------------------"<<std::endl;
-
-    meshFilenamePrefix += "_rem";
-    trace(meshFilenamePrefix, traceTrimesh);
-    if (stopAfterStep == 2) {
-        return 0;
+    if (std::string(argv[1]) == "--client")
+    {
+        if (argc < 3) {
+            std::cerr << "missing server socket" << std::endl;
+            return 1;
+        }
+        size_t failed=runClient(argv[2]);
+        return failed > 0 ? 1 : 0;
     }
 
-    std::cout<<std::endl<<"--------------------- 3 - Quadrangulation ---------------------"<<std::endl;
-    quadrangulate(meshFilenamePrefix + ".obj", trimeshToQuadrangulate, quadmesh, trimeshPartitions, trimeshCorners, trimeshFeatures, trimeshFeaturesC, quadmeshPartitions, quadmeshCorners, ilpResult, parameters);
+    BatchJob job;
+    parseJobArguments(std::vector<std::string>(argv + 1, argv + argc), job);
+
+    std::cout<<"Reading input..."<<std::endl;
+    runJob(job);
     return 0;
 }
 
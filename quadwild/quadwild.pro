@@ -4,11 +4,21 @@ include(../libs/libs.pri)
 include($$QUADRETOPOLOGY_PATH/quadretopology.pri)
 
 SOURCES += \
+    batch.cpp \
+    deadline.cpp \
     functions.cpp \
-    quadwild.cpp
+    quadwild.cpp \
+    run_stats.cpp \
+    server.cpp \
+    stage_cache.cpp
 
 HEADERS += \
-    functions.h
+    batch.h \
+    deadline.h \
+    functions.h \
+    run_stats.h \
+    server.h \
+    stage_cache.h
 
 ############################ TARGET ############################
 
@@ -55,6 +65,7 @@ macx {
 MESHFIELD_PATH = ../components/field_computation
 MESHTRACE_PATH =../components/field_tracing
 QUADRANGULATE_PATH = ../components/quad_from_patches
+THREADING_PATH = ../components/threading
 
 HEADERS += \
     $$LIBIGL_PATH/include/igl/principal_curvature.h \
@@ -80,6 +91,9 @@ INCLUDEPATH += $$MESHFIELD_PATH
 INCLUDEPATH += $$MESHTRACE_PATH
 INCLUDEPATH += $$QUADRANGULATE_PATH
 
+#threading
+INCLUDEPATH += $$THREADING_PATH
+
 #Comiso
 contains(DEFINES, COMISO_FIELD) {
     LIBS += -L$$COMISO_PATH/build/Build/lib/CoMISo/ -lCoMISo
@@ -0,0 +1,287 @@
+#include "run_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <new>
+
+#include <libTimekeeper/json.hh>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+//Allocation counters, updated by the replaced global operator new. Each thread
+//counts in its own slot, without contention, and the slots are summed when the
+//counters are read. The slots are linked without allocating, as operator new
+//itself registers them
+namespace {
+
+struct AllocationSlot {
+    std::atomic<size_t> allocations;
+    std::atomic<size_t> bytes;
+    AllocationSlot* next;
+    bool registered;
+};
+
+std::mutex slotsMutex;
+AllocationSlot* slots = nullptr;
+//counts of the threads that have exited
+std::atomic<size_t> retiredAllocations{0};
+std::atomic<size_t> retiredBytes{0};
+
+//trivially destructible, so that it stays usable while the thread exits
+thread_local AllocationSlot threadSlot;
+
+//moves the counts of the thread to the retired ones when it exits
+struct SlotRetirer {
+    ~SlotRetirer()
+    {
+        std::lock_guard<std::mutex> lock(slotsMutex);
+        for (AllocationSlot** slot = &slots; *slot != nullptr; slot = &(*slot)->next) {
+            if (*slot == &threadSlot) {
+                *slot = threadSlot.next;
+                break;
+            }
+        }
+        retiredAllocations.fetch_add(threadSlot.allocations.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        retiredBytes.fetch_add(threadSlot.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+};
+
+void countAllocation(std::size_t size)
+{
+    AllocationSlot& slot = threadSlot;
+    if (!slot.registered) {
+        slot.registered = true;
+        static thread_local SlotRetirer retirer;
+        std::lock_guard<std::mutex> lock(slotsMutex);
+        slot.next = slots;
+        slots = &slot;
+    }
+    //only this thread writes the slot
+    slot.allocations.store(slot.allocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    slot.bytes.store(slot.bytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+}
+
+template<class Member>
+size_t sumSlots(const std::atomic<size_t>& retired, Member member)
+{
+    std::lock_guard<std::mutex> lock(slotsMutex);
+    size_t sum = retired.load(std::memory_order_relaxed);
+    for (const AllocationSlot* slot = slots; slot != nullptr; slot = slot->next)
+        sum += (slot->*member).load(std::memory_order_relaxed);
+    return sum;
+}
+
+}
+
+size_t allocationCount()
+{
+    return sumSlots(retiredAllocations, &AllocationSlot::allocations);
+}
+
+size_t allocatedBytes()
+{
+    return sumSlots(retiredBytes, &AllocationSlot::bytes);
+}
+
+void* operator new(std::size_t size)
+{
+    countAllocation(size);
+
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+//Peak resident set size of the process in bytes
+static size_t peakRSS()
+{
+#ifdef __linux__
+    //VmHWM follows the resets of /proc/self/clear_refs, ru_maxrss does not
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    while (status >> key) {
+        if (key == "VmHWM:") {
+            size_t kB;
+            status >> kB;
+            return kB * 1024;
+        }
+        status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+#endif
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+//Reset the peak resident set size to the current one, where supported
+static void resetPeakRSS()
+{
+#ifdef __linux__
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs.is_open())
+        clearRefs << "5";
+#endif
+}
+
+RunStats::RunStats(const std::string& name, bool perStagePeak) :
+    perStagePeak(perStagePeak)
+{
+    //the peak left by a previous run in the same process is not this run's
+    if (perStagePeak)
+        resetPeakRSS();
+
+    nodes.emplace_back(name);
+    current = &nodes.back();
+    current->name = name;
+    current->startAllocations = allocationCount();
+    current->startAllocatedBytes = allocatedBytes();
+    current->sw.resume();
+}
+
+void RunStats::setStageListener(const StageListener& listener)
+{
+    this->listener = listener;
+}
+
+std::string RunStats::path(const Node& node) const
+{
+    if (node.parent == nullptr)
+        return node.name;
+    return path(*node.parent) + "/" + node.name;
+}
+
+void RunStats::finish()
+{
+    while (current->parent != nullptr)
+        end();
+
+    Node& root = nodes.front();
+    updatePeaks();
+    root.allocations += allocationCount() - root.startAllocations;
+    root.allocatedBytes += allocatedBytes() - root.startAllocatedBytes;
+    root.startAllocations = allocationCount();
+    root.startAllocatedBytes = allocatedBytes();
+    root.sw.stop();
+}
+
+void RunStats::updatePeaks()
+{
+    const size_t peak = peakRSS();
+    for (Node* node = current; node != nullptr; node = node->parent)
+        node->peakRSS = std::max(node->peakRSS, peak);
+}
+
+void RunStats::begin(const std::string& name)
+{
+    updatePeaks();
+    if (perStagePeak)
+        resetPeakRSS();
+
+    //A stage entered again is accumulated in the same node
+    Node* node = nullptr;
+    for (Node* child : current->children) {
+        if (child->name == name)
+            node = child;
+    }
+    if (node == nullptr) {
+        nodes.emplace_back(name, *current);
+        node = &nodes.back();
+        node->name = name;
+        node->parent = current;
+        current->children.push_back(node);
+    }
+
+    current = node;
+    current->startAllocations = allocationCount();
+    current->startAllocatedBytes = allocatedBytes();
+    current->sw.resume();
+
+    if (listener)
+        listener(path(*current), true);
+}
+
+void RunStats::end()
+{
+    current->sw.stop();
+    updatePeaks();
+    current->allocations += allocationCount() - current->startAllocations;
+    current->allocatedBytes += allocatedBytes() - current->startAllocatedBytes;
+    if (listener)
+        listener(path(*current), false);
+    current = current->parent;
+}
+
+RunStats::Scope::Scope(RunStats* stats, const std::string& name) :
+    stats(stats)
+{
+    if (stats != nullptr)
+        stats->begin(name);
+}
+
+RunStats::Scope::~Scope()
+{
+    if (stats != nullptr)
+        stats->end();
+}
+
+void RunStats::addStopWatch(const Timekeeper::HierarchicalStopWatchResult& result)
+{
+    attached.push_back(result);
+}
+
+Timekeeper::HierarchicalStopWatchResult RunStats::stopWatchResult() const
+{
+    auto result = Timekeeper::HierarchicalStopWatchResult(nodes.front().sw);
+    for (const auto& r : attached)
+        result.add_child(r);
+    return result;
+}
+
+nlohmann::json RunStats::memoryJson(const Node& node) const
+{
+    nlohmann::json j = {
+        {"name", node.name},
+        {"peak_rss_bytes", node.peakRSS},
+        {"allocations", node.allocations},
+        {"allocated_bytes", node.allocatedBytes}};
+    for (const Node* child : node.children)
+        j["children"].push_back(memoryJson(*child));
+    return j;
+}
+
+nlohmann::json RunStats::memoryJson() const
+{
+    return memoryJson(nodes.front());
+}
+
+nlohmann::json RunStats::toJson() const
+{
+    return nlohmann::json{
+        {"runtimes", stopWatchResult()},
+        {"memory", memoryJson()}};
+}
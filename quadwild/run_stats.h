@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <libTimekeeper/StopWatch.hh>
+#include <nlohmann/json.hpp>
+
+//Timing and memory of the stages of a run. Each stage is a node of a single
+//stopwatch tree, and records the peak resident set size reached while it was
+//running and the heap allocations done in the meantime (by all threads)
+class RunStats {
+public:
+    //with perStagePeak the peak RSS is reset at the start of the run and of
+    //each stage, which is only meaningful when no other mesh is processed by
+    //the same process at the same time
+    explicit RunStats(const std::string& name, bool perStagePeak = true);
+
+    class Scope {
+    public:
+        //no-op when stats is null
+        Scope(RunStats* stats, const std::string& name);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        RunStats* stats;
+    };
+
+    //called when a stage is entered or left, with its path (e.g. "quadwild/trace/load")
+    typedef std::function<void(const std::string& path, bool entered)> StageListener;
+    void setStageListener(const StageListener& listener);
+
+    //stop the root stage, call before reading the results
+    void finish();
+
+    //attach the stopwatch tree of a library call (e.g. quadrangulationFromPatches)
+    void addStopWatch(const Timekeeper::HierarchicalStopWatchResult& result);
+
+    Timekeeper::HierarchicalStopWatchResult stopWatchResult() const;
+    nlohmann::json memoryJson() const;
+    nlohmann::json toJson() const;
+
+private:
+    struct Node {
+        Node(const std::string& name) : sw(name) {}
+        Node(const std::string& name, Node& parent) : sw(name, parent.sw) {}
+
+        Timekeeper::HierarchicalStopWatch sw;
+        std::string name;
+        Node* parent = nullptr;
+        std::vector<Node*> children;
+
+        size_t peakRSS = 0;
+        size_t allocations = 0;
+        size_t allocatedBytes = 0;
+
+        //counters when the stage was entered
+        size_t startAllocations = 0;
+        size_t startAllocatedBytes = 0;
+    };
+
+    void begin(const std::string& name);
+    void end();
+    void updatePeaks();
+    std::string path(const Node& node) const;
+    nlohmann::json memoryJson(const Node& node) const;
+
+    bool perStagePeak;
+    StageListener listener;
+    std::deque<Node> nodes;
+    Node* current;
+    std::vector<Timekeeper::HierarchicalStopWatchResult> attached;
+};
+
+//Heap allocations done so far by the process
+size_t allocationCount();
+size_t allocatedBytes();
@@ -0,0 +1,649 @@
+#include "server.h"
+#include "batch.h"
+#include "functions.h"
+#include "deadline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+#include <libTimekeeper/json.hh>
+#include <progress.h>
+
+#ifndef _WIN32
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+
+namespace {
+
+//Output side of a client, shared by the jobs it submitted
+class Connection {
+public:
+    Connection(int fd, bool isSocket) : fd(fd), isSocket(isSocket) {}
+    ~Connection() { close(fd); }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    void send(const nlohmann::json& message)
+    {
+        const std::string line = message.dump() + "\n";
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t written = 0;
+        while (!closed && written < line.size()) {
+            ssize_t n = isSocket ? ::send(fd, line.data() + written, line.size() - written, MSG_NOSIGNAL)
+                                 : ::write(fd, line.data() + written, line.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                closed = true;
+            else
+                written += static_cast<size_t>(n);
+        }
+    }
+
+    //the client went away, its queued jobs are dropped
+    bool isClosed() const { return closed; }
+
+    const int fd;
+
+private:
+    const bool isSocket;
+    std::mutex mutex;
+    std::atomic<bool> closed{false};
+};
+
+//Parsed config files, reloaded when they change on disk
+class ConfigCache {
+public:
+    Parameters get(const std::string& filename)
+    {
+        std::error_code ec;
+        const std::filesystem::file_time_type time = std::filesystem::last_write_time(filename, ec);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = configs.find(filename);
+        if (it != configs.end() && !ec && it->second.first == time)
+            return it->second.second;
+
+        Parameters config;
+        loadConfigFile(filename, config);
+        configs[filename] = std::make_pair(time, config);
+        return config;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<std::string, std::pair<std::filesystem::file_time_type, Parameters>> configs;
+};
+
+//Override the keys of the config file with the "parameters" of a request
+void applyOverrides(const nlohmann::json& overrides, Parameters& parameters)
+{
+    for (auto it = overrides.begin(); it != overrides.end(); ++it) {
+        const std::string& key = it.key();
+        if (key == "do_remesh")
+            parameters.remesh = it.value().get<int>() != 0;
+        else if (key == "sharp_feature_thr")
+            parameters.sharpAngle = it.value().get<float>();
+        else if (key == "alpha")
+            parameters.alpha = it.value().get<float>();
+        else if (key == "scaleFact")
+            parameters.scaleFact = it.value().get<float>();
+        else if (key == "in_memory")
+            parameters.inMemory = it.value().get<int>() != 0;
+        else if (key == "save_intermediate")
+            parameters.saveIntermediate = it.value().get<int>() != 0;
+        else if (key == "binary_patches")
+            parameters.binaryPatches = it.value().get<int>() != 0;
+        else if (key == "cache_dir")
+            parameters.cacheDir = it.value().get<std::string>();
+        else if (key == "iterative_field")
+            parameters.iterativeField = it.value().get<int>() != 0;
+        else if (key == "field_tolerance")
+            parameters.fieldTolerance = it.value().get<float>();
+        else if (key == "pattern_cache")
+            parameters.patternCacheFile = it.value().get<std::string>();
+        else
+            throw std::runtime_error("unknown parameter '" + key + "'");
+    }
+}
+
+struct ServerJob {
+    nlohmann::json id;
+    BatchJob job;
+    nlohmann::json overrides;
+    std::shared_ptr<Connection> connection;
+    std::shared_ptr<Progress> progress; //cancelled by a "cancel" request or when the client goes away
+};
+
+//Seconds between two progress events of the same stage
+static const double progressInterval = 0.5;
+
+class Server {
+public:
+    explicit Server(const ServerOptions& options)
+    {
+        const size_t totalThreads = Scheduler::numThreads();
+        numWorkers = options.jobs > 0 ? options.jobs : std::max<size_t>(1, totalThreads / 4);
+        threadsPerJob = options.threadsPerJob > 0 ? options.threadsPerJob : std::max<size_t>(1, totalThreads / numWorkers);
+
+        for (size_t w = 0; w < numWorkers; w++)
+            workers.emplace_back(&Server::worker, this);
+    }
+
+    ~Server()
+    {
+        stopWorkers();
+    }
+
+    void serveStdin()
+    {
+        //the answers go to the original stdout, the log of the pipeline to stderr
+        std::cout.flush();
+        int out = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        std::shared_ptr<Connection> connection = std::make_shared<Connection>(out, false);
+
+        std::cerr << "Server: reading jobs from stdin, " << numWorkers << " at a time with "
+                  << threadsPerJob << " threads each" << std::endl;
+
+        std::string line;
+        while (!stopping && std::getline(std::cin, line))
+            handleLine(line, connection);
+
+        stopWorkers();
+    }
+
+    void serveSocket(const std::string& path)
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("socket path too long '" + path + "'");
+        }
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error("failed to create socket: " + std::string(std::strerror(errno)));
+        }
+        unlink(path.c_str());
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+            const std::string error = std::strerror(errno);
+            close(listenFd);
+            throw std::runtime_error("failed to listen on '" + path + "': " + error);
+        }
+
+        std::cout << "Server: listening on " << path << ", " << numWorkers << " at a time with "
+                  << threadsPerJob << " threads each" << std::endl;
+
+        while (!stopping) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            reapClients();
+            clients.emplace_back();
+            Client& client = clients.back();
+            client.connection = std::make_shared<Connection>(fd, true);
+            client.thread = std::thread(&Server::readClient, this, client.connection, &client.finished);
+        }
+
+        //stop reading requests, the jobs already queued are completed
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            for (Client& client : clients)
+                shutdown(client.connection->fd, SHUT_RD);
+        }
+        for (Client& client : clients)
+            client.thread.join();
+        clients.clear();
+
+        stopWorkers();
+        close(listenFd);
+        unlink(path.c_str());
+        std::cout << "Server: stopped" << std::endl;
+    }
+
+private:
+    struct Client {
+        std::shared_ptr<Connection> connection;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    void reapClients()
+    {
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (it->finished) {
+                it->thread.join();
+                it = clients.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void readClient(std::shared_ptr<Connection> connection, std::atomic<bool>* finished)
+    {
+        std::string buffer;
+        char chunk[4096];
+        while (true) {
+            ssize_t n = recv(connection->fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            buffer.append(chunk, static_cast<size_t>(n));
+
+            size_t newline;
+            while ((newline = buffer.find('\n')) != std::string::npos) {
+                handleLine(buffer.substr(0, newline), connection);
+                buffer.erase(0, newline + 1);
+            }
+        }
+        *finished = true;
+    }
+
+    //Every request is answered by exactly one "done", "error", "status",
+    //"cancel" or "shutdown" message
+    void handleLine(const std::string& line, const std::shared_ptr<Connection>& connection)
+    {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            return;
+
+        nlohmann::json id;
+        try {
+            nlohmann::json request = nlohmann::json::parse(line);
+            if (!request.is_object()) {
+                throw std::runtime_error("request is not a JSON object");
+            }
+
+            if (request.contains("command")) {
+                const std::string command = request["command"].get<std::string>();
+                nlohmann::json answer = {{"event", command}};
+                if (request.contains("id"))
+                    answer["id"] = request["id"];
+                if (command == "status") {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    answer["queued"] = queue.size();
+                    answer["running"] = running;
+                    answer["completed"] = completed;
+                    answer["failed"] = failed;
+                }
+                else if (command == "cancel") {
+                    //queued jobs are dropped by the workers, running ones stop
+                    //at their next progress check
+                    if (!request.contains("job")) {
+                        throw std::runtime_error("missing job to cancel");
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto range = jobs.equal_range(request["job"].dump());
+                    for (auto it = range.first; it != range.second; ++it)
+                        it->second->cancel();
+                    answer["job"] = request["job"];
+                    answer["found"] = range.first != range.second;
+                }
+                else if (command == "shutdown") {
+                    stopping = true;
+                    if (listenFd >= 0)
+                        shutdown(listenFd, SHUT_RDWR);
+                }
+                else {
+                    throw std::runtime_error("unknown command '" + command + "'");
+                }
+                connection->send(answer);
+                return;
+            }
+
+            ServerJob job;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job.id = request.contains("id") ? request["id"] : nlohmann::json(nextId++);
+            }
+            id = job.id;
+
+            if (!request.contains("mesh")) {
+                throw std::runtime_error("missing mesh");
+            }
+            job.job.meshFilename = request["mesh"].get<std::string>();
+            if (job.job.meshFilename.size() < 4) {
+                throw std::runtime_error("invalid mesh filename '" + job.job.meshFilename + "'");
+            }
+            job.job.sharpFilename = request.value("sharp", std::string());
+            job.job.fieldFilename = request.value("field", std::string());
+            job.job.configFilename = request.value("config", job.job.configFilename);
+            job.job.stopAfterStep = request.value("steps", job.job.stopAfterStep);
+            if (job.job.stopAfterStep < 1 || job.job.stopAfterStep > 3) {
+                throw std::runtime_error("unknown step " + std::to_string(job.job.stopAfterStep) + " to stop after. valid: 1, 2, 3");
+            }
+            //seconds, or a duration as "90s", "500ms" or "2m"
+            if (request.contains("deadline")) {
+                const nlohmann::json& deadline = request["deadline"];
+                job.job.deadline = deadline.is_string() ? Deadline::parseSeconds(deadline.get<std::string>()) : deadline.get<double>();
+                if (job.job.deadline < 0) {
+                    throw std::runtime_error("invalid deadline");
+                }
+            }
+            if (request.contains("parameters")) {
+                //validate the overrides now, they are applied to the config by the worker
+                Parameters check;
+                applyOverrides(request["parameters"], check);
+                job.overrides = request["parameters"];
+            }
+            job.connection = connection;
+            job.progress = jobProgress(id, connection);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping) {
+                    throw std::runtime_error("the server is shutting down");
+                }
+                queue.push_back(job);
+                jobs.emplace(id.dump(), job.progress);
+            }
+            connection->send({{"id", id}, {"event", "queued"}});
+            available.notify_one();
+        }
+        catch (std::exception& e) {
+            nlohmann::json answer = {{"event", "error"}, {"error", e.what()}};
+            if (!id.is_null())
+                answer["id"] = id;
+            connection->send(answer);
+        }
+    }
+
+    void worker()
+    {
+        Scheduler::Budget budget(threadsPerJob);
+        while (true) {
+            ServerJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this]() { return !queue.empty() || workersDone; });
+                if (queue.empty())
+                    return;
+                job = queue.front();
+                queue.pop_front();
+                running++;
+            }
+
+            bool success = false;
+            if (job.progress->cancelled()) {
+                job.connection->send({{"id", job.id}, {"event", "done"}, {"mesh", job.job.meshFilename},
+                                      {"success", false}, {"error", "cancelled"}, {"cancelled", true}});
+            }
+            else if (!job.connection->isClosed()) {
+                success = runServerJob(job);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+            completed++;
+            if (!success)
+                failed++;
+            auto range = jobs.equal_range(job.id.dump());
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second == job.progress) {
+                    jobs.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+
+    //Progress of a job: forwarded to the client as "progress" events, at most
+    //one every progressInterval seconds for the same stage. The job is
+    //cancelled when the client goes away
+    std::shared_ptr<Progress> jobProgress(const nlohmann::json& id, const std::shared_ptr<Connection>& connection)
+    {
+        struct LastEvent {
+            std::string stage;
+            std::chrono::steady_clock::time_point time;
+        };
+        std::shared_ptr<LastEvent> last = std::make_shared<LastEvent>();
+
+        //the connection is held weakly, the job holds it already
+        std::weak_ptr<Connection> weakConnection = connection;
+        return std::make_shared<Progress>([id, weakConnection, last](const std::string& stage, double fraction) {
+            std::shared_ptr<Connection> connection = weakConnection.lock();
+            if (!connection || connection->isClosed())
+                return false;
+
+            const auto now = std::chrono::steady_clock::now();
+            if (stage != last->stage || std::chrono::duration<double>(now - last->time).count() >= progressInterval) {
+                last->stage = stage;
+                last->time = now;
+                connection->send({{"id", id}, {"event", "progress"}, {"stage", stage}, {"fraction", fraction}});
+            }
+            return !connection->isClosed();
+        });
+    }
+
+    bool runServerJob(const ServerJob& serverJob)
+    {
+        const BatchJob& job = serverJob.job;
+        const std::shared_ptr<Connection>& connection = serverJob.connection;
+        const nlohmann::json& id = serverJob.id;
+
+        const auto start = std::chrono::steady_clock::now();
+        auto seconds = [&start]() {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        //the peak RSS of a stage is only its own if no other mesh is running
+        RunStats stats("quadwild", numWorkers == 1);
+        stats.setStageListener([&](const std::string& stage, bool entered) {
+            connection->send({{"id", id}, {"event", "stage"}, {"stage", stage},
+                              {"state", entered ? "begin" : "end"}, {"seconds", seconds()}});
+        });
+
+        nlohmann::json result = {{"id", id}, {"event", "done"}, {"mesh", job.meshFilename}};
+        //the deadline counts from the start of the job, not from its arrival
+        Deadline deadline(job.deadline);
+        std::string error;
+        try {
+            Parameters parameters;
+            {
+                RunStats::Scope scope(&stats, "load_config");
+                parameters = configs.get(job.configFilename);
+            }
+            applyOverrides(serverJob.overrides, parameters);
+            parameters.hasFeature = !job.sharpFilename.empty();
+            parameters.hasField = !job.fieldFilename.empty();
+
+            StageCacheReport report = processMesh(job.meshFilename, job.sharpFilename, job.fieldFilename, parameters, job.stopAfterStep, &stats, &deadline, serverJob.progress.get());
+            for (const std::pair<std::string, std::string>& stage : report.stages)
+                result["stages"][stage.first] = stage.second;
+        }
+        catch (std::exception& e) {
+            error = e.what();
+        }
+        catch (...) {
+            error = "unknown error";
+        }
+        //the libraries report a cancellation with their own errors
+        if (serverJob.progress->cancelled()) {
+            error = "cancelled";
+            result["cancelled"] = true;
+        }
+        stats.setStageListener(RunStats::StageListener());
+        stats.finish();
+
+        result["success"] = error.empty();
+        if (!error.empty())
+            result["error"] = error;
+        result["seconds"] = seconds();
+        result["outputs"] = jobOutputs(job);
+        if (deadline.limited())
+            result["deadline"] = deadline.toJson();
+        result.update(stats.toJson());
+        connection->send(result);
+
+        return error.empty();
+    }
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            workersDone = true;
+        }
+        available.notify_all();
+        for (std::thread& t : workers)
+            t.join();
+        workers.clear();
+    }
+
+    size_t numWorkers;
+    size_t threadsPerJob;
+    std::vector<std::thread> workers;
+    ConfigCache configs;
+
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<ServerJob> queue;
+    std::multimap<std::string, std::shared_ptr<Progress>> jobs; //queued and running, by id
+    bool workersDone = false;
+    size_t running = 0;
+    size_t completed = 0;
+    size_t failed = 0;
+    size_t nextId = 1;
+
+    std::atomic<bool> stopping{false};
+    int listenFd = -1;
+    std::mutex clientsMutex;
+    std::list<Client> clients;
+};
+
+}
+
+void runServer(const ServerOptions& options)
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    Server server(options);
+    if (options.socketPath.empty())
+        server.serveStdin();
+    else
+        server.serveSocket(options.socketPath);
+}
+
+size_t runClient(const std::string& socketPath)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("socket path too long '" + socketPath + "'");
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        const std::string error = std::strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        throw std::runtime_error("failed to connect to '" + socketPath + "': " + error);
+    }
+
+    //shared with the writer, which is left behind if the server goes away
+    //while stdin is still open
+    struct Input {
+        std::atomic<size_t> sent{0};
+        std::atomic<bool> done{false};
+    };
+    std::shared_ptr<Input> input = std::make_shared<Input>();
+    std::thread writer([fd, input]() {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            line += "\n";
+            if (::send(fd, line.data(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(line.size()))
+                break;
+            input->sent++;
+        }
+        input->done = true;
+    });
+
+    size_t answered = 0;
+    size_t failedJobs = 0;
+    std::string buffer;
+    char chunk[4096];
+    while (!(input->done && answered >= input->sent)) {
+        pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        buffer.append(chunk, static_cast<size_t>(n));
+
+        size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos) {
+            const std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            std::cout << line << std::endl;
+
+            nlohmann::json message = nlohmann::json::parse(line, nullptr, false);
+            const std::string event = message.is_object() ? message.value("event", std::string()) : std::string();
+            if (event == "error" || (event == "done" && !message.value("success", false)))
+                failedJobs++;
+            if (event == "done" || event == "error" || event == "status" || event == "cancel" || event == "shutdown")
+                answered++;
+        }
+    }
+
+    if (input->done) {
+        writer.join();
+        close(fd);
+    }
+    else {
+        writer.detach();
+    }
+
+    return failedJobs;
+}
+
+#else
+
+void runServer(const ServerOptions&)
+{
+    throw std::runtime_error("the server mode is not supported on Windows");
+}
+
+size_t runClient(const std::string&)
+{
+    throw std::runtime_error("the server mode is not supported on Windows");
+}
+
+#endif
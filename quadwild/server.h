@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+//Long running quadwild process, receiving jobs as JSON lines and answering
+//with JSON lines. A job request:
+//  {"id": 1, "mesh": "a.obj", "sharp": "a.sharp", "field": "a.rosy",
+//   "config": "basic_setup.txt", "steps": 3, "parameters": {"alpha": 0.01},
+//   "deadline": "60s"}
+//where "parameters" overrides the keys of the config file and "deadline"
+//(seconds or a duration) is the time budget of the job. The answers are
+//  {"id": 1, "event": "queued"}
+//  {"id": 1, "event": "stage", "stage": "quadwild/trace", "state": "begin", "seconds": 0.5}
+//  {"id": 1, "event": "progress", "stage": "remesh_adapt", "fraction": 0.25}
+//  {"id": 1, "event": "done", "success": true, "outputs": [...], "runtimes": ..., "memory": ...}
+//Other requests: {"command": "status"}, {"command": "shutdown"} and
+//{"command": "cancel", "job": 1}, which stops a queued or running job (its
+//"done" has "cancelled": true). The jobs of a client that goes away are
+//cancelled too. Config files and the pattern cache stay loaded between jobs
+struct ServerOptions {
+    std::string socketPath;   //Unix domain socket to listen on, empty for stdin/stdout
+    size_t jobs = 0;          //meshes processed at the same time (0: automatic)
+    size_t threadsPerJob = 0; //threads used inside each mesh (0: cores / jobs)
+};
+
+//serve until a shutdown request (or the end of stdin), throws if the server cannot start
+void runServer(const ServerOptions& options);
+
+//send the JSON lines of stdin to the server and print its answers, until every
+//job sent has finished. Returns the number of failed jobs
+size_t runClient(const std::string& socketPath);
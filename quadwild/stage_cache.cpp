@@ -0,0 +1,149 @@
+#include "stage_cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+StageCache::StageCache(const std::string& directory) :
+    directory(directory)
+{
+
+}
+
+uint64_t StageCache::hashString(const std::string& str, uint64_t seed)
+{
+    uint64_t hash = seed;
+    for (const char& c : str) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t StageCache::hashFile(const std::string& filename, uint64_t seed)
+{
+    std::ifstream input(filename, std::ios::binary);
+    if (!input.is_open()) {
+        throw std::runtime_error("stage cache: failed to read '" + filename + "'");
+    }
+
+    uint64_t hash = seed;
+    std::vector<char> buffer(1 << 20);
+    while (input) {
+        input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        const std::streamsize read = input.gcount();
+        for (std::streamsize i = 0; i < read; i++) {
+            hash ^= static_cast<unsigned char>(buffer[static_cast<size_t>(i)]);
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+std::string StageCache::entryPath(const std::string& stage, const uint64_t key) const
+{
+    std::ostringstream name;
+    name << stage << "-" << std::hex << std::setw(16) << std::setfill('0') << key;
+    return (fs::path(directory) / name.str()).string();
+}
+
+//Files <prefix>.<extension> with the part after the prefix
+static std::vector<std::pair<fs::path, std::string>> stageFiles(const std::string& prefix)
+{
+    std::vector<std::pair<fs::path, std::string>> files;
+
+    const fs::path prefixPath(prefix);
+    fs::path parent = prefixPath.parent_path();
+    if (parent.empty())
+        parent = ".";
+    const std::string stem = prefixPath.filename().string() + ".";
+
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(parent, ec)) {
+        if (!entry.is_regular_file())
+            continue;
+        const std::string name = entry.path().filename().string();
+        if (name.size() > stem.size() && name.compare(0, stem.size(), stem) == 0)
+            files.emplace_back(entry.path(), name.substr(stem.size() - 1));
+    }
+    return files;
+}
+
+bool StageCache::restore(const std::string& stage, const uint64_t key, const std::string& prefix) const
+{
+    if (!enabled())
+        return false;
+
+    const fs::path entry(entryPath(stage, key));
+    std::error_code ec;
+    if (!fs::is_directory(entry, ec))
+        return false;
+
+    size_t restored = 0;
+    for (const fs::directory_entry& file : fs::directory_iterator(entry, ec)) {
+        //cached files are named "data" followed by the original suffix
+        const std::string suffix = file.path().filename().string().substr(4);
+        fs::copy_file(file.path(), prefix + suffix, fs::copy_options::overwrite_existing, ec);
+        if (ec) {
+            std::cerr << "stage cache: failed to restore " << file.path() << ": " << ec.message() << std::endl;
+            return false;
+        }
+        restored++;
+    }
+
+    return restored > 0;
+}
+
+void StageCache::store(const std::string& stage, const uint64_t key, const std::string& prefix) const
+{
+    if (!enabled())
+        return;
+
+    const fs::path entry(entryPath(stage, key));
+    std::error_code ec;
+    if (fs::is_directory(entry, ec))
+        return;
+
+    //Write to a temporary directory first, so that concurrent runs never see
+    //a partial entry
+    std::ostringstream tmpName;
+    tmpName << entry.filename().string() << ".tmp-" << std::this_thread::get_id() << "-" << std::random_device()();
+    const fs::path tmp = entry.parent_path() / tmpName.str();
+
+    fs::create_directories(tmp, ec);
+    if (ec) {
+        std::cerr << "stage cache: failed to create " << tmp << ": " << ec.message() << std::endl;
+        return;
+    }
+
+    for (const std::pair<fs::path, std::string>& file : stageFiles(prefix)) {
+        fs::copy_file(file.first, tmp / ("data" + file.second), fs::copy_options::overwrite_existing, ec);
+        if (ec) {
+            std::cerr << "stage cache: failed to store " << file.first << ": " << ec.message() << std::endl;
+            fs::remove_all(tmp, ec);
+            return;
+        }
+    }
+
+    fs::rename(tmp, entry, ec);
+    if (ec) {
+        //another run stored the same entry in the meantime
+        fs::remove_all(tmp, ec);
+    }
+}
+
+void StageCacheReport::print() const
+{
+    std::cout << "Stage cache:" << std::endl;
+    for (const std::pair<std::string, std::string>& stage : stages)
+        std::cout << "  " << stage.first << ": " << stage.second << std::endl;
+}
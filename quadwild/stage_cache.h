@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Cache of the files written by a stage of the pipeline, addressed by a hash of
+//everything the stage depends on (input files and parameters). The files of a
+//stage are the ones named <prefix>.<extension>, e.g. mesh_rem.obj/.rosy/.sharp
+class StageCache {
+public:
+    //an empty directory disables the cache
+    explicit StageCache(const std::string& directory);
+
+    bool enabled() const { return !directory.empty(); }
+
+    //FNV-1a, chained through the seed
+    static uint64_t hashString(const std::string& str, uint64_t seed = 14695981039346656037ull);
+    static uint64_t hashFile(const std::string& filename, uint64_t seed = 14695981039346656037ull);
+
+    //copy the cached files of the stage to <prefix>.*, returns false on a miss
+    bool restore(const std::string& stage, const uint64_t key, const std::string& prefix) const;
+
+    //save the files <prefix>.* as the output of the stage
+    void store(const std::string& stage, const uint64_t key, const std::string& prefix) const;
+
+private:
+    std::string entryPath(const std::string& stage, const uint64_t key) const;
+
+    std::string directory;
+};
+
+//Outcome of each stage of a run: "hit", "computed" or "skipped"
+struct StageCacheReport {
+    std::vector<std::pair<std::string, std::string>> stages;
+
+    void add(const std::string& stage, const std::string& status) { stages.emplace_back(stage, status); }
+    void print() const;
+};
@@ -1,9 +1,50 @@
 #include "trace.h"
+#include "run_stats.h"
+#include "deadline.h"
 
 #include <tracing/tracer_interface.h>
+#include <fast_mesh_import.h>
+#include <progress.h>
 
-bool trace(const std::string& filename_prefix, TraceMesh& traceTrimesh)
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <sstream>
+
+std::string TraceSettings::key() const
+{
+    std::ostringstream key;
+    key << "trace"
+        << " drift " << drift
+        << " add_only_needed " << addOnlyNeeded
+        << " final_removal " << finalRemoval
+        << " meta_mesh_collapse " << metaMeshCollapse
+        << " force_split " << forceSplit
+        << " sample_ratio " << sampleRatio
+        << " CClarkability " << CClarkability
+        << " split_on_removal " << splitOnRemoval
+        << " away_from_singular " << awayFromSingular
+        << " match_valence " << matchValence
+        << " check_quality_functor " << checkQualityFunctor
+        << " MinVal " << minVal
+        << " MaxVal " << maxVal
+        << " Concave_Need " << concaveNeed;
+    return key.str();
+}
+
+bool trace(const std::string& filename_prefix, TraceMesh& traceTrimesh,
+           const TraceSettings& settings,
+           RunStats* stats,
+           Deadline* deadline,
+           Progress* progress,
+           TracedPatches* patches,
+           bool save)
 {
+    std::optional<RunStats::Scope> loadScope;
+    loadScope.emplace(stats, "load");
+    if (progress != nullptr)
+        progress->report("load", 0);
+
     std::string meshFilename = filename_prefix + ".obj";
     std::string fieldFilename = filename_prefix + ".rosy";
     std::string sharpFilename = filename_prefix + ".sharp";
@@ -14,7 +55,9 @@ bool trace(const std::string& filename_prefix, TraceMesh& traceTrimesh)
 
     //Mesh load
     printf("Loading the mesh \n");
-    bool loadedMesh=traceTrimesh.LoadMesh(meshFilename);
+    bool loadedMesh=FastMeshImporter<TraceMesh>::Open(traceTrimesh,meshFilename);
+    if (!loadedMesh)
+        loadedMesh=traceTrimesh.LoadMesh(meshFilename);
     if (!loadedMesh) {
         std::cerr << "failed to load mesh from " << meshFilename << std::endl;
         return false;
@@ -35,6 +78,32 @@ bool trace(const std::string& filename_prefix, TraceMesh& traceTrimesh)
         std::cerr << "failed to load features from " << sharpFilename << std::endl;
         return false;
     }
+    loadScope.reset();
+
+    traceLoadedMesh(filename_prefix, traceTrimesh, settings, stats, deadline, progress, patches, save);
+    return true;
+}
+
+void traceLoadedMesh(const std::string& filename_prefix, TraceMesh& traceTrimesh,
+                     const TraceSettings& settings,
+                     RunStats* stats,
+                     Deadline* deadline,
+                     Progress* progress,
+                     TracedPatches* patches,
+                     bool save)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::optional<RunStats::Scope> scope;
+    //each step of the tracer is a stage, the tracer can be cancelled between them
+    auto step = [&scope, stats, progress](const std::string& name) {
+        scope.reset();
+        scope.emplace(stats, name);
+        if (progress != nullptr)
+            progress->report(name, 0);
+    };
+
+    step("preprocess");
+
     traceTrimesh.SolveGeometricIssues();
     traceTrimesh.UpdateSharpFeaturesFromSelection();
 
@@ -46,27 +115,79 @@ bool trace(const std::string& filename_prefix, TraceMesh& traceTrimesh)
     VGraph.InitGraph(false);
 
     //INIT TRACER
+    step("init_tracer");
     typedef PatchTracer<TraceMesh> TracerType;
     TracerType PTr(VGraph);
-    TraceMesh::ScalarType Drift=100;
-    bool add_only_needed=true;
-    bool final_removal=true;
-    bool meta_mesh_collapse=true;
-    bool force_split=false;
-    PTr.sample_ratio=0.01;
-    PTr.CClarkability=1;
-    PTr.split_on_removal=true;
-    PTr.away_from_singular=true;
-    PTr.match_valence=true;
-    PTr.check_quality_functor=false;
-    PTr.MinVal=3;
-    PTr.MaxVal=5;
-    PTr.Concave_Need=1;
+    TraceMesh::ScalarType Drift=settings.drift;
+    bool add_only_needed=settings.addOnlyNeeded;
+    bool final_removal=settings.finalRemoval;
+    bool meta_mesh_collapse=settings.metaMeshCollapse;
+    bool force_split=settings.forceSplit;
+    PTr.sample_ratio=settings.sampleRatio;
+    PTr.CClarkability=settings.CClarkability;
+    PTr.split_on_removal=settings.splitOnRemoval;
+    PTr.away_from_singular=settings.awayFromSingular;
+    PTr.match_valence=settings.matchValence;
+    PTr.check_quality_functor=settings.checkQualityFunctor;
+    PTr.MinVal=settings.minVal;
+    PTr.MaxVal=settings.maxVal;
+    PTr.Concave_Need=settings.concaveNeed;
 
     //TRACING
     PTr.InitTracer(Drift,false);
+
+    //the recursive process takes a few times the preprocessing, without
+    //enough time left skip its optional removal and collapse passes
+    if (deadline != nullptr && deadline->limited() && (final_removal || meta_mesh_collapse)) {
+        const double spent = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (deadline->stageRemaining() < 3 * spent) {
+            final_removal=false;
+            meta_mesh_collapse=false;
+            deadline->degrade("skipped final removal and meta mesh collapse");
+        }
+    }
+
+    step("recursive_process");
     RecursiveProcess<TracerType>(PTr,Drift, add_only_needed,final_removal,true,meta_mesh_collapse,force_split,true,false);
+
+    step("smooth_patches");
     PTr.SmoothPatches();
-    SaveAllData(PTr,filename_prefix,0,false,false);
-    return true;
+
+    if (patches != nullptr) {
+        step("copy_patches");
+        TraceMesh& tracedMesh = PTr.Mesh();
+        patches->partitions = PTr.Partitions;
+        patches->corners = PTr.PartitionCorners;
+
+        //the sharp face edges, and the ends and junctions of the feature lines
+        patches->features.clear();
+        std::vector<std::pair<size_t,size_t>> sharpEdges;
+        for (size_t i=0;i<tracedMesh.face.size();i++)
+            for (int j=0;j<3;j++)
+            {
+                if (!tracedMesh.face[i].IsFaceEdgeS(j))continue;
+                patches->features.push_back(std::pair<size_t,size_t>(i,j));
+                size_t v0=vcg::tri::Index(tracedMesh,tracedMesh.face[i].V0(j));
+                size_t v1=vcg::tri::Index(tracedMesh,tracedMesh.face[i].V1(j));
+                sharpEdges.push_back(std::minmax(v0,v1));
+            }
+        std::sort(sharpEdges.begin(),sharpEdges.end());
+        sharpEdges.erase(std::unique(sharpEdges.begin(),sharpEdges.end()),sharpEdges.end());
+
+        std::vector<size_t> sharpValence(tracedMesh.vert.size(),0);
+        for (const auto& edge : sharpEdges)
+        {
+            sharpValence[edge.first]++;
+            sharpValence[edge.second]++;
+        }
+        patches->featuresC.clear();
+        for (size_t i=0;i<sharpValence.size();i++)
+            if (sharpValence[i]!=0 && sharpValence[i]!=2)
+                patches->featuresC.push_back(i);
+    }
+
+    if (save) {
+        step("save");
+        SaveAllData(PTr,filename_prefix,0,false,false);
+    }
 }
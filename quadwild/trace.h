@@ -1,5 +1,60 @@
 #pragma once
 #include <string>
+#include <utility>
+#include <vector>
 #include <tracing/mesh_type.h>
 
-bool trace(const std::string& filename_prefix, TraceMesh& traceTrimesh);
+class RunStats;
+class Deadline;
+class Progress;
+
+//settings of the patch tracer
+struct TraceSettings {
+    double drift = 100;
+    bool addOnlyNeeded = true;
+    bool finalRemoval = true;
+    bool metaMeshCollapse = true;
+    bool forceSplit = false;
+    double sampleRatio = 0.01;
+    int CClarkability = 1;
+    bool splitOnRemoval = true;
+    bool awayFromSingular = true;
+    bool matchValence = true;
+    bool checkQualityFunctor = false;
+    int minVal = 3;
+    int maxVal = 5;
+    int concaveNeed = 1;
+
+    //textual form of the settings, used to key the stage cache
+    std::string key() const;
+};
+
+//patch decomposition of a traced mesh, indices into its faces and vertices
+struct TracedPatches {
+    std::vector<std::vector<size_t>> partitions;
+    std::vector<std::vector<size_t>> corners;
+    std::vector<std::pair<size_t,size_t>> features; //face, edge
+    std::vector<size_t> featuresC;
+};
+
+bool trace(const std::string& filename_prefix, TraceMesh& traceTrimesh,
+           const TraceSettings& settings = TraceSettings(),
+           RunStats* stats = nullptr,
+           Deadline* deadline = nullptr,
+           Progress* progress = nullptr,
+           TracedPatches* patches = nullptr,
+           bool save = true);
+
+//trace a mesh whose field and sharp features are already set, the patch
+//decomposition is saved with the given prefix if save is set, and copied to
+//patches if given (the traced mesh is traceTrimesh itself). With a deadline,
+//the optional passes of the tracer are skipped when the stage is short on
+//time. The steps of the tracer are reported to progress, which can cancel it
+//between them
+void traceLoadedMesh(const std::string& filename_prefix, TraceMesh& traceTrimesh,
+                     const TraceSettings& settings = TraceSettings(),
+                     RunStats* stats = nullptr,
+                     Deadline* deadline = nullptr,
+                     Progress* progress = nullptr,
+                     TracedPatches* patches = nullptr,
+                     bool save = true);